@@ -0,0 +1,503 @@
+/*
+* Copyright (c) 2026 Apple Inc. All rights reserved.
+*
+* @APPLE_LICENSE_HEADER_START@
+*
+* This file contains Original Code and/or Modifications of Original Code
+* as defined in and that are subject to the Apple Public Source License
+* Version 2.0 (the 'License'). You may not use this file except in
+* compliance with the License. Please obtain a copy of the License at
+* http://www.opensource.apple.com/apsl/ and read it before using this
+* file.
+*
+* The Original Code and all software distributed under the License are
+* distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+* EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+* INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+* Please see the License for the specific language governing rights and
+* limitations under the License.
+*
+* @APPLE_LICENSE_HEADER_END@
+*/
+
+/*
+ * Streaming implementation of the BLAKE3 hash function (unkeyed, 256-bit
+ * output).  Whole power-of-two subtrees of the input are hashed without
+ * going through the incremental chunk state, four chunks at a time with
+ * SSE2 where available, and split across blake3_nthreads threads when
+ * they are large enough.
+ */
+
+#include <sys/param.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+#include "extern.h"
+
+#define	BLAKE3_BLOCK_LEN	64
+#define	BLAKE3_CHUNK_LEN	1024
+
+#define	CHUNK_START		(1 << 0)
+#define	CHUNK_END		(1 << 1)
+#define	PARENT			(1 << 2)
+#define	ROOT			(1 << 3)
+
+#ifndef nitems
+#define	nitems(x)	(sizeof((x)) / sizeof((x)[0]))
+#endif
+
+/* Do not bother with threads for subtrees smaller than this. */
+#define	BLAKE3_PIECE_MIN	(128 * BLAKE3_CHUNK_LEN)
+
+int blake3_nthreads = 1;
+
+static const uint32_t blake3_iv[8] = {
+	0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+	0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+};
+
+static const uint8_t blake3_schedule[7][16] = {
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+	{ 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 },
+	{ 3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1 },
+	{ 10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6 },
+	{ 12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4 },
+	{ 9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7 },
+	{ 11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13 },
+};
+
+#define	ROTR32(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+#define	G(v, a, b, c, d, x, y) do {					\
+	v[a] += v[b] + (x);	v[d] = ROTR32(v[d] ^ v[a], 16);		\
+	v[c] += v[d];		v[b] = ROTR32(v[b] ^ v[c], 12);		\
+	v[a] += v[b] + (y);	v[d] = ROTR32(v[d] ^ v[a], 8);		\
+	v[c] += v[d];		v[b] = ROTR32(v[b] ^ v[c], 7);		\
+} while (0)
+
+static inline uint32_t
+rd32(const u_char *p)
+{
+	return ((uint32_t)p[0] | (uint32_t)p[1] << 8 |
+	    (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+}
+
+static inline void
+wr32le(u_char *p, uint32_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = v >> 24;
+}
+
+/* Compress one block into cv; only the chaining value half is kept. */
+static void
+blake3_compress(uint32_t cv[8], const u_char *block, u_int blen,
+    uint64_t counter, u_int flags)
+{
+	uint32_t m[16], v[16];
+	const uint8_t *s;
+	int i, r;
+
+	for (i = 0; i < 16; i++)
+		m[i] = rd32(block + 4 * i);
+	memcpy(v, cv, 8 * sizeof(*v));
+	memcpy(v + 8, blake3_iv, 4 * sizeof(*v));
+	v[12] = (uint32_t)counter;
+	v[13] = (uint32_t)(counter >> 32);
+	v[14] = blen;
+	v[15] = flags;
+	for (r = 0; r < 7; r++) {
+		s = blake3_schedule[r];
+		G(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+		G(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+		G(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+		G(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+		G(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+		G(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+		G(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+		G(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+	}
+	for (i = 0; i < 8; i++)
+		cv[i] = v[i] ^ v[i + 8];
+}
+
+static void
+blake3_parent(uint32_t cv[8], const uint32_t left[8], const uint32_t right[8],
+    u_int flags)
+{
+	u_char block[BLAKE3_BLOCK_LEN];
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		wr32le(block + 4 * i, left[i]);
+		wr32le(block + 32 + 4 * i, right[i]);
+	}
+	memcpy(cv, blake3_iv, sizeof(blake3_iv));
+	blake3_compress(cv, block, BLAKE3_BLOCK_LEN, 0, PARENT | flags);
+}
+
+static void
+blake3_chunk(uint32_t cv[8], const u_char *p, uint64_t counter)
+{
+	int b;
+
+	memcpy(cv, blake3_iv, sizeof(blake3_iv));
+	for (b = 0; b < BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN; b++)
+		blake3_compress(cv, p + b * BLAKE3_BLOCK_LEN, BLAKE3_BLOCK_LEN,
+		    counter, (b == 0 ? CHUNK_START : 0) |
+		    (b == BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN - 1 ? CHUNK_END : 0));
+}
+
+#if defined(__x86_64__)
+#define	BLAKE3_SIMD_DEGREE	4
+
+#define	ROTRV(x, n)	_mm_or_si128(_mm_srli_epi32((x), (n)),		\
+	    _mm_slli_epi32((x), 32 - (n)))
+
+#define	GV(a, b, c, d, x, y) do {					\
+	v[a] = _mm_add_epi32(_mm_add_epi32(v[a], v[b]), (x));		\
+	v[d] = ROTRV(_mm_xor_si128(v[d], v[a]), 16);			\
+	v[c] = _mm_add_epi32(v[c], v[d]);				\
+	v[b] = ROTRV(_mm_xor_si128(v[b], v[c]), 12);			\
+	v[a] = _mm_add_epi32(_mm_add_epi32(v[a], v[b]), (y));		\
+	v[d] = ROTRV(_mm_xor_si128(v[d], v[a]), 8);			\
+	v[c] = _mm_add_epi32(v[c], v[d]);				\
+	v[b] = ROTRV(_mm_xor_si128(v[b], v[c]), 7);			\
+} while (0)
+
+static inline void
+transpose4(__m128i *a, __m128i *b, __m128i *c, __m128i *d)
+{
+	__m128i ab01, ab23, cd01, cd23;
+
+	ab01 = _mm_unpacklo_epi32(*a, *b);
+	ab23 = _mm_unpackhi_epi32(*a, *b);
+	cd01 = _mm_unpacklo_epi32(*c, *d);
+	cd23 = _mm_unpackhi_epi32(*c, *d);
+	*a = _mm_unpacklo_epi64(ab01, cd01);
+	*b = _mm_unpackhi_epi64(ab01, cd01);
+	*c = _mm_unpacklo_epi64(ab23, cd23);
+	*d = _mm_unpackhi_epi64(ab23, cd23);
+}
+
+/*
+ * Hash four consecutive whole chunks, one per 32-bit lane.
+ */
+static void
+blake3_chunk4(uint32_t cvs[][8], const u_char *p, uint64_t counter)
+{
+	__m128i h[8], m[16], v[16], clo, chi;
+	uint32_t out[8][4];
+	const uint8_t *s;
+	int b, i, j, r;
+
+	for (i = 0; i < 8; i++)
+		h[i] = _mm_set1_epi32((int)blake3_iv[i]);
+	clo = _mm_set_epi32((int)(uint32_t)(counter + 3),
+	    (int)(uint32_t)(counter + 2), (int)(uint32_t)(counter + 1),
+	    (int)(uint32_t)counter);
+	chi = _mm_set_epi32((int)(uint32_t)((counter + 3) >> 32),
+	    (int)(uint32_t)((counter + 2) >> 32),
+	    (int)(uint32_t)((counter + 1) >> 32),
+	    (int)(uint32_t)(counter >> 32));
+
+	for (b = 0; b < BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN; b++) {
+		for (i = 0; i < 4; i++) {
+			for (j = 0; j < 4; j++)
+				m[4 * i + j] = _mm_loadu_si128(
+				    (const __m128i *)(const void *)(p +
+				    j * BLAKE3_CHUNK_LEN + b * BLAKE3_BLOCK_LEN +
+				    16 * i));
+			transpose4(&m[4 * i], &m[4 * i + 1], &m[4 * i + 2],
+			    &m[4 * i + 3]);
+		}
+		for (i = 0; i < 8; i++)
+			v[i] = h[i];
+		for (i = 0; i < 4; i++)
+			v[8 + i] = _mm_set1_epi32((int)blake3_iv[i]);
+		v[12] = clo;
+		v[13] = chi;
+		v[14] = _mm_set1_epi32(BLAKE3_BLOCK_LEN);
+		v[15] = _mm_set1_epi32((b == 0 ? CHUNK_START : 0) |
+		    (b == BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN - 1 ? CHUNK_END : 0));
+		for (r = 0; r < 7; r++) {
+			s = blake3_schedule[r];
+			GV(0, 4, 8, 12, m[s[0]], m[s[1]]);
+			GV(1, 5, 9, 13, m[s[2]], m[s[3]]);
+			GV(2, 6, 10, 14, m[s[4]], m[s[5]]);
+			GV(3, 7, 11, 15, m[s[6]], m[s[7]]);
+			GV(0, 5, 10, 15, m[s[8]], m[s[9]]);
+			GV(1, 6, 11, 12, m[s[10]], m[s[11]]);
+			GV(2, 7, 8, 13, m[s[12]], m[s[13]]);
+			GV(3, 4, 9, 14, m[s[14]], m[s[15]]);
+		}
+		for (i = 0; i < 8; i++)
+			h[i] = _mm_xor_si128(v[i], v[i + 8]);
+	}
+
+	for (i = 0; i < 8; i++)
+		_mm_storeu_si128((__m128i *)(void *)out[i], h[i]);
+	for (j = 0; j < 4; j++)
+		for (i = 0; i < 8; i++)
+			cvs[j][i] = out[i][j];
+}
+#endif /* __x86_64__ */
+
+/*
+ * Chaining value of a subtree of n whole chunks, n a power of two.
+ */
+static void
+blake3_subtree(uint32_t cv[8], const u_char *p, size_t n, uint64_t counter)
+{
+	uint32_t cvs[16][8];
+	size_t i;
+
+	if (n > 16) {
+		uint32_t left[8], right[8];
+
+		blake3_subtree(left, p, n / 2, counter);
+		blake3_subtree(right, p + n / 2 * BLAKE3_CHUNK_LEN, n / 2,
+		    counter + n / 2);
+		blake3_parent(cv, left, right, 0);
+		return;
+	}
+	i = 0;
+#ifdef BLAKE3_SIMD_DEGREE
+	for (; i + BLAKE3_SIMD_DEGREE <= n; i += BLAKE3_SIMD_DEGREE)
+		blake3_chunk4(&cvs[i], p + i * BLAKE3_CHUNK_LEN, counter + i);
+#endif
+	for (; i < n; i++)
+		blake3_chunk(cvs[i], p + i * BLAKE3_CHUNK_LEN, counter + i);
+	for (; n > 1; n /= 2)
+		for (i = 0; i < n / 2; i++)
+			blake3_parent(cvs[i], cvs[2 * i], cvs[2 * i + 1], 0);
+	memcpy(cv, cvs[0], sizeof(cvs[0]));
+}
+
+struct blake3_piece {
+	const u_char	*p;
+	size_t		 n;
+	uint64_t	 counter;
+	uint32_t	 cv[8];
+};
+
+static void *
+blake3_piece(void *arg)
+{
+	struct blake3_piece *pc = arg;
+
+	blake3_subtree(pc->cv, pc->p, pc->n, pc->counter);
+	return (NULL);
+}
+
+/*
+ * Reduce a subtree of n > 1 whole chunks to the chaining values of its two
+ * children.  The caller decides later whether their parent is the root.
+ */
+static void
+blake3_subtree2(uint32_t cvs[2][8], const u_char *p, size_t n,
+    uint64_t counter)
+{
+	struct blake3_piece pcs[64];
+	pthread_t tids[64];
+	size_t i, npieces, nthr;
+
+	npieces = 2;
+	while (npieces < (size_t)blake3_nthreads && npieces < nitems(pcs) &&
+	    n / npieces * BLAKE3_CHUNK_LEN >= 2 * BLAKE3_PIECE_MIN)
+		npieces *= 2;
+	/* npieces >= 2: a do-while shows the compiler that pcs[0] is set. */
+	i = 0;
+	do {
+		pcs[i].p = p + i * (n / npieces) * BLAKE3_CHUNK_LEN;
+		pcs[i].n = n / npieces;
+		pcs[i].counter = counter + i * (n / npieces);
+	} while (++i < npieces);
+	nthr = 1;
+	if (blake3_nthreads > 1 &&
+	    n / npieces * BLAKE3_CHUNK_LEN >= BLAKE3_PIECE_MIN)
+		for (; nthr < npieces; nthr++)
+			if (pthread_create(&tids[nthr], NULL, blake3_piece,
+			    &pcs[nthr]) != 0)
+				break;
+	blake3_piece(&pcs[0]);
+	/* Hash here whatever could not be given a thread. */
+	for (i = nthr; i < npieces; i++)
+		blake3_piece(&pcs[i]);
+	for (i = 1; i < nthr; i++)
+		pthread_join(tids[i], NULL);
+	for (; npieces > 2; npieces /= 2)
+		for (i = 0; i < npieces / 2; i++)
+			blake3_parent(pcs[i].cv, pcs[2 * i].cv,
+			    pcs[2 * i + 1].cv, 0);
+	memcpy(cvs[0], pcs[0].cv, sizeof(pcs[0].cv));
+	memcpy(cvs[1], pcs[1].cv, sizeof(pcs[1].cv));
+}
+
+/*
+ * Incremental interface, following the structure of the reference
+ * implementation: completed chaining values are kept on a stack that is
+ * merged lazily, so that the last one is never merged before it is known
+ * whether it belongs to the root.
+ */
+static void
+blake3_push(BLAKE3_CTX *ctx, const uint32_t cv[8], uint64_t counter)
+{
+	/* A tree of counter chunks has one stack entry per set bit. */
+	while (ctx->stacklen > (u_int)__builtin_popcountll(counter)) {
+		ctx->stacklen--;
+		blake3_parent(ctx->stack[ctx->stacklen - 1],
+		    ctx->stack[ctx->stacklen - 1], ctx->stack[ctx->stacklen], 0);
+	}
+	if (cv != NULL)
+		memcpy(ctx->stack[ctx->stacklen++], cv, 8 * sizeof(*cv));
+}
+
+static void
+blake3_chunk_update(BLAKE3_CTX *ctx, const u_char *p, size_t len)
+{
+	size_t n;
+
+	while (len > 0) {
+		if (ctx->buflen == BLAKE3_BLOCK_LEN) {
+			blake3_compress(ctx->cv, ctx->buf, BLAKE3_BLOCK_LEN,
+			    ctx->counter, ctx->blocks == 0 ? CHUNK_START : 0);
+			ctx->blocks++;
+			ctx->buflen = 0;
+		}
+		n = MIN(BLAKE3_BLOCK_LEN - ctx->buflen, len);
+		memcpy(ctx->buf + ctx->buflen, p, n);
+		ctx->buflen += n;
+		p += n;
+		len -= n;
+	}
+}
+
+static inline size_t
+blake3_chunk_len(const BLAKE3_CTX *ctx)
+{
+	return (ctx->blocks * BLAKE3_BLOCK_LEN + ctx->buflen);
+}
+
+static inline u_int
+blake3_chunk_flags(const BLAKE3_CTX *ctx)
+{
+	return ((ctx->blocks == 0 ? CHUNK_START : 0) | CHUNK_END);
+}
+
+static void
+blake3_chunk_reset(BLAKE3_CTX *ctx, uint64_t counter)
+{
+	memcpy(ctx->cv, blake3_iv, sizeof(blake3_iv));
+	ctx->counter = counter;
+	ctx->blocks = 0;
+	ctx->buflen = 0;
+}
+
+void
+BLAKE3Init(BLAKE3_CTX *ctx)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	blake3_chunk_reset(ctx, 0);
+}
+
+void
+BLAKE3Update(BLAKE3_CTX *ctx, const void *buf, size_t len)
+{
+	const u_char *p = buf;
+	uint32_t cv[8], cvs[2][8];
+	uint64_t n;
+	size_t take;
+
+	if (blake3_chunk_len(ctx) > 0) {
+		take = MIN(BLAKE3_CHUNK_LEN - blake3_chunk_len(ctx), len);
+		blake3_chunk_update(ctx, p, take);
+		p += take;
+		len -= take;
+		if (len == 0)
+			return;
+		memcpy(cv, ctx->cv, sizeof(cv));
+		blake3_compress(cv, ctx->buf, ctx->buflen, ctx->counter,
+		    blake3_chunk_flags(ctx));
+		blake3_push(ctx, cv, ctx->counter);
+		blake3_chunk_reset(ctx, ctx->counter + 1);
+	}
+
+	/*
+	 * Consume the largest power-of-two run of whole chunks that keeps
+	 * the tree aligned, always leaving at least one byte for the chunk
+	 * state so that the root is compressed in BLAKE3Final().
+	 */
+	while (len > BLAKE3_CHUNK_LEN) {
+		for (n = 1; n * 2 * BLAKE3_CHUNK_LEN <= len; n *= 2)
+			;
+		while (((n - 1) & ctx->counter) != 0)
+			n /= 2;
+		if (n == 1) {
+			blake3_chunk(cv, p, ctx->counter);
+			blake3_push(ctx, cv, ctx->counter);
+		} else {
+			blake3_subtree2(cvs, p, n, ctx->counter);
+			blake3_push(ctx, cvs[0], ctx->counter);
+			blake3_push(ctx, cvs[1], ctx->counter + n / 2);
+		}
+		ctx->counter += n;
+		p += n * BLAKE3_CHUNK_LEN;
+		len -= n * BLAKE3_CHUNK_LEN;
+	}
+	if (len > 0) {
+		blake3_chunk_update(ctx, p, len);
+		blake3_push(ctx, NULL, ctx->counter);
+	}
+}
+
+void
+BLAKE3Final(u_char digest[BLAKE3_DIGEST_LENGTH], BLAKE3_CTX *ctx)
+{
+	uint32_t cv[8], left[8];
+	u_char block[BLAKE3_BLOCK_LEN];
+	u_int blen, flags, i, remaining;
+
+	/* Find the output node: either the open chunk or the top parent. */
+	if (blake3_chunk_len(ctx) > 0 || ctx->stacklen == 0) {
+		memcpy(cv, ctx->cv, sizeof(cv));
+		memcpy(block, ctx->buf, sizeof(block));
+		memset(block + ctx->buflen, 0, sizeof(block) - ctx->buflen);
+		blen = ctx->buflen;
+		flags = blake3_chunk_flags(ctx);
+		remaining = ctx->stacklen;
+	} else {
+		remaining = ctx->stacklen - 2;
+		memcpy(cv, blake3_iv, sizeof(cv));
+		for (i = 0; i < 8; i++) {
+			wr32le(block + 4 * i, ctx->stack[remaining][i]);
+			wr32le(block + 32 + 4 * i, ctx->stack[remaining + 1][i]);
+		}
+		blen = BLAKE3_BLOCK_LEN;
+		flags = PARENT;
+	}
+	while (remaining-- > 0) {
+		blake3_compress(cv, block, blen, flags == PARENT ? 0 :
+		    ctx->counter, flags);
+		memcpy(left, ctx->stack[remaining], sizeof(left));
+		for (i = 0; i < 8; i++) {
+			wr32le(block + 4 * i, left[i]);
+			wr32le(block + 32 + 4 * i, cv[i]);
+		}
+		memcpy(cv, blake3_iv, sizeof(cv));
+		blen = BLAKE3_BLOCK_LEN;
+		flags = PARENT;
+	}
+	blake3_compress(cv, block, blen, 0, flags | ROOT);
+	for (i = 0; i < 8; i++)
+		wr32le(digest + 4 * i, cv[i]);
+	memset(ctx, 0, sizeof(*ctx));
+}
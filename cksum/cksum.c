@@ -48,70 +48,223 @@ static char sccsid[] = "@(#)cksum.c	8.2 (Berkeley) 4/28/95";
 #include <sys/cdefs.h>
 __FBSDID("$FreeBSD$");
 
-#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/stat.h>
 
+#include <ctype.h>
 #include <err.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include <libutil.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "extern.h"
 
+#ifndef nitems
+#define	nitems(x)	(sizeof((x)) / sizeof((x)[0]))
+#endif
+
+typedef void (DIGEST_Init)(void *);
+typedef void (DIGEST_Final)(u_char *, void *);
+
+/*
+ * Digest algorithms selectable with -a.  Each one given is computed over
+ * the same single pass through the input.
+ */
+static const struct algorithm {
+	const char	*name;
+	size_t		 dlen;
+	DIGEST_Init	*init;
+	cksum_fn	 update;
+	DIGEST_Final	*final;
+} algorithms[] = {
+	{ "xxh64", XXH64_DIGEST_LENGTH, (DIGEST_Init *)&XXH64Init,
+	    (cksum_fn)&XXH64Update, (DIGEST_Final *)&XXH64Final },
+	{ "xxh3", XXH3_DIGEST_LENGTH, (DIGEST_Init *)&XXH3Init,
+	    (cksum_fn)&XXH3Update, (DIGEST_Final *)&XXH3Final },
+	{ "blake3", BLAKE3_DIGEST_LENGTH, (DIGEST_Init *)&BLAKE3Init,
+	    (cksum_fn)&BLAKE3Update, (DIGEST_Final *)&BLAKE3Final },
+};
+
+#define	DIGEST_MAX	(XXH64_DIGEST_LENGTH + XXH3_DIGEST_LENGTH + \
+			    BLAKE3_DIGEST_LENGTH)
+
+union digest_ctx {
+	XXH64_CTX	xxh64;
+	XXH3_CTX	xxh3;
+	BLAKE3_CTX	blake3;
+};
+
+static const struct algorithm *algs[nitems(algorithms)];
+static u_int nalgs;
+
+/*
+ * Per-argument state for -j and -c.  Workers fill these in any order; the
+ * main thread consumes them in argument order so output is unchanged.
+ * The x fields hold the values expected by a -c manifest entry.
+ */
+struct job {
+	char		*fn;
+	uint32_t	 val;
+	u_char		 digest[DIGEST_MAX];
+	off_t		 len;
+	uint32_t	 xval;
+	u_char		 xdigest[DIGEST_MAX];
+	off_t		 xlen;
+	double		 secs;
+	int		 error;
+	int		 badsize;
+	int		 done;
+};
+
+static struct job *jobs;
+static int njobs, nextjob;
+static pthread_mutex_t job_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_cv = PTHREAD_COND_INITIALIZER;
+
+static int (*cfncn)(int, uint32_t *, off_t *);
+static void (*pfncn)(char *, uint32_t, off_t);
+static void (*sfncn)(uint32_t, off_t);
+static int cflag, vflag;
+static off_t blksize = 1;
+
+static int cksum_check(const char *, int);
+static int cksum_parallel(char **, int, int);
+static int check_job(struct job *);
+static int check_line(struct job *, char *);
+static int digest_fd(int, u_char *, off_t *);
+static void digest_input(void *, const void *, size_t);
+static double elapsed(const struct timespec *);
+static void pfile(char *, uint32_t, const u_char *, off_t);
+static int print_job(struct job *);
+static void pstat(const char *, off_t, double);
+static int run_jobs(int, int (*)(struct job *));
+static void *worker(void *);
 static void usage(void);
 
 int
 main(int argc, char **argv)
 {
+	struct timespec start;
+	u_char digest[DIGEST_MAX];
+	uint64_t chunk;
 	uint32_t val;
-	int ch, fd, rval;
+	u_int i;
+	int ch, fd, nthreads, oflag, rval;
 	off_t len;
-	char *fn, *p;
-	int (*cfncn)(int, uint32_t *, off_t *);
-	void (*pfncn)(char *, uint32_t, off_t);
+	char *fn, *manifest, *p;
+	const char *errstr;
 
 	if ((p = strrchr(argv[0], '/')) == NULL)
 		p = argv[0];
 	else
 		++p;
+	nthreads = 1;
+	oflag = 0;
+	manifest = NULL;
 	if (!strcmp(p, "sum")) {
 		cfncn = csum1;
 		pfncn = psum1;
+		sfncn = NULL;
+		--argc;
 		++argv;
 	} else {
-		cfncn = crc;
+		cfncn = crc_fd;
 		pfncn = pcrc;
+		sfncn = crc_sum;
 
-		while ((ch = getopt(argc, argv, "o:")) != -1)
+		while ((ch = getopt(argc, argv, "a:b:c:j:o:v")) != -1)
 			switch (ch) {
+			case 'a':
+				for (i = 0; i < nitems(algorithms); i++)
+					if (strcasecmp(optarg,
+					    algorithms[i].name) == 0)
+						break;
+				if (i == nitems(algorithms)) {
+					warnx("unknown algorithm: %s", optarg);
+					usage();
+				}
+				/* Each algorithm is computed at most once. */
+				for (ch = 0; ch < (int)nalgs; ch++)
+					if (algs[ch] == &algorithms[i])
+						break;
+				if (ch == (int)nalgs)
+					algs[nalgs++] = &algorithms[i];
+				break;
+			case 'b':
+				if (expand_number(optarg, &chunk) != 0 ||
+				    chunk == 0 || chunk > INT64_MAX)
+					errx(1, "-b %s: invalid chunk size",
+					    optarg);
+				crc_chunk = (off_t)chunk;
+				break;
+			case 'c':
+				cflag = 1;
+				manifest = optarg;
+				break;
+			case 'j':
+				nthreads = (int)strtonum(optarg, 1, 256,
+				    &errstr);
+				if (errstr != NULL)
+					errx(1, "-j %s: %s", optarg, errstr);
+				break;
 			case 'o':
+				oflag = 1;
 				if (!strcmp(optarg, "1")) {
 					cfncn = csum1;
 					pfncn = psum1;
+					sfncn = NULL;
+					blksize = 1024;
 				} else if (!strcmp(optarg, "2")) {
 					cfncn = csum2;
 					pfncn = psum2;
+					sfncn = NULL;
+					blksize = 512;
 				} else if (!strcmp(optarg, "3")) {
-					cfncn = crc32;
+					cfncn = crc32_fd;
 					pfncn = pcrc;
+					sfncn = crc32_sum;
+					blksize = 1;
 				} else {
 					warnx("illegal argument to -o option");
 					usage();
 				}
 				break;
+			case 'v':
+				vflag = 1;
+				break;
 			case '?':
 			default:
 				usage();
 			}
 		argc -= optind;
 		argv += optind;
+		if (oflag && nalgs > 0)
+			usage();
+		/* A manifest line carries a single checksum or digest. */
+		if (cflag && (argc > 0 || nalgs > 1))
+			usage();
 	}
 
 	fd = STDIN_FILENO;
 	fn = NULL;
 	rval = 0;
-	do {
+	/*
+	 * With several operands the threads go to whole files; a lone
+	 * operand is instead split into chunks by crc_fd()/crc32_fd().
+	 */
+	crc_nthreads = blake3_nthreads = nthreads;
+	if (cflag)
+		rval = cksum_check(manifest, nthreads);
+	else if (nthreads > 1 && argc > 1)
+		rval = cksum_parallel(argv, argc, nthreads);
+	else do {
 		if (*argv) {
 			fn = *argv++;
 			if ((fd = open(fn, O_RDONLY, 0)) < 0) {
@@ -120,11 +273,16 @@ main(int argc, char **argv)
 				continue;
 			}
 		}
-		if (cfncn(fd, &val, &len)) {
+		(void)clock_gettime(CLOCK_MONOTONIC, &start);
+		if (nalgs > 0 ? digest_fd(fd, digest, &len) :
+		    cfncn(fd, &val, &len)) {
 			warn("%s", fn ? fn : "stdin");
 			rval = 1;
-		} else
-			pfncn(fn, val, len);
+		} else {
+			pfile(fn, val, digest, len);
+			if (vflag)
+				pstat(fn, len, elapsed(&start));
+		}
 		(void)close(fd);
 	} while (*argv);
 #ifdef __APPLE__
@@ -134,10 +292,327 @@ main(int argc, char **argv)
 	exit(rval);
 }
 
+/*
+ * Checksum the named files on up to nthreads threads.  Results are
+ * printed, and folded into the running total, strictly in argument order.
+ */
+static int
+cksum_parallel(char **argv, int argc, int nthreads)
+{
+	int i, rval;
+
+	if ((jobs = calloc(argc, sizeof(*jobs))) == NULL)
+		err(1, "calloc");
+	for (i = 0; i < argc; i++)
+		jobs[i].fn = argv[i];
+	njobs = argc;
+	rval = run_jobs(nthreads, print_job);
+	free(jobs);
+	return (rval);
+}
+
+static int
+print_job(struct job *j)
+{
+	pfile(j->fn, j->val, j->digest, j->len);
+	return (0);
+}
+
+/*
+ * Verify every entry of a manifest written by an earlier run with the
+ * same algorithm.  Only failures are reported, followed by a summary.
+ */
+static int
+cksum_check(const char *manifest, int nthreads)
+{
+	FILE *fp;
+	struct job *j;
+	char *line;
+	size_t linecap;
+	ssize_t linelen;
+	u_long lineno;
+	int i, maxjobs, nbad, nerr, rval;
+
+	if (strcmp(manifest, "-") == 0)
+		fp = stdin;
+	else if ((fp = fopen(manifest, "r")) == NULL)
+		err(1, "%s", manifest);
+
+	rval = 0;
+	line = NULL;
+	linecap = 0;
+	lineno = 0;
+	maxjobs = 0;
+	while ((linelen = getline(&line, &linecap, fp)) > 0) {
+		lineno++;
+		if (line[linelen - 1] == '\n')
+			line[--linelen] = '\0';
+		if (linelen == 0)
+			continue;
+		if (njobs == maxjobs) {
+			maxjobs = maxjobs ? maxjobs * 2 : 64;
+			if ((j = realloc(jobs, maxjobs * sizeof(*jobs))) == NULL)
+				err(1, "realloc");
+			jobs = j;
+		}
+		j = &jobs[njobs];
+		memset(j, 0, sizeof(*j));
+		if (check_line(j, line) != 0) {
+			warnx("%s: line %lu: improperly formatted line",
+			    manifest, lineno);
+			rval = 1;
+			continue;
+		}
+		if ((j->fn = strdup(j->fn)) == NULL)
+			err(1, "strdup");
+		njobs++;
+	}
+	if (ferror(fp))
+		err(1, "%s", manifest);
+	if (fp != stdin)
+		(void)fclose(fp);
+	free(line);
+
+	nbad = run_jobs(nthreads, check_job);
+	for (i = nerr = 0; i < njobs; i++) {
+		if (jobs[i].error != 0)
+			nerr++;
+		free(jobs[i].fn);
+	}
+	free(jobs);
+	(void)printf("%d checked, %d failed, %d unreadable\n",
+	    njobs, nbad - nerr, nerr);
+	return (rval || nbad > 0);
+}
+
+/*
+ * Parse one manifest line, "checksum length file", as written by pcrc(),
+ * psum1(), psum2() or pdigest().  The file name is the rest of the line.
+ */
+static int
+check_line(struct job *j, char *line)
+{
+	const struct algorithm *a;
+	char *p;
+	size_t i;
+	u_long val;
+	intmax_t len;
+
+	p = line;
+	if (nalgs > 0) {
+		a = algs[0];
+		for (i = 0; i < a->dlen; i++, p += 2) {
+			if (!isxdigit((u_char)p[0]) || !isxdigit((u_char)p[1]))
+				return (1);
+			j->xdigest[i] = (u_char)(digittoint(p[0]) << 4 |
+			    digittoint(p[1]));
+		}
+	} else {
+		if (!isdigit((u_char)*p))
+			return (1);
+		errno = 0;
+		val = strtoul(p, &p, 10);
+		if (errno != 0 || val > UINT32_MAX)
+			return (1);
+		j->xval = (uint32_t)val;
+	}
+	if (*p++ != ' ' || !isdigit((u_char)*p))
+		return (1);
+	errno = 0;
+	len = strtoimax(p, &p, 10);
+	if (errno != 0 || *p++ != ' ' || *p == '\0')
+		return (1);
+	j->xlen = (off_t)len;
+	j->fn = p;
+	return (0);
+}
+
+static int
+check_job(struct job *j)
+{
+	if (j->badsize)
+		(void)printf("%s: FAILED (size)\n", j->fn);
+	else if ((blksize == 1 ? j->len : howmany(j->len, blksize)) !=
+	    j->xlen || (nalgs > 0 ?
+	    memcmp(j->digest, j->xdigest, algs[0]->dlen) != 0 :
+	    j->val != j->xval))
+		(void)printf("%s: FAILED\n", j->fn);
+	else
+		return (0);
+	return (1);
+}
+
+/*
+ * Process jobs[] on up to nthreads threads, handing each finished job to
+ * done() in order and returning how many failed.
+ */
+static int
+run_jobs(int nthreads, int (*done)(struct job *))
+{
+	pthread_t *tids;
+	struct job *j;
+	int error, i, nbad;
+
+	if (nthreads > njobs)
+		nthreads = njobs;
+	if ((tids = calloc(MAX(nthreads, 1), sizeof(*tids))) == NULL)
+		err(1, "calloc");
+	if (njobs > 1)
+		crc_nthreads = blake3_nthreads = 1;
+	for (i = 0; i < nthreads; i++)
+		if ((error = pthread_create(&tids[i], NULL, worker, NULL)) != 0)
+			errc(1, error, "pthread_create");
+
+	nbad = 0;
+	for (i = 0; i < njobs; i++) {
+		j = &jobs[i];
+		pthread_mutex_lock(&job_mtx);
+		while (!j->done)
+			pthread_cond_wait(&job_cv, &job_mtx);
+		pthread_mutex_unlock(&job_mtx);
+		if (j->error != 0) {
+			errno = j->error;
+			warn("%s", j->fn);
+			nbad++;
+			continue;
+		}
+		nbad += done(j);
+		if (vflag && !j->badsize)
+			pstat(j->fn, j->len, j->secs);
+	}
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(tids[i], NULL);
+	free(tids);
+	return (nbad);
+}
+
+static void *
+worker(void *arg __unused)
+{
+	struct timespec start;
+	struct stat sb;
+	struct job *j;
+	int fd;
+
+	for (;;) {
+		pthread_mutex_lock(&job_mtx);
+		if (nextjob == njobs) {
+			pthread_mutex_unlock(&job_mtx);
+			break;
+		}
+		j = &jobs[nextjob++];
+		pthread_mutex_unlock(&job_mtx);
+
+		(void)clock_gettime(CLOCK_MONOTONIC, &start);
+		if ((fd = open(j->fn, O_RDONLY, 0)) < 0)
+			j->error = errno;
+		else {
+			/* A regular file of the wrong size need not be read. */
+			if (cflag && fstat(fd, &sb) == 0 &&
+			    S_ISREG(sb.st_mode) && (blksize == 1 ? sb.st_size :
+			    howmany(sb.st_size, blksize)) != j->xlen)
+				j->badsize = 1;
+			else if (nalgs > 0 ?
+			    digest_fd(fd, j->digest, &j->len) :
+			    cfncn(fd, &j->val, &j->len))
+				j->error = errno;
+			(void)close(fd);
+		}
+		j->secs = elapsed(&start);
+
+		pthread_mutex_lock(&job_mtx);
+		j->done = 1;
+		pthread_cond_broadcast(&job_cv);
+		pthread_mutex_unlock(&job_mtx);
+	}
+	return (NULL);
+}
+
+/*
+ * Run every algorithm selected with -a over fd, storing the digests one
+ * after another in digest.
+ */
+static int
+digest_fd(int fd, u_char *digest, off_t *len)
+{
+	union digest_ctx ctx[nitems(algorithms)];
+	u_int i;
+
+	for (i = 0; i < nalgs; i++)
+		algs[i]->init(&ctx[i]);
+	if (nalgs == 1 ? cksum_read(fd, algs[0]->update, &ctx[0], len) :
+	    cksum_read(fd, digest_input, ctx, len))
+		return (1);
+	for (i = 0; i < nalgs; i++) {
+		algs[i]->final(digest, &ctx[i]);
+		digest += algs[i]->dlen;
+	}
+	return (0);
+}
+
+static void
+digest_input(void *arg, const void *buf, size_t len)
+{
+	union digest_ctx *ctx = arg;
+	u_int i;
+
+	for (i = 0; i < nalgs; i++)
+		algs[i]->update(&ctx[i], buf, len);
+}
+
+/*
+ * Write the result for one file, folding it into the running total if the
+ * algorithm keeps one.
+ */
+static void
+pfile(char *fn, uint32_t val, const u_char *digest, off_t len)
+{
+	u_int i;
+
+	if (nalgs == 0) {
+		if (sfncn != NULL)
+			sfncn(val, len);
+		pfncn(fn, val, len);
+		return;
+	}
+	for (i = 0; i < nalgs; i++) {
+		pdigest(fn, digest, algs[i]->dlen, len);
+		digest += algs[i]->dlen;
+	}
+}
+
+static double
+elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((now.tv_sec - start->tv_sec) +
+	    (now.tv_nsec - start->tv_nsec) / 1e9);
+}
+
+/*
+ * Report throughput for -v.  Statistics go to stderr so that the checksum
+ * lines on stdout are unchanged.
+ */
+static void
+pstat(const char *fn, off_t len, double secs)
+{
+	(void)fprintf(stderr, "%s: %jd bytes in %.3f secs (%.0f bytes/sec)\n",
+	    fn ? fn : "stdin", (intmax_t)len, secs,
+	    secs > 0 ? len / secs : 0.0);
+}
+
 static void
 usage(void)
 {
-	(void)fprintf(stderr, "usage: cksum [-o 1 | 2 | 3] [file ...]\n");
+	(void)fprintf(stderr,
+	    "usage: cksum [-b chunk] [-j jobs] [-o 1 | 2 | 3] [-v] [file ...]\n");
+	(void)fprintf(stderr,
+	    "       cksum [-b chunk] [-j jobs] [-v] -a algorithm ... [file ...]\n");
+	(void)fprintf(stderr,
+	    "       cksum [-j jobs] [-o 1 | 2 | 3 | -a algorithm] [-v] -c manifest\n");
 	(void)fprintf(stderr, "       sum [file ...]\n");
 	exit(1);
 }
@@ -40,10 +40,17 @@ static char sccsid[] = "@(#)crc.c	8.1 (Berkeley) 6/17/93";
 #include <sys/cdefs.h>
 __FBSDID("$FreeBSD$");
 
-#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/stat.h>
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 #include "extern.h"
 
@@ -102,6 +109,328 @@ static const uint32_t crctab[] = {
 	0xa2f33668, 0xbcb4666d, 0xb8757bda, 0xb5365d03, 0xb1f740b4
 };
 
+#define	CRC_POLY	0x04c11db7
+
+#define	COMPUTE(var, ch)	(var) = (var) << 8 ^ crctab[(var) >> 24 ^ (ch)]
+
+/*
+ * Slicing-by-8 tables: crcslice[k][i] is the CRC of byte i followed by k
+ * zero bytes, which lets the inner loop consume eight bytes per iteration.
+ */
+static uint32_t crcslice[8][256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+#if defined(__x86_64__) || defined(__i386__)
+#define	CRC_CLMUL
+static int crc_have_clmul;
+static uint64_t crc_k128[2], crc_k512[2];
+static uint64_t crc_k256[2], crc_k384[2];
+#endif
+
+/*
+ * Multiply a and b modulo the CRC polynomial.  Polynomials are stored with
+ * the coefficient of x^0 in the low bit, as in the register form above.
+ */
+static uint32_t
+crc_mulmod(uint32_t a, uint32_t b)
+{
+	uint32_t r;
+	int i;
+
+	for (r = 0, i = 31; i >= 0; i--) {
+		r = (r << 1) ^ ((r & 0x80000000) ? CRC_POLY : 0);
+		if (b & (1U << i))
+			r ^= a;
+	}
+	return (r);
+}
+
+/* Return x^n modulo the CRC polynomial. */
+static uint32_t
+crc_xpow(uint64_t n)
+{
+	uint32_t r, sq;
+
+	for (r = 1, sq = 2; n != 0; n >>= 1) {
+		if (n & 1)
+			r = crc_mulmod(r, sq);
+		sq = crc_mulmod(sq, sq);
+	}
+	return (r);
+}
+
+static void
+crc_init(void)
+{
+	int i, k;
+
+	for (i = 0; i < 256; i++) {
+		crcslice[0][i] = crctab[i];
+		for (k = 1; k < 8; k++)
+			crcslice[k][i] = crcslice[k - 1][i] << 8 ^
+			    crctab[crcslice[k - 1][i] >> 24];
+	}
+#ifdef CRC_CLMUL
+	/*
+	 * Folding a 128-bit lane forward by d bits multiplies its high half
+	 * by x^(d+64) and its low half by x^d.
+	 */
+	crc_k128[0] = crc_xpow(128);
+	crc_k128[1] = crc_xpow(128 + 64);
+	crc_k256[0] = crc_xpow(256);
+	crc_k256[1] = crc_xpow(256 + 64);
+	crc_k384[0] = crc_xpow(384);
+	crc_k384[1] = crc_xpow(384 + 64);
+	crc_k512[0] = crc_xpow(512);
+	crc_k512[1] = crc_xpow(512 + 64);
+	crc_have_clmul = __builtin_cpu_supports("pclmul") &&
+	    __builtin_cpu_supports("ssse3");
+#endif
+}
+
+static uint32_t
+crc_slice8(uint32_t lcrc, const u_char *p, size_t nr)
+{
+	uint32_t a, b;
+
+	for (; nr != 0 && ((uintptr_t)p & 7) != 0; nr--, p++)
+		COMPUTE(lcrc, *p);
+	for (; nr >= 8; nr -= 8, p += 8) {
+		a = lcrc ^ ((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+		    (uint32_t)p[2] << 8 | p[3]);
+		b = (uint32_t)p[4] << 24 | (uint32_t)p[5] << 16 |
+		    (uint32_t)p[6] << 8 | p[7];
+		lcrc = crcslice[7][a >> 24] ^ crcslice[6][(a >> 16) & 0xff] ^
+		    crcslice[5][(a >> 8) & 0xff] ^ crcslice[4][a & 0xff] ^
+		    crcslice[3][b >> 24] ^ crcslice[2][(b >> 16) & 0xff] ^
+		    crcslice[1][(b >> 8) & 0xff] ^ crcslice[0][b & 0xff];
+	}
+	for (; nr != 0; nr--, p++)
+		COMPUTE(lcrc, *p);
+	return (lcrc);
+}
+
+#ifdef CRC_CLMUL
+#define	CRC_FOLD(x, k)							\
+	_mm_xor_si128(_mm_clmulepi64_si128((x), (k), 0x00),		\
+	    _mm_clmulepi64_si128((x), (k), 0x11))
+
+/*
+ * Carry-less multiply folding over four 128-bit lanes.  Input is
+ * byte-swapped so that each lane holds the message most significant
+ * coefficient first, matching the non-reflected register form.  The
+ * folded remainder is reduced through the byte table.
+ */
+__attribute__((target("pclmul,ssse3")))
+static uint32_t
+crc_clmul(uint32_t lcrc, const u_char *p, size_t nr)
+{
+	const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+	    8, 9, 10, 11, 12, 13, 14, 15);
+	__m128i x0, x1, x2, x3, k;
+	u_char tmp[16];
+	int i;
+
+#define	LOAD(off)	_mm_shuffle_epi8(_mm_loadu_si128(		\
+	    (const __m128i *)(const void *)(p + (off))), bswap)
+
+	x0 = _mm_xor_si128(LOAD(0),
+	    _mm_set_epi32((int)lcrc, 0, 0, 0));
+	x1 = LOAD(16);
+	x2 = LOAD(32);
+	x3 = LOAD(48);
+	p += 64;
+	nr -= 64;
+	k = _mm_loadu_si128((const __m128i *)(const void *)crc_k512);
+	for (; nr >= 64; nr -= 64, p += 64) {
+		x0 = _mm_xor_si128(CRC_FOLD(x0, k), LOAD(0));
+		x1 = _mm_xor_si128(CRC_FOLD(x1, k), LOAD(16));
+		x2 = _mm_xor_si128(CRC_FOLD(x2, k), LOAD(32));
+		x3 = _mm_xor_si128(CRC_FOLD(x3, k), LOAD(48));
+	}
+	x0 = CRC_FOLD(x0,
+	    _mm_loadu_si128((const __m128i *)(const void *)crc_k384));
+	x1 = CRC_FOLD(x1,
+	    _mm_loadu_si128((const __m128i *)(const void *)crc_k256));
+	k = _mm_loadu_si128((const __m128i *)(const void *)crc_k128);
+	x2 = CRC_FOLD(x2, k);
+	x0 = _mm_xor_si128(_mm_xor_si128(x0, x1), _mm_xor_si128(x2, x3));
+	for (; nr >= 16; nr -= 16, p += 16)
+		x0 = _mm_xor_si128(CRC_FOLD(x0, k), LOAD(0));
+#undef LOAD
+
+	_mm_storeu_si128((__m128i *)(void *)tmp, _mm_shuffle_epi8(x0, bswap));
+	for (lcrc = 0, i = 0; i < 16; i++)
+		COMPUTE(lcrc, tmp[i]);
+	return (crc_slice8(lcrc, p, nr));
+}
+#endif /* CRC_CLMUL */
+
+/*
+ * Update a running (non-complemented) CRC register with nr bytes from p.
+ */
+uint32_t
+crc_update(uint32_t lcrc, const void *buf, size_t nr)
+{
+	(void)pthread_once(&crc_once, crc_init);
+#ifdef CRC_CLMUL
+	if (crc_have_clmul && nr >= 256)
+		return (crc_clmul(lcrc, buf, nr));
+#endif
+	return (crc_slice8(lcrc, buf, nr));
+}
+
+/*
+ * Given the register value crc1 after some prefix and crc2 after a suffix
+ * of len2 bytes started from zero, return the register value after the
+ * whole sequence.
+ */
+uint32_t
+crc_combine(uint32_t crc1, uint32_t crc2, off_t len2)
+{
+	return (crc_mulmod(crc1, crc_xpow((uint64_t)len2 * 8)) ^ crc2);
+}
+
+/*
+ * Chunked parallel CRC.  A regular file of at least two chunks is split
+ * into crc_chunk sized pieces that are read with pread(2) and hashed on
+ * up to crc_nthreads threads, each from a zero register; the pieces are
+ * then merged in order with the combine function.  Since the CRC is
+ * linear over GF(2) the result is identical to the serial computation.
+ */
+#define	CRC_PBUFSIZE	(1024 * 1024)
+
+int crc_nthreads = 1;			/* Threads per file. */
+off_t crc_chunk = 64 * 1024 * 1024;	/* Bytes per thread work item. */
+
+struct crc_pctx {
+	int		 fd;
+	off_t		 base;
+	off_t		 size;
+	uint32_t	 init;
+	uint32_t	(*update)(uint32_t, const void *, size_t);
+	uint32_t	*regs;
+	off_t		 nchunks;
+	off_t		 next;
+	int		 error;
+	pthread_mutex_t	 mtx;
+};
+
+static void *
+crc_pworker(void *arg)
+{
+	struct crc_pctx *ctx = arg;
+	uint32_t reg;
+	off_t i, off, end;
+	ssize_t nr;
+	void *buf;
+
+	if ((buf = malloc(CRC_PBUFSIZE)) == NULL) {
+		pthread_mutex_lock(&ctx->mtx);
+		ctx->error = errno;
+		pthread_mutex_unlock(&ctx->mtx);
+		return (NULL);
+	}
+	for (;;) {
+		pthread_mutex_lock(&ctx->mtx);
+		i = ctx->error == 0 ? ctx->next++ : ctx->nchunks;
+		pthread_mutex_unlock(&ctx->mtx);
+		if (i >= ctx->nchunks)
+			break;
+
+		off = i * crc_chunk;
+		end = MIN(off + crc_chunk, ctx->size);
+		reg = i == 0 ? ctx->init : 0;
+		while (off < end) {
+			nr = pread(ctx->fd, buf, MIN(CRC_PBUFSIZE, end - off),
+			    ctx->base + off);
+			if (nr <= 0) {
+				/* A short read means the file shrank under us. */
+				pthread_mutex_lock(&ctx->mtx);
+				if (ctx->error == 0)
+					ctx->error = nr < 0 ? errno : EIO;
+				pthread_mutex_unlock(&ctx->mtx);
+				break;
+			}
+			reg = ctx->update(reg, buf, nr);
+			off += nr;
+		}
+		ctx->regs[i] = reg;
+	}
+	free(buf);
+	return (NULL);
+}
+
+/*
+ * Advance *reg over the remainder of fd if it is a regular file large
+ * enough to be worth splitting.  On success the file offset is left at
+ * the end of the bytes consumed and their count is stored in *len; if the
+ * file does not qualify *len is zero.  Returns 0 on success and 1 on
+ * failure with errno set.
+ */
+int
+crc_pread(int fd, uint32_t *reg, off_t *len,
+    uint32_t (*update)(uint32_t, const void *, size_t),
+    uint32_t (*combine)(uint32_t, uint32_t, off_t))
+{
+	struct crc_pctx ctx;
+	struct stat sb;
+	pthread_t *tids;
+	off_t i;
+	int error, n, nthreads;
+
+	*len = 0;
+	if (crc_nthreads < 2 || fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode) ||
+	    (ctx.base = lseek(fd, 0, SEEK_CUR)) < 0 ||
+	    sb.st_size - ctx.base < 2 * crc_chunk)
+		return (0);
+
+	ctx.fd = fd;
+	ctx.size = sb.st_size - ctx.base;
+	ctx.init = *reg;
+	ctx.update = update;
+	ctx.nchunks = (ctx.size + crc_chunk - 1) / crc_chunk;
+	ctx.next = 0;
+	ctx.error = 0;
+	nthreads = (int)MIN(crc_nthreads, ctx.nchunks);
+	if ((ctx.regs = calloc(ctx.nchunks, sizeof(*ctx.regs))) == NULL)
+		return (1);
+	if ((tids = calloc(nthreads, sizeof(*tids))) == NULL) {
+		free(ctx.regs);
+		return (1);
+	}
+	pthread_mutex_init(&ctx.mtx, NULL);
+	for (n = 0; n < nthreads; n++)
+		if ((error = pthread_create(&tids[n], NULL, crc_pworker,
+		    &ctx)) != 0) {
+			pthread_mutex_lock(&ctx.mtx);
+			if (ctx.error == 0)
+				ctx.error = error;
+			pthread_mutex_unlock(&ctx.mtx);
+			break;
+		}
+	while (n-- > 0)
+		pthread_join(tids[n], NULL);
+	pthread_mutex_destroy(&ctx.mtx);
+	free(tids);
+
+	if (ctx.error == 0) {
+		*reg = ctx.regs[0];
+		for (i = 1; i < ctx.nchunks; i++)
+			*reg = combine(*reg, ctx.regs[i],
+			    MIN(crc_chunk, ctx.size - i * crc_chunk));
+		*len = ctx.size;
+		if (lseek(fd, ctx.base + ctx.size, SEEK_SET) < 0)
+			ctx.error = errno;
+	}
+	free(ctx.regs);
+	if (ctx.error != 0) {
+		errno = ctx.error;
+		return (1);
+	}
+	return (0);
+}
+
 /*
  * Compute a POSIX 1003.2 checksum.  This routine has been broken out so that
  * other programs can use it.  It takes a file descriptor to read from and
@@ -113,33 +442,57 @@ uint32_t crc_total = ~0;		/* The crc over a number of files. */
 int
 crc(int fd, uint32_t *cval, off_t *clen)
 {
-	uint32_t lcrc;
-	int nr;
-	off_t len;
-	u_char *p;
-	u_char buf[16 * 1024];
+	if (crc_fd(fd, cval, clen))
+		return (1);
+	crc_sum(*cval, *clen);
+	return (0);
+}
 
-#define	COMPUTE(var, ch)	(var) = (var) << 8 ^ crctab[(var) >> 24 ^ (ch)]
+static void
+crc_input(void *arg, const void *buf, size_t nr)
+{
+	uint32_t *lcrc = arg;
 
-	lcrc = len = 0;
-	crc_total = ~crc_total;
-	while ((nr = read(fd, buf, sizeof(buf))) > 0)
-		for (len += nr, p = buf; nr--; ++p) {
-			COMPUTE(lcrc, *p);
-			COMPUTE(crc_total, *p);
-		}
-	if (nr < 0)
+	*lcrc = crc_update(*lcrc, buf, nr);
+}
+
+/*
+ * As crc(), but leave crc_total alone so that several files may be
+ * checksummed concurrently and folded in later with crc_sum().
+ */
+int
+crc_fd(int fd, uint32_t *cval, off_t *clen)
+{
+	uint32_t lcrc;
+	off_t len, nr;
+
+	lcrc = 0;
+	if (crc_pread(fd, &lcrc, &len, crc_update, crc_combine) ||
+	    cksum_read(fd, crc_input, &lcrc, &nr))
 		return (1);
+	len += nr;
 
 	*clen = len;
 
 	/* Include the length of the file. */
-	for (; len != 0; len >>= 8) {
+	for (; len != 0; len >>= 8)
 		COMPUTE(lcrc, len & 0xff);
-		COMPUTE(crc_total, len & 0xff);
-	}
 
 	*cval = ~lcrc;
-	crc_total = ~crc_total;
 	return (0);
 }
+
+/*
+ * Fold a file's checksum into crc_total.  The running total covers every
+ * byte fed to the file's register, including the trailing length octets,
+ * so it is derived with a single combine step rather than a second pass.
+ */
+void
+crc_sum(uint32_t cval, off_t clen)
+{
+	off_t len, n;
+
+	for (len = clen, n = clen; len != 0; len >>= 8)
+		n++;
+	crc_total = ~crc_combine(~crc_total, ~cval, n);
+}
@@ -16,9 +16,16 @@ __FBSDID("$FreeBSD$");
 
 #include <sys/types.h>
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
 
 #include "extern.h"
 
@@ -95,28 +102,240 @@ static const uint32_t crctab[256] = {
 	0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
 };
 
+#define	CRC32_POLY	0xedb88320
+
+/*
+ * Slicing-by-8 tables: crc32slice[k][i] is the CRC of byte i followed by k
+ * zero bytes, which lets the inner loop consume eight bytes per iteration.
+ */
+static uint32_t crc32slice[8][256];
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+
+#if defined(__x86_64__) || defined(__i386__)
+#define	CRC32_CLMUL
+static int crc32_have_clmul;
+static uint64_t crc32_k128[2], crc32_k512[2];
+static uint64_t crc32_k256[2], crc32_k384[2];
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define	CRC32_ARMV8
+#endif
+
+/*
+ * Multiply a and b modulo the CRC polynomial.  Polynomials are stored
+ * reflected, with the coefficient of x^0 in the high bit.
+ */
+static uint32_t
+crc32_mulmod(uint32_t a, uint32_t b)
+{
+	uint32_t m, p;
+
+	for (m = 1U << 31, p = 0; m != 0; m >>= 1) {
+		if (a & m)
+			p ^= b;
+		b = (b & 1) ? (b >> 1) ^ CRC32_POLY : b >> 1;
+	}
+	return (p);
+}
+
+/* Return x^n modulo the CRC polynomial. */
+static uint32_t
+crc32_xpow(uint64_t n)
+{
+	uint32_t r, sq;
+
+	for (r = 1U << 31, sq = 1U << 30; n != 0; n >>= 1) {
+		if (n & 1)
+			r = crc32_mulmod(r, sq);
+		sq = crc32_mulmod(sq, sq);
+	}
+	return (r);
+}
+
+static void
+crc32_init(void)
+{
+	int i, k;
+
+	for (i = 0; i < 256; i++) {
+		crc32slice[0][i] = crctab[i];
+		for (k = 1; k < 8; k++)
+			crc32slice[k][i] = crc32slice[k - 1][i] >> 8 ^
+			    crctab[crc32slice[k - 1][i] & 0xff];
+	}
+#ifdef CRC32_CLMUL
+	/*
+	 * Folding a reflected 128-bit lane forward by d bits multiplies its
+	 * low half by x^(d+64) and its high half by x^d.  A reflected 64x32
+	 * carry-less product lands 33 bits short of the lane, hence the -33.
+	 */
+	crc32_k128[0] = crc32_xpow(128 + 64 - 33);
+	crc32_k128[1] = crc32_xpow(128 - 33);
+	crc32_k256[0] = crc32_xpow(256 + 64 - 33);
+	crc32_k256[1] = crc32_xpow(256 - 33);
+	crc32_k384[0] = crc32_xpow(384 + 64 - 33);
+	crc32_k384[1] = crc32_xpow(384 - 33);
+	crc32_k512[0] = crc32_xpow(512 + 64 - 33);
+	crc32_k512[1] = crc32_xpow(512 - 33);
+	crc32_have_clmul = __builtin_cpu_supports("pclmul");
+#endif
+}
+
+static uint32_t
+crc32_slice8(uint32_t lcrc, const u_char *p, size_t nr)
+{
+	uint32_t a, b;
+
+	for (; nr != 0 && ((uintptr_t)p & 7) != 0; nr--, p++)
+		CRC(lcrc, *p);
+	for (; nr >= 8; nr -= 8, p += 8) {
+		a = lcrc ^ ((uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 |
+		    (uint32_t)p[1] << 8 | p[0]);
+		b = (uint32_t)p[7] << 24 | (uint32_t)p[6] << 16 |
+		    (uint32_t)p[5] << 8 | p[4];
+		lcrc = crc32slice[7][a & 0xff] ^ crc32slice[6][(a >> 8) & 0xff] ^
+		    crc32slice[5][(a >> 16) & 0xff] ^ crc32slice[4][a >> 24] ^
+		    crc32slice[3][b & 0xff] ^ crc32slice[2][(b >> 8) & 0xff] ^
+		    crc32slice[1][(b >> 16) & 0xff] ^ crc32slice[0][b >> 24];
+	}
+	for (; nr != 0; nr--, p++)
+		CRC(lcrc, *p);
+	return (lcrc);
+}
+
+#ifdef CRC32_CLMUL
+#define	CRC32_FOLD(x, k)						\
+	_mm_xor_si128(_mm_clmulepi64_si128((x), (k), 0x00),		\
+	    _mm_clmulepi64_si128((x), (k), 0x11))
+
+/*
+ * Carry-less multiply folding over four 128-bit lanes; the folded
+ * remainder is reduced through the byte table.
+ */
+__attribute__((target("pclmul,sse2")))
+static uint32_t
+crc32_clmul(uint32_t lcrc, const u_char *p, size_t nr)
+{
+	__m128i x0, x1, x2, x3, k;
+	u_char tmp[16];
+	int i;
+
+#define	LOAD(off)	_mm_loadu_si128((const __m128i *)(const void *)(p + (off)))
+
+	x0 = _mm_xor_si128(LOAD(0), _mm_cvtsi32_si128((int)lcrc));
+	x1 = LOAD(16);
+	x2 = LOAD(32);
+	x3 = LOAD(48);
+	p += 64;
+	nr -= 64;
+	k = _mm_loadu_si128((const __m128i *)(const void *)crc32_k512);
+	for (; nr >= 64; nr -= 64, p += 64) {
+		x0 = _mm_xor_si128(CRC32_FOLD(x0, k), LOAD(0));
+		x1 = _mm_xor_si128(CRC32_FOLD(x1, k), LOAD(16));
+		x2 = _mm_xor_si128(CRC32_FOLD(x2, k), LOAD(32));
+		x3 = _mm_xor_si128(CRC32_FOLD(x3, k), LOAD(48));
+	}
+	x0 = CRC32_FOLD(x0,
+	    _mm_loadu_si128((const __m128i *)(const void *)crc32_k384));
+	x1 = CRC32_FOLD(x1,
+	    _mm_loadu_si128((const __m128i *)(const void *)crc32_k256));
+	k = _mm_loadu_si128((const __m128i *)(const void *)crc32_k128);
+	x2 = CRC32_FOLD(x2, k);
+	x0 = _mm_xor_si128(_mm_xor_si128(x0, x1), _mm_xor_si128(x2, x3));
+	for (; nr >= 16; nr -= 16, p += 16)
+		x0 = _mm_xor_si128(CRC32_FOLD(x0, k), LOAD(0));
+#undef LOAD
+
+	_mm_storeu_si128((__m128i *)(void *)tmp, x0);
+	for (lcrc = 0, i = 0; i < 16; i++)
+		CRC(lcrc, tmp[i]);
+	return (crc32_slice8(lcrc, p, nr));
+}
+#endif /* CRC32_CLMUL */
+
+#ifdef CRC32_ARMV8
+/* ARMv8 CRC32 instructions implement this polynomial directly. */
+static uint32_t
+crc32_armv8(uint32_t lcrc, const u_char *p, size_t nr)
+{
+	uint64_t w;
+
+	for (; nr != 0 && ((uintptr_t)p & 7) != 0; nr--, p++)
+		lcrc = __crc32b(lcrc, *p);
+	for (; nr >= 8; nr -= 8, p += 8) {
+		memcpy(&w, p, sizeof(w));
+		lcrc = __crc32d(lcrc, w);
+	}
+	for (; nr != 0; nr--, p++)
+		lcrc = __crc32b(lcrc, *p);
+	return (lcrc);
+}
+#endif
+
+/*
+ * Update a running (non-complemented) CRC register with nr bytes from p.
+ */
+uint32_t
+crc32_update(uint32_t lcrc, const void *buf, size_t nr)
+{
+	(void)pthread_once(&crc32_once, crc32_init);
+#if defined(CRC32_CLMUL)
+	if (crc32_have_clmul && nr >= 256)
+		return (crc32_clmul(lcrc, buf, nr));
+#elif defined(CRC32_ARMV8)
+	return (crc32_armv8(lcrc, buf, nr));
+#endif
+	return (crc32_slice8(lcrc, buf, nr));
+}
+
+/*
+ * Given the CRC crc1 of some prefix and the CRC crc2 of a suffix of len2
+ * bytes, return the CRC of the whole sequence.
+ */
+uint32_t
+crc32_combine(uint32_t crc1, uint32_t crc2, off_t len2)
+{
+	return (crc32_mulmod(crc32_xpow((uint64_t)len2 * 8), crc1) ^ crc2);
+}
+
 uint32_t crc32_total = 0;
 
 int
 crc32(int fd, uint32_t *cval, off_t *clen)
+{
+    if (crc32_fd(fd, cval, clen))
+        return 1 ;
+    crc32_sum(*cval, *clen) ;
+    return 0 ;
+}
+
+static void
+crc32_input(void *arg, const void *buf, size_t nr)
+{
+    uint32_t *lcrc = arg ;
+
+    *lcrc = crc32_update(*lcrc, buf, nr) ;
+}
+
+/*
+ * As crc32(), but leave crc32_total alone; see crc_fd().
+ */
+int
+crc32_fd(int fd, uint32_t *cval, off_t *clen)
 {
     uint32_t lcrc = ~0;
-    int nr ;
-    off_t len ;
-    char buf[BUFSIZ], *p ;
-	
-    len = 0 ;
-    crc32_total = ~crc32_total ;
-    while ((nr = read(fd, buf, sizeof(buf))) > 0)
-        for (len += nr, p = buf; nr--; ++p) {
-	    CRC(lcrc, *p) ;
-	    CRC(crc32_total, *p) ;
-	}
-    if (nr < 0)
+    off_t len, nr ;
+
+    if (crc_pread(fd, &lcrc, &len, crc32_update, crc32_combine) ||
+        cksum_read(fd, crc32_input, &lcrc, &nr))
         return 1 ;
 
-    *clen = len ;
+    *clen = len + nr ;
     *cval = ~lcrc ;
-    crc32_total = ~crc32_total ;
     return 0 ;
 }
+
+void
+crc32_sum(uint32_t cval, off_t clen)
+{
+    crc32_total = crc32_combine(crc32_total, cval, clen) ;
+}
@@ -39,15 +39,74 @@
 
 extern uint32_t crc_total;
 extern uint32_t crc32_total;
+extern int crc_nthreads;
+extern off_t crc_chunk;
+
+typedef void (*cksum_fn)(void *, const void *, size_t);
+
+#define	XXH64_DIGEST_LENGTH	8
+#define	XXH3_DIGEST_LENGTH	8
+#define	BLAKE3_DIGEST_LENGTH	32
+
+typedef struct {
+	uint64_t	v[4];
+	uint64_t	total;
+	u_char		buf[32];
+	size_t		buflen;
+} XXH64_CTX;
+
+typedef struct {
+	uint64_t	acc[8];
+	uint64_t	total;
+	size_t		nstripes;
+	u_char		buf[64];
+	size_t		buflen;
+	u_char		last[64];
+	u_char		small[240];
+} XXH3_CTX;
+
+typedef struct {
+	uint32_t	cv[8];
+	uint64_t	counter;
+	u_char		buf[64];
+	size_t		buflen;
+	u_int		blocks;
+	u_int		stacklen;
+	uint32_t	stack[55][8];
+} BLAKE3_CTX;
+
+extern int blake3_nthreads;
 
 __BEGIN_DECLS
 int	crc(int, uint32_t *, off_t *);
+int	crc_fd(int, uint32_t *, off_t *);
+void	crc_sum(uint32_t, off_t);
 void	pcrc(char *, uint32_t, off_t);
 void	psum1(char *, uint32_t, off_t);
 void	psum2(char *, uint32_t, off_t);
 int	csum1(int, uint32_t *, off_t *);
 int	csum2(int, uint32_t *, off_t *);
 int	crc32(int, uint32_t *, off_t *);
+int	crc32_fd(int, uint32_t *, off_t *);
+void	crc32_sum(uint32_t, off_t);
+uint32_t crc_update(uint32_t, const void *, size_t);
+uint32_t crc_combine(uint32_t, uint32_t, off_t);
+uint32_t crc32_update(uint32_t, const void *, size_t);
+uint32_t crc32_combine(uint32_t, uint32_t, off_t);
+int	cksum_read(int, cksum_fn, void *, off_t *);
+int	crc_pread(int, uint32_t *, off_t *,
+	    uint32_t (*)(uint32_t, const void *, size_t),
+	    uint32_t (*)(uint32_t, uint32_t, off_t));
+void	XXH64Init(XXH64_CTX *);
+void	XXH64Update(XXH64_CTX *, const void *, size_t);
+void	XXH64Final(u_char [XXH64_DIGEST_LENGTH], XXH64_CTX *);
+void	XXH3Init(XXH3_CTX *);
+void	XXH3Update(XXH3_CTX *, const void *, size_t);
+void	XXH3Final(u_char [XXH3_DIGEST_LENGTH], XXH3_CTX *);
+void	BLAKE3Init(BLAKE3_CTX *);
+void	BLAKE3Update(BLAKE3_CTX *, const void *, size_t);
+void	BLAKE3Final(u_char [BLAKE3_DIGEST_LENGTH], BLAKE3_CTX *);
+void	pdigest(char *, const u_char *, size_t, off_t);
 __END_DECLS
 
 #endif /* _CKSUM_EXTERN_H_ */
@@ -0,0 +1,194 @@
+/*
+* Copyright (c) 2026 Apple Inc. All rights reserved.
+*
+* @APPLE_LICENSE_HEADER_START@
+*
+* This file contains Original Code and/or Modifications of Original Code
+* as defined in and that are subject to the Apple Public Source License
+* Version 2.0 (the 'License'). You may not use this file except in
+* compliance with the License. Please obtain a copy of the License at
+* http://www.opensource.apple.com/apsl/ and read it before using this
+* file.
+*
+* The Original Code and all software distributed under the License are
+* distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+* EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+* INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+* Please see the License for the specific language governing rights and
+* limitations under the License.
+*
+* @APPLE_LICENSE_HEADER_END@
+*/
+
+#include <sys/param.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "extern.h"
+
+/*
+ * Input layer shared by the checksum algorithms.  Regular files are
+ * mapped a window at a time; everything else is read into a large
+ * page-aligned buffer that is kept until the calling thread exits.
+ */
+#define	INPUT_BUFSIZE	(1024 * 1024)
+#define	INPUT_MAPSIZE	(64 * 1024 * 1024)
+#define	INPUT_MAPMIN	(64 * 1024)
+
+static pthread_key_t inbuf_key;
+static pthread_once_t inbuf_once = PTHREAD_ONCE_INIT;
+
+static void
+inbuf_init(void)
+{
+	(void)pthread_key_create(&inbuf_key, free);
+}
+
+static void *
+input_buffer(void)
+{
+	void *buf;
+
+	(void)pthread_once(&inbuf_once, inbuf_init);
+	if ((buf = pthread_getspecific(inbuf_key)) != NULL)
+		return (buf);
+	if ((errno = posix_memalign(&buf, getpagesize(), INPUT_BUFSIZE)) != 0)
+		return (NULL);
+	if ((errno = pthread_setspecific(inbuf_key, buf)) != 0) {
+		free(buf);
+		return (NULL);
+	}
+	return (buf);
+}
+
+/*
+ * A truncation can still land between the fstat() and the access to the
+ * mapping.  The SIGBUS that follows is turned into EIO for that file.
+ */
+static __thread sigjmp_buf *input_fault;
+static pthread_once_t sigbus_once = PTHREAD_ONCE_INIT;
+
+static void
+input_sigbus(int sig)
+{
+	if (input_fault != NULL)
+		siglongjmp(*input_fault, 1);
+	/* Not ours: fault again and die as usual. */
+	(void)signal(sig, SIG_DFL);
+}
+
+static void
+sigbus_init(void)
+{
+	struct sigaction sa;
+
+	sa.sa_handler = input_sigbus;
+	sa.sa_flags = 0;
+	sigemptyset(&sa.sa_mask);
+	(void)sigaction(SIGBUS, &sa, NULL);
+}
+
+/*
+ * Pass [start, end) of fd to fn from mapped windows, INPUT_BUFSIZE bytes at
+ * a time.  Returns the offset reached, which is short of end if mmap()
+ * fails or the file shrinks, when the caller reads the rest; or -1 if the
+ * file shrank under a mapping that was in use.
+ */
+static off_t
+input_mmap(int fd, off_t start, off_t end, cksum_fn fn, void *arg)
+{
+	sigjmp_buf env;
+	struct stat sb;
+	size_t pgoff, winsize, n;
+	volatile off_t off;
+	off_t pgmask, wend;
+	u_char *p, *q;
+
+	(void)pthread_once(&sigbus_once, sigbus_init);
+	pgmask = getpagesize() - 1;
+	for (off = start; off < end; ) {
+		pgoff = (size_t)(off & pgmask);
+		winsize = (size_t)MIN(INPUT_MAPSIZE, end - off + pgoff);
+		p = mmap(NULL, winsize, PROT_READ, MAP_SHARED, fd, off - pgoff);
+		if (p == MAP_FAILED)
+			break;
+		(void)madvise(p, winsize, MADV_SEQUENTIAL);
+		if (sigsetjmp(env, 1) != 0) {
+			input_fault = NULL;
+			(void)munmap(p, winsize);
+			errno = EIO;
+			return (-1);
+		}
+		input_fault = &env;
+		q = p + pgoff;
+		for (wend = off + (winsize - pgoff); off < wend;
+		    off += n, q += n) {
+			/* Touching a page past EOF raises SIGBUS. */
+			if (fstat(fd, &sb) != 0 || sb.st_size < end)
+				break;
+			n = (size_t)MIN(INPUT_BUFSIZE, wend - off);
+			fn(arg, q, n);
+		}
+		input_fault = NULL;
+		(void)munmap(p, winsize);
+		if (off < wend)
+			break;
+	}
+	return (off);
+}
+
+/*
+ * Feed the remainder of fd to fn in as few calls as practical, storing the
+ * number of bytes consumed in *clen.  Returns 0 on success and 1 on
+ * failure with errno set.
+ */
+int
+cksum_read(int fd, cksum_fn fn, void *arg, off_t *clen)
+{
+	struct stat sb;
+	ssize_t nr;
+	off_t off, len;
+	void *inbuf;
+
+	len = 0;
+	if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) &&
+	    (off = lseek(fd, 0, SEEK_CUR)) >= 0 &&
+	    sb.st_size - off >= INPUT_MAPMIN) {
+		if ((len = input_mmap(fd, off, sb.st_size, fn, arg)) < 0)
+			return (1);
+		len -= off;
+		if (lseek(fd, off + len, SEEK_SET) < 0)
+			return (1);
+		if (len == sb.st_size - off)
+			goto tail;
+		/* Read the rest, e.g. on file systems without mmap. */
+	}
+
+#ifdef F_RDAHEAD
+	(void)fcntl(fd, F_RDAHEAD, 1);
+#elif defined(POSIX_FADV_SEQUENTIAL)
+	(void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+tail:
+	if ((inbuf = input_buffer()) == NULL)
+		return (1);
+	/* Pick up anything appended since the fstat(), or a whole pipe. */
+	while ((nr = read(fd, inbuf, INPUT_BUFSIZE)) > 0) {
+		fn(arg, inbuf, nr);
+		len += nr;
+	}
+	if (nr < 0)
+		return (1);
+	*clen = len;
+	return (0);
+}
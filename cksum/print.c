@@ -71,3 +71,16 @@ psum2(char *fn, uint32_t val, off_t len)
 		(void)printf(" %s", fn);
 	(void)printf("\n");
 }
+
+void
+pdigest(char *fn, const u_char *digest, size_t dlen, off_t len)
+{
+	size_t i;
+
+	for (i = 0; i < dlen; i++)
+		(void)printf("%02x", digest[i]);
+	(void)printf(" %jd", (intmax_t)len);
+	if (fn != NULL)
+		(void)printf(" %s", fn);
+	(void)printf("\n");
+}
@@ -45,27 +45,31 @@ __FBSDID("$FreeBSD$");
 
 #include "extern.h"
 
-int
-csum1(int fd, uint32_t *cval, off_t *clen)
+static void
+sum1_input(void *arg, const void *buf, size_t nr)
 {
-	int nr;
-	u_int lcrc;
-	off_t total;
-	u_char *p;
-	u_char buf[8192];
+	u_int *lcrc = arg;
+	const u_char *p;
 
 	/*
 	 * 16-bit checksum, rotating right before each addition;
 	 * overflow is discarded.
 	 */
-	lcrc = total = 0;
-	while ((nr = read(fd, buf, sizeof(buf))) > 0)
-		for (total += nr, p = buf; nr--; ++p) {
-			if (lcrc & 1)
-				lcrc |= 0x10000;
-			lcrc = ((lcrc >> 1) + *p) & 0xffff;
-		}
-	if (nr < 0)
+	for (p = buf; nr--; ++p) {
+		if (*lcrc & 1)
+			*lcrc |= 0x10000;
+		*lcrc = ((*lcrc >> 1) + *p) & 0xffff;
+	}
+}
+
+int
+csum1(int fd, uint32_t *cval, off_t *clen)
+{
+	u_int lcrc;
+	off_t total;
+
+	lcrc = 0;
+	if (cksum_read(fd, sum1_input, &lcrc, &total))
 		return (1);
 
 	*cval = lcrc;
@@ -44,14 +44,21 @@ __FBSDID("$FreeBSD$");
 
 #include "extern.h"
 
+static void
+sum2_input(void *arg, const void *buf, size_t nr)
+{
+	uint32_t *lcrc = arg;
+	const u_char *p;
+
+	for (p = buf; nr--; ++p)
+		*lcrc += *p;
+}
+
 int
 csum2(int fd, uint32_t *cval, off_t *clen)
 {
 	uint32_t lcrc;
-	int nr;
 	off_t total;
-	u_char *p;
-	u_char buf[8192];
 
 	/*
 	 * Draft 8 POSIX 1003.2:
@@ -60,11 +67,8 @@ csum2(int fd, uint32_t *cval, off_t *clen)
 	 *   r = s % 2^16 + (s % 2^32) / 2^16
 	 * lcrc = (r % 2^16) + r / 2^16
 	 */
-	lcrc = total = 0;
-	while ((nr = read(fd, buf, sizeof(buf))) > 0)
-		for (total += nr, p = buf; nr--; ++p)
-			lcrc += *p;
-	if (nr < 0)
+	lcrc = 0;
+	if (cksum_read(fd, sum2_input, &lcrc, &total))
 		return (1);
 
 	lcrc = (lcrc & 0xffff) + (lcrc >> 16);
@@ -0,0 +1,137 @@
+#
+# SPDX-License-Identifier: APSL-1.0
+#
+# Copyright (c) 2026 Apple Inc. All rights reserved.
+#
+# @APPLE_LICENSE_HEADER_START@
+#
+# "Portions Copyright (c) 1999 Apple Computer, Inc.  All Rights
+# Reserved.  This file contains Original Code and/or Modifications of
+# Original Code as defined in and that are subject to the Apple Public
+# Source License Version 1.0 (the 'License').  You may not use this file
+# except in compliance with the License.  Please obtain a copy of the
+# License at http://www.apple.com/publicsource and read it before using
+# this file.
+#
+# The Original Code and all software distributed under the License are
+# distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+# EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+# INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+# License for the specific language governing rights and limitations
+# under the License."
+#
+# @APPLE_LICENSE_HEADER_END@
+#
+
+# Write the first $1 bytes of 0, 1, ..., 250, 0, 1, ... to $2.  This is
+# the input of the BLAKE3 test vectors; the xxh64 and xxh3 digests below
+# are those of the xxHash reference implementation for the same input.
+mkinput()
+{
+	i=0
+	while [ $i -lt 251 ]; do
+		printf "\\$(printf %o $i)"
+		i=$((i + 1))
+	done > pattern
+	while [ $(wc -c < pattern) -lt $1 ]; do
+		cat pattern pattern > pattern.new
+		mv pattern.new pattern
+	done
+	head -c $1 pattern > $2
+}
+
+atf_test_case digest_vectors
+digest_vectors_head()
+{
+	atf_set "descr" "-a gives the reference digests around a BLAKE3 chunk"
+}
+digest_vectors_body()
+{
+	for n in 0 1 1023 1024 1025; do
+		mkinput $n in$n
+	done
+
+	cat > expect <<EOF
+ef46db3751d8e999 0 in0
+e934a84adb052768 1 in1
+d66738f081c25cf4 1023 in1023
+138e26c65048ce29 1024 in1024
+cfd73aedd2d6a39d 1025 in1025
+EOF
+	atf_check -o file:expect cksum -a xxh64 in0 in1 in1023 in1024 in1025
+
+	cat > expect <<EOF
+2d06800538d394c2 0 in0
+c44bdff4074eecdb 1 in1
+d3d91d80ac495685 1023 in1023
+e5d78bafa45b2aa5 1024 in1024
+e95c42288f28186e 1025 in1025
+EOF
+	atf_check -o file:expect cksum -a xxh3 in0 in1 in1023 in1024 in1025
+
+	cat > expect <<EOF
+af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262 0 in0
+2d3adedff11b61f14c886e35afa036736dcd87a74d27b5c1510225d0f592e213 1 in1
+10108970eeda3eb932baac1428c7a2163b0e924c9a9e25b35bba72b28f70bd11 1023 in1023
+42214739f095a406f3fc83deb889744ac00df831c10daa55189b5d121c855af7 1024 in1024
+d00278ae47eb27b34faecf67b4fe263f82d5412916c1ffd97c8cb7fb814b8444 1025 in1025
+EOF
+	atf_check -o file:expect cksum -a blake3 in0 in1 in1023 in1024 in1025
+}
+
+atf_test_case digest_large
+digest_large_head()
+{
+	atf_set "descr" "-a gives the same digests of a large input with -j and from a pipe"
+}
+digest_large_body()
+{
+	mkinput 5242881 in
+
+	cat > expect <<EOF
+48ea3695d9635bdc 5242881 in
+50b75f9e2e562f04 5242881 in
+a2eed482c537df008175a978a474f0a2f257d3ef11f7ac1f6fa9f5e49af4d345 5242881 in
+EOF
+	atf_check -o file:expect cksum -a xxh64 -a xxh3 -a blake3 in
+	atf_check -o file:expect cksum -j 4 -a xxh64 -a xxh3 -a blake3 in
+
+	# Standard input is hashed as it arrives, in pieces of any size.
+	sed 's/ in$//' expect > expect.stdin
+	atf_check -o file:expect.stdin \
+	    -x "cat in | cksum -a xxh64 -a xxh3 -a blake3"
+}
+
+atf_test_case digest_check
+digest_check_head()
+{
+	atf_set "descr" "-c verifies a manifest written by -a"
+}
+digest_check_body()
+{
+	mkinput 1 in1
+	mkinput 1025 in1025
+	mkinput 5242881 in
+
+	atf_check -o save:manifest cksum -a blake3 in1 in1025 in
+	atf_check -o inline:"3 checked, 0 failed, 0 unreadable\n" \
+	    cksum -a blake3 -c manifest
+	atf_check -o inline:"3 checked, 0 failed, 0 unreadable\n" \
+	    cksum -j 4 -a blake3 -c - < manifest
+
+	head -c 1024 in1025 > in1025.new
+	mv in1025.new in1025
+	printf 'x' > in1
+	rm in
+	atf_check -s exit:1 -e match:"in: " \
+	    -o inline:"in1: FAILED\nin1025: FAILED (size)\n3 checked, 2 failed, 1 unreadable\n" \
+	    cksum -a blake3 -c manifest
+}
+
+atf_init_test_cases()
+{
+	atf_add_test_case digest_vectors
+	atf_add_test_case digest_large
+	atf_add_test_case digest_check
+}
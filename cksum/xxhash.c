@@ -0,0 +1,444 @@
+/*
+* Copyright (c) 2026 Apple Inc. All rights reserved.
+*
+* @APPLE_LICENSE_HEADER_START@
+*
+* This file contains Original Code and/or Modifications of Original Code
+* as defined in and that are subject to the Apple Public Source License
+* Version 2.0 (the 'License'). You may not use this file except in
+* compliance with the License. Please obtain a copy of the License at
+* http://www.opensource.apple.com/apsl/ and read it before using this
+* file.
+*
+* The Original Code and all software distributed under the License are
+* distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+* EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+* INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+* Please see the License for the specific language governing rights and
+* limitations under the License.
+*
+* @APPLE_LICENSE_HEADER_END@
+*/
+
+/*
+ * Streaming implementations of the XXH64 and XXH3 (64-bit) hash functions
+ * by Yann Collet, with a zero seed and the default secret.  The digests
+ * are written big-endian, matching the canonical representation.
+ */
+
+#include <sys/param.h>
+
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+#include "extern.h"
+
+#define	PRIME32_1	0x9E3779B1U
+#define	PRIME32_2	0x85EBCA77U
+#define	PRIME32_3	0xC2B2AE3DU
+#define	PRIME64_1	0x9E3779B185EBCA87ULL
+#define	PRIME64_2	0xC2B2AE3D27D4EB4FULL
+#define	PRIME64_3	0x165667B19E3779F9ULL
+#define	PRIME64_4	0x85EBCA77C2B2AE63ULL
+#define	PRIME64_5	0x27D4EB2F165667C5ULL
+#define	PRIME_MX1	0x165667919E3779F9ULL
+#define	PRIME_MX2	0x9FB21C651E98DF25ULL
+
+#define	ROTL64(x, r)	(((x) << (r)) | ((x) >> (64 - (r))))
+
+static inline uint32_t
+rd32(const u_char *p)
+{
+	return ((uint32_t)p[0] | (uint32_t)p[1] << 8 |
+	    (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+}
+
+static inline uint64_t
+rd64(const u_char *p)
+{
+	return ((uint64_t)rd32(p) | (uint64_t)rd32(p + 4) << 32);
+}
+
+static void
+wr64be(u_char *p, uint64_t v)
+{
+	int i;
+
+	for (i = 7; i >= 0; i--, v >>= 8)
+		p[i] = v & 0xff;
+}
+
+static inline uint64_t
+mul128_fold64(uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+	__uint128_t r = (__uint128_t)a * b;
+
+	return ((uint64_t)r ^ (uint64_t)(r >> 64));
+#else
+	uint64_t lolo, hilo, lohi, hihi, cross, lo, hi;
+
+	lolo = (a & 0xffffffff) * (b & 0xffffffff);
+	hilo = (a >> 32) * (b & 0xffffffff);
+	lohi = (a & 0xffffffff) * (b >> 32);
+	hihi = (a >> 32) * (b >> 32);
+	cross = (lolo >> 32) + (hilo & 0xffffffff) + lohi;
+	hi = (hilo >> 32) + (cross >> 32) + hihi;
+	lo = (cross << 32) | (lolo & 0xffffffff);
+	return (lo ^ hi);
+#endif
+}
+
+/*
+ * XXH64
+ */
+static inline uint64_t
+xxh64_round(uint64_t acc, uint64_t input)
+{
+	acc += input * PRIME64_2;
+	acc = ROTL64(acc, 31);
+	return (acc * PRIME64_1);
+}
+
+static inline uint64_t
+xxh64_merge(uint64_t acc, uint64_t val)
+{
+	acc ^= xxh64_round(0, val);
+	return (acc * PRIME64_1 + PRIME64_4);
+}
+
+static uint64_t
+xxh64_avalanche(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+	return (h);
+}
+
+void
+XXH64Init(XXH64_CTX *ctx)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->v[0] = PRIME64_1 + PRIME64_2;
+	ctx->v[1] = PRIME64_2;
+	ctx->v[2] = 0;
+	ctx->v[3] = -PRIME64_1;
+}
+
+void
+XXH64Update(XXH64_CTX *ctx, const void *buf, size_t len)
+{
+	const u_char *p = buf;
+	size_t n;
+
+	ctx->total += len;
+	if (ctx->buflen != 0) {
+		n = MIN(len, sizeof(ctx->buf) - ctx->buflen);
+		memcpy(ctx->buf + ctx->buflen, p, n);
+		ctx->buflen += n;
+		p += n;
+		len -= n;
+		if (ctx->buflen < sizeof(ctx->buf))
+			return;
+		ctx->v[0] = xxh64_round(ctx->v[0], rd64(ctx->buf));
+		ctx->v[1] = xxh64_round(ctx->v[1], rd64(ctx->buf + 8));
+		ctx->v[2] = xxh64_round(ctx->v[2], rd64(ctx->buf + 16));
+		ctx->v[3] = xxh64_round(ctx->v[3], rd64(ctx->buf + 24));
+		ctx->buflen = 0;
+	}
+	for (; len >= 32; p += 32, len -= 32) {
+		ctx->v[0] = xxh64_round(ctx->v[0], rd64(p));
+		ctx->v[1] = xxh64_round(ctx->v[1], rd64(p + 8));
+		ctx->v[2] = xxh64_round(ctx->v[2], rd64(p + 16));
+		ctx->v[3] = xxh64_round(ctx->v[3], rd64(p + 24));
+	}
+	memcpy(ctx->buf, p, len);
+	ctx->buflen = len;
+}
+
+void
+XXH64Final(u_char digest[XXH64_DIGEST_LENGTH], XXH64_CTX *ctx)
+{
+	const u_char *p;
+	uint64_t h;
+	size_t len;
+
+	if (ctx->total >= 32) {
+		h = ROTL64(ctx->v[0], 1) + ROTL64(ctx->v[1], 7) +
+		    ROTL64(ctx->v[2], 12) + ROTL64(ctx->v[3], 18);
+		h = xxh64_merge(h, ctx->v[0]);
+		h = xxh64_merge(h, ctx->v[1]);
+		h = xxh64_merge(h, ctx->v[2]);
+		h = xxh64_merge(h, ctx->v[3]);
+	} else
+		h = PRIME64_5;
+	h += ctx->total;
+
+	for (p = ctx->buf, len = ctx->buflen; len >= 8; p += 8, len -= 8) {
+		h ^= xxh64_round(0, rd64(p));
+		h = ROTL64(h, 27) * PRIME64_1 + PRIME64_4;
+	}
+	if (len >= 4) {
+		h ^= (uint64_t)rd32(p) * PRIME64_1;
+		h = ROTL64(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+		len -= 4;
+	}
+	for (; len > 0; p++, len--) {
+		h ^= *p * PRIME64_5;
+		h = ROTL64(h, 11) * PRIME64_1;
+	}
+	wr64be(digest, xxh64_avalanche(h));
+	memset(ctx, 0, sizeof(*ctx));
+}
+
+/*
+ * XXH3-64
+ */
+#define	XXH3_SECRET_SIZE	192
+#define	XXH3_STRIPE_LEN		64
+#define	XXH3_STRIPES_PER_BLOCK	((XXH3_SECRET_SIZE - XXH3_STRIPE_LEN) / 8)
+
+static const u_char xxh3_secret[XXH3_SECRET_SIZE] = {
+	0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe,
+	0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+	0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb,
+	0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+	0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78,
+	0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+	0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e,
+	0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+	0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb,
+	0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+	0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e,
+	0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+	0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f,
+	0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+	0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31,
+	0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+	0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3,
+	0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+	0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49,
+	0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+	0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc,
+	0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+	0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28,
+	0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static uint64_t
+xxh3_avalanche(uint64_t h)
+{
+	h ^= h >> 37;
+	h *= PRIME_MX1;
+	h ^= h >> 32;
+	return (h);
+}
+
+static uint64_t
+xxh3_rrmxmx(uint64_t h, uint64_t len)
+{
+	h ^= ROTL64(h, 49) ^ ROTL64(h, 24);
+	h *= PRIME_MX2;
+	h ^= (h >> 35) + len;
+	h *= PRIME_MX2;
+	return (h ^ (h >> 28));
+}
+
+static inline uint64_t
+xxh3_mix16(const u_char *p, const u_char *s)
+{
+	return (mul128_fold64(rd64(p) ^ rd64(s), rd64(p + 8) ^ rd64(s + 8)));
+}
+
+/* Inputs of at most 240 bytes are hashed in one shot. */
+static uint64_t
+xxh3_short(const u_char *p, size_t len)
+{
+	const u_char *s = xxh3_secret;
+	uint64_t acc, end, lo, hi;
+	uint32_t c;
+	size_t i;
+
+	if (len == 0)
+		return (xxh64_avalanche(rd64(s + 56) ^ rd64(s + 64)));
+	if (len <= 3) {
+		c = (uint32_t)p[0] << 16 | (uint32_t)p[len >> 1] << 24 |
+		    p[len - 1] | (uint32_t)len << 8;
+		return (xxh64_avalanche(c ^ (uint64_t)(rd32(s) ^ rd32(s + 4))));
+	}
+	if (len <= 8) {
+		lo = rd32(p + len - 4) + ((uint64_t)rd32(p) << 32);
+		return (xxh3_rrmxmx(lo ^ (rd64(s + 8) ^ rd64(s + 16)), len));
+	}
+	if (len <= 16) {
+		lo = rd64(p) ^ (rd64(s + 24) ^ rd64(s + 32));
+		hi = rd64(p + len - 8) ^ (rd64(s + 40) ^ rd64(s + 48));
+		return (xxh3_avalanche(len + __builtin_bswap64(lo) + hi +
+		    mul128_fold64(lo, hi)));
+	}
+	acc = len * PRIME64_1;
+	if (len <= 128) {
+		for (i = (len - 1) / 32 + 1; i-- > 0; ) {
+			acc += xxh3_mix16(p + 16 * i, s + 32 * i);
+			acc += xxh3_mix16(p + len - 16 * (i + 1), s + 32 * i + 16);
+		}
+		return (xxh3_avalanche(acc));
+	}
+	for (i = 0; i < 8; i++)
+		acc += xxh3_mix16(p + 16 * i, s + 16 * i);
+	end = xxh3_mix16(p + len - 16, s + 136 - 17);
+	acc = xxh3_avalanche(acc);
+	for (i = 8; i < len / 16; i++)
+		end += xxh3_mix16(p + 16 * i, s + 16 * (i - 8) + 3);
+	return (xxh3_avalanche(acc + end));
+}
+
+#if defined(__x86_64__)
+/* SSE2 is part of the x86_64 baseline, so no run-time check is needed. */
+static inline void
+xxh3_accumulate(uint64_t *acc, const u_char *p, const u_char *s)
+{
+	__m128i a, d, k, dk, hi, prod, sw;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		a = _mm_loadu_si128((const __m128i *)(const void *)(acc + 2 * i));
+		d = _mm_loadu_si128((const __m128i *)(const void *)(p + 16 * i));
+		k = _mm_loadu_si128((const __m128i *)(const void *)(s + 16 * i));
+		dk = _mm_xor_si128(d, k);
+		hi = _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1));
+		prod = _mm_mul_epu32(dk, hi);
+		sw = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+		a = _mm_add_epi64(a, _mm_add_epi64(prod, sw));
+		_mm_storeu_si128((__m128i *)(void *)(acc + 2 * i), a);
+	}
+}
+#else
+static inline void
+xxh3_accumulate(uint64_t *acc, const u_char *p, const u_char *s)
+{
+	uint64_t d, dk;
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		d = rd64(p + 8 * i);
+		dk = d ^ rd64(s + 8 * i);
+		acc[i ^ 1] += d;
+		acc[i] += (dk & 0xffffffff) * (dk >> 32);
+	}
+}
+#endif
+
+static void
+xxh3_scramble(uint64_t *acc)
+{
+	const u_char *s = xxh3_secret + XXH3_SECRET_SIZE - XXH3_STRIPE_LEN;
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		acc[i] ^= acc[i] >> 47;
+		acc[i] ^= rd64(s + 8 * i);
+		acc[i] *= PRIME32_1;
+	}
+}
+
+static inline void
+xxh3_stripe(XXH3_CTX *ctx, const u_char *p)
+{
+	xxh3_accumulate(ctx->acc, p, xxh3_secret + ctx->nstripes * 8);
+	if (++ctx->nstripes == XXH3_STRIPES_PER_BLOCK) {
+		xxh3_scramble(ctx->acc);
+		ctx->nstripes = 0;
+	}
+}
+
+void
+XXH3Init(XXH3_CTX *ctx)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->acc[0] = PRIME32_3;
+	ctx->acc[1] = PRIME64_1;
+	ctx->acc[2] = PRIME64_2;
+	ctx->acc[3] = PRIME64_3;
+	ctx->acc[4] = PRIME64_4;
+	ctx->acc[5] = PRIME32_2;
+	ctx->acc[6] = PRIME64_5;
+	ctx->acc[7] = PRIME32_1;
+}
+
+/*
+ * A stripe is only accumulated once at least one more byte follows it,
+ * since the final stripe is always the last 64 bytes of input and is
+ * processed with a different part of the secret.
+ */
+void
+XXH3Update(XXH3_CTX *ctx, const void *buf, size_t len)
+{
+	const u_char *p = buf;
+	size_t n;
+
+	if (ctx->total < sizeof(ctx->small)) {
+		n = MIN(len, sizeof(ctx->small) - ctx->total);
+		memcpy(ctx->small + ctx->total, p, n);
+	}
+	ctx->total += len;
+	if (ctx->buflen + len <= XXH3_STRIPE_LEN) {
+		memcpy(ctx->buf + ctx->buflen, p, len);
+		ctx->buflen += len;
+		return;
+	}
+	if (ctx->buflen != 0) {
+		n = XXH3_STRIPE_LEN - ctx->buflen;
+		memcpy(ctx->buf + ctx->buflen, p, n);
+		p += n;
+		len -= n;
+		xxh3_stripe(ctx, ctx->buf);
+		memcpy(ctx->last, ctx->buf, XXH3_STRIPE_LEN);
+		ctx->buflen = 0;
+	}
+	if (len > XXH3_STRIPE_LEN) {
+		for (; len > XXH3_STRIPE_LEN; p += XXH3_STRIPE_LEN,
+		    len -= XXH3_STRIPE_LEN)
+			xxh3_stripe(ctx, p);
+		memcpy(ctx->last, p - XXH3_STRIPE_LEN, XXH3_STRIPE_LEN);
+	}
+	memcpy(ctx->buf, p, len);
+	ctx->buflen = len;
+}
+
+void
+XXH3Final(u_char digest[XXH3_DIGEST_LENGTH], XXH3_CTX *ctx)
+{
+	const u_char *s;
+	u_char stripe[XXH3_STRIPE_LEN];
+	uint64_t h;
+	int i;
+
+	if (ctx->total <= sizeof(ctx->small)) {
+		wr64be(digest, xxh3_short(ctx->small, ctx->total));
+		memset(ctx, 0, sizeof(*ctx));
+		return;
+	}
+
+	/* The last stripe overlaps the previous one when input is short. */
+	memcpy(stripe, ctx->last + ctx->buflen, XXH3_STRIPE_LEN - ctx->buflen);
+	memcpy(stripe + XXH3_STRIPE_LEN - ctx->buflen, ctx->buf, ctx->buflen);
+	xxh3_accumulate(ctx->acc, stripe,
+	    xxh3_secret + XXH3_SECRET_SIZE - XXH3_STRIPE_LEN - 7);
+
+	s = xxh3_secret + 11;
+	h = ctx->total * PRIME64_1;
+	for (i = 0; i < 4; i++)
+		h += mul128_fold64(ctx->acc[2 * i] ^ rd64(s + 16 * i),
+		    ctx->acc[2 * i + 1] ^ rd64(s + 16 * i + 8));
+	wr64be(digest, xxh3_avalanche(h));
+	memset(ctx, 0, sizeof(*ctx));
+}
@@ -75,9 +75,11 @@
 	*--(p).p_end = 0;						\
 }
 
-static char emptystring[] = "";
-
-PATH_T to = { to.p_path, emptystring, "" };
+/*
+ * The target path.  Each -J worker has its own copy, set from the job it
+ * is running; main() initializes the walker's.
+ */
+__thread PATH_T to;
 
 int Nflag, fflag, iflag, lflag, nflag, pflag, sflag, vflag;
 #ifdef __APPLE__
@@ -87,6 +89,7 @@ int Sflag;
 int Xflag;
 #endif /* __APPLE__ */
 static int Hflag, Lflag, Pflag, Rflag, rflag;
+static int Jflag, hflag;
 volatile sig_atomic_t info;
 
 enum op { FILE_TO_FILE, FILE_TO_DIR, DIR_TO_DNE };
@@ -101,15 +104,16 @@ main(int argc, char *argv[])
 	enum op type;
 	int ch, fts_options, r, have_trailing_slash;
 	char *target;
+	const char *errstr;
 
 #ifdef __APPLE__
 	unix2003_compat = COMPAT_MODE("bin/cp", "unix2003");
 #endif /* __APPLE__ */
 	fts_options = FTS_NOCHDIR | FTS_PHYSICAL;
 #ifdef __APPLE__
-	while ((ch = getopt(argc, argv, "HLPRacfilNnprSsvXx")) != -1)
+	while ((ch = getopt(argc, argv, "HJ:LPRacfhilNnprSsvXx")) != -1)
 #else /* !__APPLE__ */
-	while ((ch = getopt(argc, argv, "HLPRafilNnprsvx")) != -1)
+	while ((ch = getopt(argc, argv, "HJ:LPRafhilNnprsvx")) != -1)
 #endif /* __APPLE__ */
 		switch (ch) {
 #ifdef __APPLE__
@@ -121,6 +125,11 @@ main(int argc, char *argv[])
 			Hflag = 1;
 			Lflag = Pflag = 0;
 			break;
+		case 'J':
+			Jflag = (int)strtonum(optarg, 1, 256, &errstr);
+			if (errstr != NULL)
+				errx(1, "-J %s: %s", optarg, errstr);
+			break;
 		case 'L':
 			Lflag = 1;
 			Hflag = Pflag = 0;
@@ -153,6 +162,9 @@ main(int argc, char *argv[])
 #endif /* __APPLE__ */
 			iflag = nflag = 0;
 			break;
+		case 'h':
+			hflag = 1;
+			break;
 		case 'i':
 			iflag = 1;
 #ifdef __APPLE__
@@ -212,6 +224,8 @@ main(int argc, char *argv[])
 		errx(1, "the -R and -r options may not be specified together");
 	if (lflag && sflag)
 		errx(1, "the -l and -s options may not be specified together");
+	if (iflag && Jflag > 1)
+		errx(1, "the -i and -J options may not be specified together");
 	if (rflag)
 		Rflag = 1;
 	if (Rflag) {
@@ -334,6 +348,8 @@ copy(char *argv[], enum op type, int fts_options, struct stat *root_stat)
 	recurse_path = NULL;
 	if ((ftsp = fts_open(argv, fts_options, NULL)) == NULL)
 		err(1, "fts_open");
+	if (Jflag > 1)
+		pool_init(Jflag);
 	for (badcp = rval = 0; (curr = fts_read(ftsp)) != NULL; badcp = 0) {
 		switch (curr->fts_info) {
 		case FTS_NS:
@@ -481,6 +497,12 @@ copy(char *argv[], enum op type, int fts_options, struct stat *root_stat)
 		}
 
 		if (curr->fts_info == FTS_DP) {
+			/*
+			 * Files copied by -J workers must be in place before
+			 * the directory's attributes are set.
+			 */
+			if (Jflag > 1)
+				pool_wait_dir(curr);
 			/*
 			 * We are nearly finished with this directory.  If we
 			 * didn't actually copy it, or otherwise don't need to
@@ -540,6 +562,7 @@ copy(char *argv[], enum op type, int fts_options, struct stat *root_stat)
 		/* Not an error but need to remember it happened. */
 		dne = lstat(to.p_path, &to_stat) != 0;
 
+		copy_method = NULL;
 		switch (curr->fts_statp->st_mode & S_IFMT) {
 		case S_IFLNK:
 			if ((fts_options & FTS_LOGICAL) ||
@@ -647,15 +670,38 @@ copy(char *argv[], enum op type, int fts_options, struct stat *root_stat)
 			}
 			break;
 		default:
+			/*
+			 * Files with other links are copied here, not by the
+			 * -J pool, so that the first copy exists before later
+			 * names are linked to it.
+			 */
+			if (hflag && curr->fts_statp->st_nlink > 1) {
+				if (copy_hardlink(curr, dne))
+					badcp = rval = 1;
+				break;
+			}
+			/* The pool reports -v and errors for its own jobs. */
+			if (Jflag > 1 && S_ISREG(curr->fts_statp->st_mode)) {
+				pool_copy(curr, dne);
+				continue;
+			}
 			if (copy_file(curr, dne))
 				badcp = rval = 1;
 			break;
 		}
-		if (vflag && !badcp)
-			(void)printf("%s -> %s\n", curr->fts_path, to.p_path);
+		if (vflag && !badcp) {
+			if (copy_method != NULL)
+				(void)printf("%s -> %s (%s)\n", curr->fts_path,
+				    to.p_path, copy_method);
+			else
+				(void)printf("%s -> %s\n", curr->fts_path,
+				    to.p_path);
+		}
 	}
 	if (errno)
 		err(1, "fts_read");
+	if (Jflag > 1 && pool_finish() != 0)
+		rval = 1;
 	fts_close(ftsp);
 	free(recurse_path);
 	return (rval);
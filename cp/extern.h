@@ -38,7 +38,7 @@ typedef struct {
 	char	p_path[PATH_MAX];	/* pointer to the start of a path */
 } PATH_T;
 
-extern PATH_T to;
+extern __thread PATH_T to;
 extern int Nflag, fflag, iflag, lflag, nflag, pflag, sflag, vflag;
 #ifdef __APPLE__
 extern int unix2003_compat;
@@ -47,13 +47,21 @@ extern int Sflag;
 extern int Xflag;
 #endif /* __APPLE__ */
 extern volatile sig_atomic_t info;
+extern __thread const char *copy_method;
 
 __BEGIN_DECLS
 int	copy_fifo(struct stat *, int);
 int	copy_file(const FTSENT *, int);
+int	copy_hardlink(const FTSENT *, int);
 int	copy_link(const FTSENT *, int);
+off_t	copy_parallel(const char *, int, int, const struct stat *);
 int	copy_special(struct stat *, int);
 int	setfile(struct stat *, int);
+void	pool_copy(FTSENT *, int);
+int	pool_finish(void);
+void	pool_init(int);
+void	pool_wait_dir(FTSENT *);
+int	overwrite_ok(void);
 int	preserve_dir_acls(struct stat *, char *, char *);
 int	preserve_fd_acls(int, int);
 void	usage(void) __dead2;
@@ -0,0 +1,211 @@
+/*
+* Copyright (c) 2026 Apple Inc. All rights reserved.
+*
+* @APPLE_LICENSE_HEADER_START@
+*
+* This file contains Original Code and/or Modifications of Original Code
+* as defined in and that are subject to the Apple Public Source License
+* Version 2.0 (the 'License'). You may not use this file except in
+* compliance with the License. Please obtain a copy of the License at
+* http://www.opensource.apple.com/apsl/ and read it before using this
+* file.
+*
+* The Original Code and all software distributed under the License are
+* distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+* EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+* INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+* Please see the License for the specific language governing rights and
+* limitations under the License.
+*
+* @APPLE_LICENSE_HEADER_END@
+*/
+
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fts.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "extern.h"
+
+/*
+ * Table of files with several links that have been copied, for -h.  In
+ * the spirit of linkchk() in du(1), but open-addressed with linear probing
+ * so that an entry is just the key, a countdown and the destination path.
+ * An entry is dropped once all of its links have been seen, using
+ * backward-shift deletion so that no tombstones are needed.
+ */
+struct link_entry {
+	dev_t		 dev;
+	ino_t		 ino;
+	nlink_t		 links;		/* links not yet seen */
+	char		*path;		/* first copy; NULL if slot is free */
+};
+
+#define	LINKS_INITIAL	1024
+
+static struct link_entry *table;
+static size_t table_size, table_used;
+static int stop_allocating;
+
+static size_t
+link_hash(dev_t dev, ino_t ino)
+{
+	uint64_t h;
+
+	h = ((uint64_t)dev * 0x9e3779b97f4a7c15ULL) ^ (uint64_t)ino;
+	h *= 0xff51afd7ed558ccdULL;
+	return ((size_t)(h ^ (h >> 32)) & (table_size - 1));
+}
+
+static struct link_entry *
+link_lookup(const struct stat *st)
+{
+	struct link_entry *le;
+	size_t i;
+
+	if (table == NULL)
+		return (NULL);
+	for (i = link_hash(st->st_dev, st->st_ino); ;
+	    i = (i + 1) & (table_size - 1)) {
+		le = &table[i];
+		if (le->path == NULL)
+			return (NULL);
+		if (le->dev == st->st_dev && le->ino == st->st_ino)
+			return (le);
+	}
+}
+
+/*
+ * Double the table, keeping it at most half full.  Returns 0 on success.
+ */
+static int
+link_grow(void)
+{
+	struct link_entry *old;
+	size_t i, j, old_size;
+
+	old = table;
+	old_size = table_size;
+	table_size = old_size ? old_size * 2 : LINKS_INITIAL;
+	if ((table = calloc(table_size, sizeof(*table))) == NULL) {
+		table = old;
+		table_size = old_size;
+		return (-1);
+	}
+	for (i = 0; i < old_size; i++) {
+		if (old[i].path == NULL)
+			continue;
+		for (j = link_hash(old[i].dev, old[i].ino);
+		    table[j].path != NULL; j = (j + 1) & (table_size - 1))
+			;
+		table[j] = old[i];
+	}
+	free(old);
+	return (0);
+}
+
+static void
+link_insert(const struct stat *st, const char *path)
+{
+	struct link_entry *le;
+	size_t i;
+	char *p;
+
+	if (stop_allocating)
+		return;
+	if (((table_used + 1) * 2 > table_size && link_grow() != 0) ||
+	    (p = strdup(path)) == NULL) {
+		stop_allocating = 1;
+		warnx("No more memory for tracking hard links");
+		return;
+	}
+	for (i = link_hash(st->st_dev, st->st_ino); table[i].path != NULL;
+	    i = (i + 1) & (table_size - 1))
+		;
+	le = &table[i];
+	le->dev = st->st_dev;
+	le->ino = st->st_ino;
+	le->links = st->st_nlink - 1;
+	le->path = p;
+	table_used++;
+}
+
+static void
+link_remove(struct link_entry *le)
+{
+	size_t i, j, k, mask;
+
+	mask = table_size - 1;
+	free(le->path);
+	le->path = NULL;
+	table_used--;
+	/*
+	 * Move back any later entry in the same run that would no longer
+	 * be reachable from its home slot.
+	 */
+	for (i = j = (size_t)(le - table); ; ) {
+		j = (j + 1) & mask;
+		if (table[j].path == NULL)
+			break;
+		k = link_hash(table[j].dev, table[j].ino);
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		table[i] = table[j];
+		table[j].path = NULL;
+		i = j;
+	}
+}
+
+/*
+ * Copy a file that has other links.  The first time such a file is seen
+ * it is copied normally and remembered; later names for it become hard
+ * links to that copy.  Returns 1 on failure, as copy_file() does.
+ */
+int
+copy_hardlink(const FTSENT *entp, int dne)
+{
+	struct link_entry *le;
+	int rval;
+
+	if ((le = link_lookup(entp->fts_statp)) == NULL) {
+		if (copy_file(entp, dne))
+			return (1);
+		link_insert(entp->fts_statp, to.p_path);
+		return (0);
+	}
+	if (!dne && nflag) {
+		if (vflag)
+			printf("%s not overwritten\n", to.p_path);
+		return (1);
+	}
+	/* Ask before replacing the file, as copy_file() does for -i. */
+	if (!dne && iflag && !overwrite_ok())
+		return (1);
+	if (!dne && unlink(to.p_path)) {
+		warn("unlink: %s", to.p_path);
+		return (1);
+	}
+	if (link(le->path, to.p_path) == 0) {
+		copy_method = "link";
+		rval = 0;
+	} else if (errno == EXDEV || errno == EMLINK) {
+		/* E.g. a mount point inside the target; copy it instead. */
+		rval = copy_file(entp, 1);
+	} else {
+		warn("link: %s", to.p_path);
+		return (1);
+	}
+	if (--le->links == 0)
+		link_remove(le);
+	return (rval);
+}
@@ -0,0 +1,225 @@
+/*
+* Copyright (c) 2026 Apple Inc. All rights reserved.
+*
+* @APPLE_LICENSE_HEADER_START@
+*
+* This file contains Original Code and/or Modifications of Original Code
+* as defined in and that are subject to the Apple Public Source License
+* Version 2.0 (the 'License'). You may not use this file except in
+* compliance with the License. Please obtain a copy of the License at
+* http://www.opensource.apple.com/apsl/ and read it before using this
+* file.
+*
+* The Original Code and all software distributed under the License are
+* distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+* EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+* INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+* Please see the License for the specific language governing rights and
+* limitations under the License.
+*
+* @APPLE_LICENSE_HEADER_END@
+*/
+
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fts.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "extern.h"
+
+/*
+ * Regular files of at least PCOPY_MIN bytes are split into PCOPY_CHUNK
+ * byte ranges which are copied by up to PCOPY_NTHREADS threads at once.
+ * Keeping several requests in flight helps most on network and striped
+ * targets, where a single read/write loop leaves bandwidth unused.
+ */
+#define	PCOPY_MIN	(32 * 1024 * 1024)
+#define	PCOPY_CHUNK	(8 * 1024 * 1024)
+#define	PCOPY_NTHREADS	4
+#define	PCOPY_BUFSIZE	(2 * 1024 * 1024)
+
+struct pcopy {
+	pthread_mutex_t	 mtx;
+	int		 from_fd;
+	int		 to_fd;
+	off_t		 size;
+	off_t		 next;		/* start of the next unclaimed range */
+	off_t		 copied;	/* bytes written so far */
+	int		 error;
+};
+
+/*
+ * Answer SIGINFO if this is the thread that was passed src.  Called with
+ * pc->mtx held.
+ */
+static void
+pcopy_info(struct pcopy *pc, const char *src)
+{
+	if (src != NULL && info) {
+		info = 0;
+		(void)fprintf(stderr, "%s -> %s %3d%%\n", src, to.p_path,
+		    (int)(100.0 * pc->copied / pc->size));
+	}
+}
+
+static int
+pcopy_range(struct pcopy *pc, const char *src, off_t off, off_t len,
+    char **bufp, int *cfrp)
+{
+	ssize_t rcount, wcount;
+	off_t end, woff;
+
+	for (end = off + len; off < end; ) {
+#ifndef __APPLE__
+		if (*cfrp) {
+			off_t roff = off;
+
+			woff = off;
+			rcount = copy_file_range(pc->from_fd, &roff,
+			    pc->to_fd, &woff, (size_t)(end - off), 0);
+			if (rcount > 0) {
+				off += rcount;
+				goto progress;
+			}
+			if (rcount == 0)
+				return (EIO);
+			if (errno != EXDEV && errno != EINVAL &&
+			    errno != ENOSYS && errno != EOPNOTSUPP)
+				return (errno);
+			/* Not supported between these files; use pread(2). */
+			*cfrp = 0;
+		}
+#endif /* !__APPLE__ */
+		if (*bufp == NULL && (*bufp = malloc(PCOPY_BUFSIZE)) == NULL)
+			return (errno);
+		rcount = pread(pc->from_fd, *bufp,
+		    (size_t)MIN(PCOPY_BUFSIZE, end - off), off);
+		if (rcount < 0)
+			return (errno);
+		/* The source was truncated while we were copying it. */
+		if (rcount == 0)
+			return (EIO);
+		for (woff = 0; woff < rcount; woff += wcount) {
+			wcount = pwrite(pc->to_fd, *bufp + woff,
+			    (size_t)(rcount - woff), off + woff);
+			if (wcount < 0)
+				return (errno);
+			/* A write that makes no progress would spin forever. */
+			if (wcount == 0)
+				return (EIO);
+		}
+		off += rcount;
+#ifndef __APPLE__
+progress:
+#endif /* !__APPLE__ */
+		pthread_mutex_lock(&pc->mtx);
+		pc->copied += rcount;
+		pcopy_info(pc, src);
+		pthread_mutex_unlock(&pc->mtx);
+	}
+	return (0);
+}
+
+/*
+ * Claim and copy ranges until none are left or a thread has failed.  The
+ * thread that passes src also answers SIGINFO as it copies.
+ */
+static void
+pcopy_loop(struct pcopy *pc, const char *src)
+{
+	off_t off, len;
+	char *buf;
+	int cfr, error;
+
+	buf = NULL;
+	cfr = 1;
+	for (;;) {
+		pthread_mutex_lock(&pc->mtx);
+		pcopy_info(pc, src);
+		if (pc->error != 0 || pc->next >= pc->size) {
+			pthread_mutex_unlock(&pc->mtx);
+			break;
+		}
+		off = pc->next;
+		len = MIN(PCOPY_CHUNK, pc->size - off);
+		pc->next += len;
+		pthread_mutex_unlock(&pc->mtx);
+
+		if ((error = pcopy_range(pc, src, off, len, &buf, &cfr)) != 0) {
+			pthread_mutex_lock(&pc->mtx);
+			if (pc->error == 0)
+				pc->error = error;
+			pthread_mutex_unlock(&pc->mtx);
+			break;
+		}
+	}
+	free(buf);
+}
+
+static void *
+pcopy_worker(void *arg)
+{
+	pcopy_loop(arg, NULL);
+	return (NULL);
+}
+
+/*
+ * Copy the first fs->st_size bytes of from_fd to to_fd on several threads.
+ * The calling thread copies ranges too, and answers SIGINFO while it does.
+ * Returns the number of bytes copied, 0 if the copy is not worth
+ * splitting (in which case nothing has been done), or -1 with errno set.
+ * On success both descriptors are left positioned just past the copy.
+ */
+off_t
+copy_parallel(const char *src, int from_fd, int to_fd, const struct stat *fs)
+{
+	pthread_t tids[PCOPY_NTHREADS - 1];
+	struct pcopy pc;
+	struct stat sb;
+	off_t size;
+	int i, nthreads;
+
+	/*
+	 * Leave sparse files to the sequential path, which knows how to
+	 * preserve their holes.
+	 */
+	size = fs->st_size;
+	if (size < PCOPY_MIN || (off_t)fs->st_blocks * S_BLKSIZE < size ||
+	    fstat(to_fd, &sb) != 0 || !S_ISREG(sb.st_mode))
+		return (0);
+
+	pthread_mutex_init(&pc.mtx, NULL);
+	pc.from_fd = from_fd;
+	pc.to_fd = to_fd;
+	pc.size = size;
+	pc.next = pc.copied = 0;
+	pc.error = 0;
+
+	nthreads = (int)MIN(PCOPY_NTHREADS - 1, howmany(size, PCOPY_CHUNK) - 1);
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&tids[i], NULL, pcopy_worker, &pc) != 0)
+			break;
+	nthreads = i;
+
+	pcopy_loop(&pc, src);
+	for (i = 0; i < nthreads; i++)
+		pthread_join(tids[i], NULL);
+	pthread_mutex_destroy(&pc.mtx);
+
+	if (pc.error != 0) {
+		errno = pc.error;
+		return (-1);
+	}
+	if (lseek(from_fd, size, SEEK_SET) < 0 ||
+	    lseek(to_fd, size, SEEK_SET) < 0)
+		return (-1);
+	return (size);
+}
@@ -0,0 +1,271 @@
+/*
+* Copyright (c) 2026 Apple Inc. All rights reserved.
+*
+* @APPLE_LICENSE_HEADER_START@
+*
+* This file contains Original Code and/or Modifications of Original Code
+* as defined in and that are subject to the Apple Public Source License
+* Version 2.0 (the 'License'). You may not use this file except in
+* compliance with the License. Please obtain a copy of the License at
+* http://www.opensource.apple.com/apsl/ and read it before using this
+* file.
+*
+* The Original Code and all software distributed under the License are
+* distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+* EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+* INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+* Please see the License for the specific language governing rights and
+* limitations under the License.
+*
+* @APPLE_LICENSE_HEADER_END@
+*/
+
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fts.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "extern.h"
+
+/*
+ * Worker pool for cp -J.  The fts(3) walk stays on the main thread, which
+ * creates directories in order and hands regular files to the pool.  Each
+ * worker has its own queue, filled round-robin by the walker; a worker
+ * whose queue is empty steals from the others before going to sleep.
+ *
+ * Every queued file is counted against its parent directory, and the
+ * walker waits for that count to drop to zero at the directory's FTS_DP
+ * visit, so that directory attributes are still set after its contents
+ * are complete.
+ */
+
+/* Most jobs that may be queued per worker before the walker waits. */
+#define	POOL_BACKLOG	256
+
+struct pool_dir {
+	int		 pending;	/* queued or running files */
+};
+
+struct pool_job {
+	struct pool_job	*next;
+	struct pool_dir	*dir;
+	struct stat	 sb;
+	int		 dne;
+	char		*src;
+	char		 dst[PATH_MAX];
+};
+
+struct pool_queue {
+	pthread_mutex_t	 mtx;
+	struct pool_job	*head;
+	struct pool_job	*tail;
+};
+
+static struct pool_queue *queues;
+static pthread_t *tids;
+static int nworkers, nextq;
+
+static pthread_mutex_t pool_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cv = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cv = PTHREAD_COND_INITIALIZER;
+static int queued;		/* jobs not yet taken by a worker */
+static int outstanding;		/* jobs not yet finished */
+static int shutdown_pool;
+static int pool_rval;
+
+static struct pool_job *
+pool_take(int self)
+{
+	struct pool_queue *q;
+	struct pool_job *job;
+	int i;
+
+	/* Own queue first, then steal from the others in turn. */
+	for (i = 0; i < nworkers; i++) {
+		q = &queues[(self + i) % nworkers];
+		pthread_mutex_lock(&q->mtx);
+		if ((job = q->head) != NULL) {
+			if ((q->head = job->next) == NULL)
+				q->tail = NULL;
+		}
+		pthread_mutex_unlock(&q->mtx);
+		if (job != NULL)
+			return (job);
+	}
+	return (NULL);
+}
+
+static void *
+pool_worker(void *arg)
+{
+	struct pool_job *job;
+	FTSENT ent;
+	int self, rval;
+
+	self = (int)(intptr_t)arg;
+	for (;;) {
+		if ((job = pool_take(self)) == NULL) {
+			pthread_mutex_lock(&pool_mtx);
+			while (queued == 0 && !shutdown_pool)
+				pthread_cond_wait(&work_cv, &pool_mtx);
+			if (queued == 0) {
+				pthread_mutex_unlock(&pool_mtx);
+				break;
+			}
+			pthread_mutex_unlock(&pool_mtx);
+			continue;
+		}
+		pthread_mutex_lock(&pool_mtx);
+		queued--;
+		pthread_mutex_unlock(&pool_mtx);
+
+		/* copy_file() only looks at the path and the stat buffer. */
+		memset(&ent, 0, sizeof(ent));
+		ent.fts_path = job->src;
+		ent.fts_statp = &job->sb;
+		(void)strlcpy(to.p_path, job->dst, sizeof(to.p_path));
+		to.p_end = to.p_path + strlen(to.p_path);
+		copy_method = NULL;
+		rval = copy_file(&ent, job->dne);
+		if (vflag && rval == 0) {
+			if (copy_method != NULL)
+				(void)printf("%s -> %s (%s)\n", job->src,
+				    job->dst, copy_method);
+			else
+				(void)printf("%s -> %s\n", job->src, job->dst);
+		}
+
+		pthread_mutex_lock(&pool_mtx);
+		if (rval != 0)
+			pool_rval = 1;
+		if (job->dir != NULL)
+			job->dir->pending--;
+		outstanding--;
+		pthread_cond_broadcast(&done_cv);
+		pthread_mutex_unlock(&pool_mtx);
+		free(job->src);
+		free(job);
+	}
+	return (NULL);
+}
+
+void
+pool_init(int nthreads)
+{
+	int error, i;
+
+	nworkers = nthreads;
+	if ((queues = calloc(nworkers, sizeof(*queues))) == NULL ||
+	    (tids = calloc(nworkers, sizeof(*tids))) == NULL)
+		err(1, "calloc");
+	for (i = 0; i < nworkers; i++)
+		pthread_mutex_init(&queues[i].mtx, NULL);
+	for (i = 0; i < nworkers; i++)
+		if ((error = pthread_create(&tids[i], NULL, pool_worker,
+		    (void *)(intptr_t)i)) != 0)
+			errc(1, error, "pthread_create");
+}
+
+/*
+ * Queue entp for copying to the current target path.  If entp is inside
+ * a directory being copied, the directory's FTS_DP visit must call
+ * pool_wait_dir() before touching its attributes.
+ */
+void
+pool_copy(FTSENT *entp, int dne)
+{
+	struct pool_queue *q;
+	struct pool_job *job;
+	struct pool_dir *dir;
+
+	if ((job = malloc(sizeof(*job))) == NULL ||
+	    (job->src = strdup(entp->fts_path)) == NULL)
+		err(1, "malloc");
+	job->next = NULL;
+	job->sb = *entp->fts_statp;
+	job->dne = dne;
+	(void)strlcpy(job->dst, to.p_path, sizeof(job->dst));
+
+	dir = NULL;
+	if (entp->fts_level > FTS_ROOTLEVEL) {
+		if ((dir = entp->fts_parent->fts_pointer) == NULL) {
+			if ((dir = calloc(1, sizeof(*dir))) == NULL)
+				err(1, "calloc");
+			entp->fts_parent->fts_pointer = dir;
+		}
+	}
+	job->dir = dir;
+
+	pthread_mutex_lock(&pool_mtx);
+	while (outstanding >= POOL_BACKLOG * nworkers)
+		pthread_cond_wait(&done_cv, &pool_mtx);
+	if (dir != NULL)
+		dir->pending++;
+	outstanding++;
+	queued++;
+	pthread_mutex_unlock(&pool_mtx);
+
+	q = &queues[nextq];
+	nextq = (nextq + 1) % nworkers;
+	pthread_mutex_lock(&q->mtx);
+	if (q->tail != NULL)
+		q->tail->next = job;
+	else
+		q->head = job;
+	q->tail = job;
+	pthread_mutex_unlock(&q->mtx);
+
+	pthread_mutex_lock(&pool_mtx);
+	pthread_cond_signal(&work_cv);
+	pthread_mutex_unlock(&pool_mtx);
+}
+
+/*
+ * Wait for every file queued from the directory entp to be copied.
+ */
+void
+pool_wait_dir(FTSENT *entp)
+{
+	struct pool_dir *dir;
+
+	if ((dir = entp->fts_pointer) == NULL)
+		return;
+	pthread_mutex_lock(&pool_mtx);
+	while (dir->pending > 0)
+		pthread_cond_wait(&done_cv, &pool_mtx);
+	pthread_mutex_unlock(&pool_mtx);
+	entp->fts_pointer = NULL;
+	free(dir);
+}
+
+/*
+ * Wait for all queued copies and stop the workers.  Returns 1 if any copy
+ * failed.
+ */
+int
+pool_finish(void)
+{
+	int i;
+
+	pthread_mutex_lock(&pool_mtx);
+	shutdown_pool = 1;
+	pthread_cond_broadcast(&work_cv);
+	pthread_mutex_unlock(&pool_mtx);
+	for (i = 0; i < nworkers; i++)
+		pthread_join(tids[i], NULL);
+	for (i = 0; i < nworkers; i++)
+		pthread_mutex_destroy(&queues[i].mtx);
+	free(queues);
+	free(tids);
+	return (pool_rval);
+}
@@ -97,6 +97,65 @@ hardlink_exists_force_body()
 	atf_check_equal "$(stat -f%d,%i foo)" "$(stat -f%d,%i bar)"
 }
 
+atf_test_case hflag
+hflag_body()
+{
+	mkdir -p foo/a foo/b
+	echo "foo" >foo/a/file
+	ln foo/a/file foo/b/link1
+	ln foo/a/file foo/b/link2
+
+	atf_check cp -Rh foo bar
+	atf_check cmp foo/a/file bar/a/file
+	atf_check -o inline:"3\n" stat -f '%l' bar/a/file
+	atf_check_equal "$(stat -f%d,%i bar/a/file)" "$(stat -f%d,%i bar/b/link1)"
+	atf_check_equal "$(stat -f%d,%i bar/a/file)" "$(stat -f%d,%i bar/b/link2)"
+	atf_check_not_equal "$(stat -f%d,%i foo/a/file)" \
+	    "$(stat -f%d,%i bar/a/file)"
+}
+
+atf_test_case hflag_interactive
+hflag_interactive_body()
+{
+	mkdir -p foo bar
+	echo "foo" >foo/file
+	ln foo/file foo/link
+	echo "bar" >bar/file
+	echo "bar" >bar/link
+
+	# The first name is copied; the second would become a link to it.
+	atf_check -s exit:1 -e ignore -x "printf 'y\\nn\\n' | cp -Rih foo/ bar"
+	atf_check -o inline:"bar\nfoo\n" -x "cat bar/file bar/link | sort"
+}
+
+atf_test_case large_file
+large_file_body()
+{
+	# 64 megabytes of data, enough to be copied in parallel ranges
+	seq -f%015g 4194304 >foo
+
+	atf_check cp foo bar
+	files_are_equal foo bar
+}
+
+atf_test_case Jflag
+Jflag_body()
+{
+	mkdir -p foo/sub
+	for i in $(seq 1 64); do
+		echo "file $i" >foo/file$i
+		echo "sub $i" >foo/sub/file$i
+	done
+	chmod 0555 foo/sub
+	touch -t 200001010000 foo/sub
+
+	atf_check cp -Rp -J 4 foo bar
+	atf_check diff -r foo bar
+	atf_check -o inline:"$(stat -f '%p %m' foo/sub)\n" \
+	    stat -f '%p %m' bar/sub
+	chmod 0755 foo/sub bar/sub
+}
+
 atf_test_case matching_srctgt
 matching_srctgt_body()
 {
@@ -562,6 +621,10 @@ atf_init_test_cases()
 	atf_add_test_case hardlink
 	atf_add_test_case hardlink_exists
 	atf_add_test_case hardlink_exists_force
+	atf_add_test_case hflag
+	atf_add_test_case hflag_interactive
+	atf_add_test_case Jflag
+	atf_add_test_case large_file
 	atf_add_test_case matching_srctgt
 	atf_add_test_case matching_srctgt_contained
 	atf_add_test_case matching_srctgt_link
@@ -33,6 +33,12 @@
 #include <sys/acl.h>
 #include <sys/stat.h>
 
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+#endif /* __linux__ */
+
 #ifdef __APPLE__
 #include <sys/attr.h>
 #include <sys/clonefile.h>
@@ -83,11 +89,36 @@
  */
 #define YESNO "(y/n [n]) "
 
+/*
+ * Ways of moving file data, cheapest first.  copy_chunk() starts at the
+ * best tier the platform offers and drops to the next one whenever a
+ * mechanism turns out not to work for the descriptors at hand.
+ */
+enum copy_tier {
+	TIER_RANGE,		/* copy_file_range(2) */
+	TIER_SENDFILE,		/* sendfile(2) */
+	TIER_LOOP,		/* read(2)/write(2) through a buffer */
+};
+
+static const char *tier_names[] = {
+	[TIER_RANGE] = "copy_file_range",
+	[TIER_SENDFILE] = "sendfile",
+	[TIER_LOOP] = "read/write",
+};
+
+/* Largest single sendfile(2) request. */
+#define SENDFILE_MAX (1024*1024*1024)
+
+/*
+ * How the data of the last file handed to copy_file() was copied, for -v.
+ */
+__thread const char *copy_method;
+
 static ssize_t
-copy_fallback(int from_fd, int to_fd)
+copy_fallback(int from_fd, int to_fd, size_t len)
 {
-	static char *buf = NULL;
-	static size_t bufsize;
+	static __thread char *buf = NULL;
+	static __thread size_t bufsize;
 	ssize_t rcount, wresid, wcount = 0;
 	char *bufp;
 
@@ -100,7 +131,7 @@ copy_fallback(int from_fd, int to_fd)
 		if (buf == NULL)
 			err(1, "Not enough memory");
 	}
-	rcount = read(from_fd, buf, bufsize);
+	rcount = read(from_fd, buf, MIN(bufsize, len));
 	if (rcount <= 0)
 		return (rcount);
 	for (bufp = buf, wresid = rcount; ; bufp += wcount, wresid -= wcount) {
@@ -112,6 +143,118 @@ copy_fallback(int from_fd, int to_fd)
 	}
 	return (wcount < 0 ? wcount : rcount);
 }
+
+/*
+ * Errors meaning that a copy mechanism cannot be used between these two
+ * descriptors at all, as opposed to a genuine I/O error.
+ */
+static int
+copy_unsupported(int error)
+{
+
+	return (error == EINVAL || error == EXDEV || error == ENOSYS ||
+	    error == EOPNOTSUPP);
+}
+
+/*
+ * Copy the next chunk of at most len bytes of from_fd to to_fd at their
+ * current offsets using the cheapest mechanism that works, lowering *tier
+ * as needed.
+ */
+static ssize_t
+copy_chunk(int from_fd, int to_fd, size_t len, enum copy_tier *tier)
+{
+	ssize_t wcount;
+
+	switch (*tier) {
+	case TIER_RANGE:
+#ifndef __APPLE__
+		wcount = copy_file_range(from_fd, NULL, to_fd, NULL, len, 0);
+		if (wcount >= 0 || !copy_unsupported(errno))
+			return (wcount);
+#endif /* !__APPLE__ */
+		*tier = TIER_SENDFILE;
+		/* FALLTHROUGH */
+	case TIER_SENDFILE:
+#ifdef __linux__
+		wcount = sendfile(to_fd, from_fd, NULL, MIN(len, SENDFILE_MAX));
+		if (wcount >= 0 || !copy_unsupported(errno))
+			return (wcount);
+#endif /* __linux__ */
+		*tier = TIER_LOOP;
+		/* FALLTHROUGH */
+	case TIER_LOOP:
+	default:
+		return (copy_fallback(from_fd, to_fd, len));
+	}
+}
+
+/*
+ * Copy the rest of from_fd to to_fd.  If the source has holes, only its
+ * data extents are copied, as found with SEEK_DATA and SEEK_HOLE, and the
+ * holes are recreated by seeking past them in the destination and setting
+ * its final length with ftruncate(2).  Progress is added to *wtotal.
+ */
+static int
+copy_data(const FTSENT *entp, int from_fd, int to_fd, enum copy_tier *tier,
+    off_t *wtotal)
+{
+	struct stat *fs, sb;
+	ssize_t wcount;
+	off_t data, hole, len;
+	int sparse;
+
+	fs = entp->fts_statp;
+	data = hole = 0;
+	sparse = 0;
+#ifdef SEEK_DATA
+	if (S_ISREG(fs->st_mode) && fstat(to_fd, &sb) == 0 &&
+	    S_ISREG(sb.st_mode) &&
+	    (off_t)fs->st_blocks * S_BLKSIZE < fs->st_size &&
+	    (hole = lseek(from_fd, 0, SEEK_CUR)) >= 0)
+		sparse = 1;
+#endif /* SEEK_DATA */
+	do {
+		len = SSIZE_MAX;
+#ifdef SEEK_DATA
+		if (sparse) {
+			if ((data = lseek(from_fd, hole, SEEK_DATA)) < 0) {
+				/* Nothing but a hole from here to the end. */
+				if (errno == ENXIO)
+					break;
+				return (-1);
+			}
+			if ((hole = lseek(from_fd, data, SEEK_HOLE)) < 0 ||
+			    lseek(from_fd, data, SEEK_SET) < 0 ||
+			    lseek(to_fd, data, SEEK_SET) < 0)
+				return (-1);
+			len = hole - data;
+		}
+#endif /* SEEK_DATA */
+		for (; len > 0; len -= wcount) {
+			wcount = copy_chunk(from_fd, to_fd,
+			    (size_t)MIN(len, SSIZE_MAX), tier);
+			if (wcount < 0)
+				return (-1);
+			if (wcount == 0)
+				break;
+			*wtotal += wcount;
+			if (info) {
+				info = 0;
+				(void)fprintf(stderr,
+				    "%s -> %s %3d%%\n",
+				    entp->fts_path, to.p_path,
+				    cp_pct(*wtotal, fs->st_size));
+			}
+		}
+	} while (sparse && len == 0);
+	/* Extend the destination over a trailing hole. */
+	if (sparse && (fstat(from_fd, &sb) != 0 ||
+	    ftruncate(to_fd, sb.st_size) != 0))
+		return (-1);
+	return (0);
+}
+
 #ifdef __APPLE__
 /*
  * Context for fcopyfile() callback.
@@ -152,6 +295,39 @@ copyfile_callback(int what, int stage, copyfile_state_t state,
 }
 #endif /* !__APPLE__ */
 
+/*
+ * Ask the user whether to overwrite to.p_path, as -i requires.  Returns 1
+ * if they agreed.
+ */
+int
+overwrite_ok(void)
+{
+	int ch, checkch;
+#ifdef __APPLE__
+	char resp[] = {'\0', '\0'};
+#endif /* __APPLE__ */
+
+	(void)fprintf(stderr, "overwrite %s? %s", to.p_path, YESNO);
+#ifdef __APPLE__
+	/* Load user specified locale */
+	setlocale(LC_MESSAGES, "");
+#endif /* __APPLE__ */
+	checkch = ch = getchar();
+	while (ch != '\n' && ch != EOF)
+		ch = getchar();
+#ifdef __APPLE__
+	/* only care about the first character */
+	resp[0] = checkch;
+	if (rpmatch(resp) != 1) {
+#else /* !__APPLE__ */
+	if (checkch != 'y' && checkch != 'Y') {
+#endif /* __APPLE__ */
+		(void)fprintf(stderr, "not overwritten\n");
+		return (0);
+	}
+	return (1);
+}
+
 int
 copy_file(const FTSENT *entp, int dne)
 {
@@ -163,17 +339,18 @@ copy_file(const FTSENT *entp, int dne)
 	struct stat sb, *fs;
 	ssize_t wcount;
 	off_t wtotal;
-	int ch, checkch, from_fd, rval, to_fd;
+	int from_fd, rval, to_fd;
 #ifdef __APPLE__
-	char resp[] = {'\0', '\0'};
 	mode_t mode = 0;
-	int cpflags, ret, use_copy_file_range = 0;
+	int cpflags, ret;
+	enum copy_tier tier = TIER_LOOP;
 #else /* !__APPLE__ */
-	int use_copy_file_range = 1;
+	enum copy_tier tier = TIER_RANGE;
 #endif /* __APPLE__ */
 
 	fs = entp->fts_statp;
 	from_fd = to_fd = -1;
+	copy_method = NULL;
 	if (!lflag && !sflag) {
 		if ((from_fd = open(entp->fts_path, O_RDONLY, 0)) < 0 ||
 		    fstat(from_fd, &sb) != 0) {
@@ -224,27 +401,9 @@ copy_file(const FTSENT *entp, int dne)
 				printf("%s not overwritten\n", to.p_path);
 			rval = 1;
 			goto done;
-		} else if (iflag) {
-			(void)fprintf(stderr, "overwrite %s? %s", 
-			    to.p_path, YESNO);
-#ifdef __APPLE__
-			/* Load user specified locale */
-			setlocale(LC_MESSAGES, "");
-#endif /* __APPLE__ */
-			checkch = ch = getchar();
-			while (ch != '\n' && ch != EOF)
-				ch = getchar();
-#ifdef __APPLE__
-			/* only care about the first character */
-			resp[0] = checkch;
-			if (rpmatch(resp) != 1) {
-#else /* !__APPLE__ */
-			if (checkch != 'y' && checkch != 'Y') {
-#endif /* __APPLE__ */
-				(void)fprintf(stderr, "not overwritten\n");
-				rval = 1;
-				goto done;
-			}
+		} else if (iflag && !overwrite_ok()) {
+			rval = 1;
+			goto done;
 		}
 
 #ifdef __APPLE__
@@ -270,8 +429,10 @@ copy_file(const FTSENT *entp, int dne)
 #ifdef __APPLE__
 	if (cflag) {
 		ret = clonefile(entp->fts_path, to.p_path, 0);
-		if (ret == 0)
+		if (ret == 0) {
+			copy_method = "clonefile";
 			goto done;
+		}
 		if (errno != ENOTSUP) {
 			warn("%s: clonefile failed", to.p_path);
 			rval = 1;
@@ -399,6 +560,7 @@ copy_file(const FTSENT *entp, int dne)
 				cpflags |= COPYFILE_DATA_SPARSE;
 			ret = fcopyfile(from_fd, to_fd, cpfs, cpflags);
 			copyfile_state_free(cpfs);
+			copy_method = "fcopyfile";
 			if (ret != 0) {
 				if (errno == ECANCELED)
 					errno = cpctx.error;
@@ -409,29 +571,32 @@ copy_file(const FTSENT *entp, int dne)
 	} else {
 #endif /* __APPLE__ */
 	wtotal = 0;
-	do {
-#ifndef __APPLE__
-		if (use_copy_file_range) {
-			wcount = copy_file_range(from_fd, NULL,
-			    to_fd, NULL, SSIZE_MAX, 0);
-			if (wcount < 0 && errno == EINVAL) {
-				/* probably a non-seekable descriptor */
-				use_copy_file_range = 0;
-			}
-		}
-#endif /* !__APPLE__ */
-		if (!use_copy_file_range) {
-			wcount = copy_fallback(from_fd, to_fd);
-		}
-		wtotal += wcount;
-		if (info) {
-			info = 0;
-			(void)fprintf(stderr,
-			    "%s -> %s %3d%%\n",
-			    entp->fts_path, to.p_path,
-			    cp_pct(wtotal, fs->st_size));
-		}
-	} while (wcount > 0);
+	wcount = 1;
+#ifdef FICLONE
+	/*
+	 * Share the source's blocks with the destination if the file system
+	 * supports it, as clonefile(2) does above.
+	 */
+	if (S_ISREG(fs->st_mode) && ioctl(to_fd, FICLONE, from_fd) == 0) {
+		copy_method = "clone";
+		wcount = 0;
+	}
+#endif /* FICLONE */
+	/*
+	 * Large regular files are copied in ranges by several threads;
+	 * whatever is left (e.g. data appended since the stat) goes through
+	 * the loop below.
+	 */
+	if (wcount > 0 && S_ISREG(fs->st_mode) &&
+	    (wtotal = copy_parallel(entp->fts_path, from_fd, to_fd, fs)) != 0) {
+		copy_method = "parallel";
+		if (wtotal < 0)
+			wcount = -1;
+	}
+	if (wcount > 0 && copy_data(entp, from_fd, to_fd, &tier, &wtotal) != 0)
+		wcount = -1;
+	if (copy_method == NULL)
+		copy_method = tier_names[tier];
 	if (wcount < 0) {
 		warn("%s", entp->fts_path);
 		rval = 1;
@@ -563,7 +728,7 @@ copy_special(struct stat *from_stat, int exists)
 int
 setfile(struct stat *fs, int fd)
 {
-	static struct timespec tspec[2];
+	struct timespec tspec[2];
 	struct stat ts;
 	int rval, gotstat, islink, fdval;
 
@@ -795,24 +960,24 @@ usage(void)
 #ifdef __APPLE__
 	if (unix2003_compat) {
 	(void)fprintf(stderr, "%s\n%s\n",
-	    "usage: cp [-R [-H | -L | -P]] [-fi | -n] [-aclpSsvXx] "
-	    "source_file target_file",
-	    "       cp [-R [-H | -L | -P]] [-fi | -n] [-aclpSsvXx] "
-	    "source_file ... "
+	    "usage: cp [-R [-H | -L | -P]] [-fi | -n] [-achlpSsvXx] "
+	    "[-J jobs] source_file target_file",
+	    "       cp [-R [-H | -L | -P]] [-fi | -n] [-achlpSsvXx] "
+	    "[-J jobs] source_file ... "
 	    "target_directory");
 	} else {
 #endif /* __APPLE__ */
 	(void)fprintf(stderr, "%s\n%s\n",
 #ifdef __APPLE__
-	    "usage: cp [-R [-H | -L | -P]] [-f | -i | -n] [-aclpSsvXx] "
-	    "source_file target_file",
-	    "       cp [-R [-H | -L | -P]] [-f | -i | -n] [-aclpSsvXx] "
+	    "usage: cp [-R [-H | -L | -P]] [-f | -i | -n] [-achlpSsvXx] "
+	    "[-J jobs] source_file target_file",
+	    "       cp [-R [-H | -L | -P]] [-f | -i | -n] [-achlpSsvXx] "
 #else /* !__APPLE__ */
-	    "usage: cp [-R [-H | -L | -P]] [-f | -i | -n] [-alpsvx] "
-	    "source_file target_file",
-	    "       cp [-R [-H | -L | -P]] [-f | -i | -n] [-alpsvx] "
+	    "usage: cp [-R [-H | -L | -P]] [-f | -i | -n] [-ahlpsvx] "
+	    "[-J jobs] source_file target_file",
+	    "       cp [-R [-H | -L | -P]] [-f | -i | -n] [-ahlpsvx] "
 #endif /* __APPLE__ */
-	    "source_file ... "
+	    "[-J jobs] source_file ... "
 	    "target_directory");
 #ifdef __APPLE__
 	}
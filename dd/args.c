@@ -73,9 +73,12 @@ static void	f_fillchar(char *);
 static void	f_ibs(char *);
 static void	f_if(char *);
 static void	f_iflag(char *);
+static void	f_interval(char *);
+static void	f_ihash(char *);
 static void	f_obs(char *);
 static void	f_of(char *);
 static void	f_oflag(char *);
+static void	f_ohash(char *);
 static void	f_seek(char *);
 static void	f_skip(char *);
 static void	f_speed(char *);
@@ -105,14 +108,17 @@ static const struct arg {
 #endif
 	{ "if",		f_if,		C_IF,	 C_IF },
 	{ "iflag",	f_iflag,	0,	 0 },
+	{ "ihash",	f_ihash,	C_IHASH, C_IHASH },
+	{ "interval",	f_interval,	0,	 0 },
 	{ "iseek",	f_skip,		C_SKIP,	 C_SKIP },
 #ifdef __APPLE__
 	{ "obs",	f_obs,		C_OBS,	 C_OBS },
 #else
 	{ "obs",	f_obs,		C_OBS,	 C_BS|C_OBS },
 #endif
-	{ "of",		f_of,		C_OF,	 C_OF },
+	{ "of",		f_of,		C_OF,	 0 },
 	{ "oflag",	f_oflag,	0,	 0 },
+	{ "ohash",	f_ohash,	C_OHASH, C_OHASH },
 	{ "oseek",	f_seek,		C_SEEK,	 C_SEEK },
 	{ "seek",	f_seek,		C_SEEK,	 C_SEEK },
 	{ "skip",	f_skip,		C_SKIP,	 C_SKIP },
@@ -281,10 +287,30 @@ f_if(char *arg)
 	in.name = arg;
 }
 
+static void
+f_ihash(char *arg)
+{
+
+	in.hash = hash_lookup(arg);
+}
+
+static void
+f_interval(char *arg)
+{
+	char *end;
+
+	errno = 0;
+	status_interval = strtod(arg, &end);
+	if (errno != 0 || *end != '\0' || end == arg ||
+	    !(status_interval >= 0.001 && status_interval <= 86400))
+		errx(1, "interval must be between 0.001 and 86400 seconds");
+}
+
 static const struct iflag {
 	const char *name;
 	uint64_t set, noset;
 } ilist[] = {
+	{ "async",	C_IASYNC,	0 },
 	{ "direct",	C_IDIRECT,	0 },
 	{ "fullblock",	C_IFULLBLOCK,	C_SYNC },
 };
@@ -332,7 +358,22 @@ static void
 f_of(char *arg)
 {
 
-	out.name = arg;
+	/* Each further of= adds an output that gets a copy of the data. */
+	if (out.name == NULL) {
+		out.name = arg;
+		return;
+	}
+	if ((outs = reallocarray(outs, nouts + 1, sizeof(*outs))) == NULL)
+		err(1, "of");
+	memset(&outs[nouts], 0, sizeof(*outs));
+	outs[nouts++].name = arg;
+}
+
+static void
+f_ohash(char *arg)
+{
+
+	out.hash = hash_lookup(arg);
 }
 
 static void
@@ -366,6 +407,8 @@ f_status(char *arg)
 		ddflags |= C_NOXFER;
 	else if (strcmp(arg, "progress") == 0)
 		ddflags |= C_PROGRESS;
+	else if (strcmp(arg, "json") == 0)
+		ddflags |= C_JSON;
 	else
 		errx(1, "unknown status %s", arg);
 }
@@ -432,6 +475,7 @@ static const struct oflag {
 	const char *name;
 	uint64_t set;
 } olist[] = {
+	{ "async",	C_OASYNC },
 	{ "direct",	C_ODIRECT },
 	{ "fsync",	C_OFSYNC },
 	{ "sync",	C_OFSYNC },
@@ -0,0 +1,579 @@
+/*
+* Copyright (c) 2026 Apple Inc. All rights reserved.
+*
+* @APPLE_LICENSE_HEADER_START@
+*
+* This file contains Original Code and/or Modifications of Original Code
+* as defined in and that are subject to the Apple Public Source License
+* Version 2.0 (the 'License'). You may not use this file except in
+* compliance with the License. Please obtain a copy of the License at
+* http://www.opensource.apple.com/apsl/ and read it before using this
+* file.
+*
+* The Original Code and all software distributed under the License are
+* distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+* EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+* INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+* Please see the License for the specific language governing rights and
+* limitations under the License.
+*
+* @APPLE_LICENSE_HEADER_END@
+*/
+
+#include <sys/param.h>
+
+#include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dd.h"
+#include "extern.h"
+
+/*
+ * iflag=async and oflag=async: a reader thread and/or a writer thread,
+ * each connected to the main thread by a ring of ASYNC_NBUF buffers, so
+ * that the input and output devices can be busy at the same time.
+ *
+ * The reader issues the same read(2) calls as dd_in() would and queues
+ * each result, including errors; the main thread then interprets them
+ * exactly as before.  The writer performs the writes and hole seeks
+ * queued by dd_out() and does the output accounting itself, so that
+ * short writes are counted just as in the synchronous case.
+ *
+ * When of= is given more than once, every output gets its own writer
+ * thread draining the same ring, and a slot is reused only once all of
+ * them are past it.  These writers keep separate statistics, and one
+ * that fails is reported and then skips the rest of the data, leaving
+ * the others to finish.
+ *
+ * The helper threads block all signals; the main thread never waits
+ * for them for long without calling check_terminate().
+ */
+#define	ASYNC_NBUF	4
+
+enum { OP_DATA, OP_HOLE, OP_FLUSH };
+
+struct slot {
+	u_char		*buf;
+	size_t		 len;		/* bytes of data in buf */
+	size_t		 off;		/* bytes already consumed */
+	size_t		 n;		/* output block size, for accounting */
+	ssize_t		 rv;		/* read(2) result */
+	int		 error;		/* errno if rv == -1 */
+	int		 op;
+};
+
+struct ring {
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 cv;
+	struct slot	 slots[ASYNC_NBUF];
+	u_int		 head;		/* next slot to be filled */
+	u_int		 tail;		/* next slot to be drained */
+	int		 done;		/* producer has finished */
+	pthread_t	 tid;
+};
+
+/* One consumer of the output ring. */
+struct output {
+	IO		*io;
+	u_int		 tail;		/* next slot to be written */
+	pthread_t	 tid;
+	int		 error;		/* errno once the output has failed */
+	uintmax_t	 out_full;	/* # of full output blocks */
+	uintmax_t	 out_part;	/* # of partial output blocks */
+	uintmax_t	 bytes;		/* # of bytes written */
+	LAT		 wlat;		/* write(2) latencies */
+};
+
+static struct ring rin, rout;
+static struct output *outputs;
+static u_int noutputs, nfailed;
+
+/*
+ * The helper threads update st and their outputs' counters as they go.
+ * They do so under stat_mtx, which the main thread also holds while it
+ * copies the counters to print them.
+ */
+static pthread_mutex_t stat_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+void
+async_stat_lock(void)
+{
+
+	if (ddflags & (C_IASYNC | C_OASYNC))
+		pthread_mutex_lock(&stat_mtx);
+}
+
+void
+async_stat_unlock(void)
+{
+
+	if (ddflags & (C_IASYNC | C_OASYNC))
+		pthread_mutex_unlock(&stat_mtx);
+}
+
+static void
+ring_init(struct ring *r, size_t size)
+{
+	u_int i;
+
+	pthread_mutex_init(&r->mtx, NULL);
+	pthread_cond_init(&r->cv, NULL);
+	for (i = 0; i < ASYNC_NBUF; i++)
+		if ((r->slots[i].buf = malloc(size)) == NULL)
+			err(1, "async buffer");
+}
+
+/*
+ * Wait on the ring from the main thread, waking up regularly so that
+ * SIGINT and SIGINFO are handled while the other side is blocked in I/O.
+ */
+static void
+ring_wait_main(struct ring *r)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += 100 * 1000 * 1000;
+	if (ts.tv_nsec >= 1000 * 1000 * 1000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000 * 1000 * 1000;
+	}
+	(void)pthread_cond_timedwait(&r->cv, &r->mtx, &ts);
+	if (kill_signal || need_summary || need_progress) {
+		pthread_mutex_unlock(&r->mtx);
+		check_terminate();
+		if (need_summary)
+			summary();
+		if (need_progress)
+			progress();
+		pthread_mutex_lock(&r->mtx);
+	}
+}
+
+static void
+thread_start(pthread_t *tid, void *(*fn)(void *), void *arg)
+{
+	sigset_t all, old;
+	int error;
+
+	/* Leave signal handling to the main thread. */
+	(void)sigfillset(&all);
+	(void)pthread_sigmask(SIG_SETMASK, &all, &old);
+	if ((error = pthread_create(tid, NULL, fn, arg)) != 0)
+		errc(1, error, "pthread_create");
+	(void)pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+static void *
+reader(void *arg __unused)
+{
+	struct timespec t0;
+	struct slot *s;
+	uintmax_t left;
+	ssize_t n;
+
+	/*
+	 * Don't read ahead past count=, so that input shared with another
+	 * process (e.g. a pipe) is left as the synchronous path leaves it.
+	 */
+	left = cpy_cnt == 0 ? UINTMAX_MAX : cpy_cnt;
+	if (ddflags & C_IFULLBLOCK && left != UINTMAX_MAX)
+		left *= in.dbsz;
+	for (;;) {
+		pthread_mutex_lock(&rin.mtx);
+		while (rin.head - rin.tail == ASYNC_NBUF)
+			pthread_cond_wait(&rin.cv, &rin.mtx);
+		pthread_mutex_unlock(&rin.mtx);
+
+		s = &rin.slots[rin.head % ASYNC_NBUF];
+		do {
+			if (ddflags & C_JSON)
+				(void)clock_gettime(CLOCK_MONOTONIC, &t0);
+			n = read(in.fd, s->buf, ddflags & C_IFULLBLOCK ?
+			    (size_t)MIN(in.dbsz, left) : in.dbsz);
+			if (ddflags & C_JSON) {
+				async_stat_lock();
+				lat_add(&st.rlat, &t0);
+				async_stat_unlock();
+			}
+		} while (n == -1 && errno == EINTR);
+		s->rv = n;
+		s->error = errno;
+		s->len = n > 0 ? (size_t)n : 0;
+		s->off = 0;
+		if (n == -1 && ddflags & C_NOERROR && in.flags & ISSEEK &&
+		    lseek(in.fd, (off_t)in.dbsz, SEEK_CUR) == -1)
+			warn("%s", in.name);
+
+		if (n > 0)
+			left -= ddflags & C_IFULLBLOCK ? MIN((uintmax_t)n, left) : 1;
+		else if (n == -1 && ddflags & C_SYNC)
+			left--;
+
+		pthread_mutex_lock(&rin.mtx);
+		rin.head++;
+		if (n == 0 || left == 0 || (n == -1 && !(ddflags & C_NOERROR)))
+			rin.done = 1;
+		pthread_cond_broadcast(&rin.cv);
+		pthread_mutex_unlock(&rin.mtx);
+		if (rin.done)
+			break;
+	}
+	return (NULL);
+}
+
+static void
+tee_fail(struct output *o, int error)
+{
+
+	warnc(error, "%s", o->io->name);
+	pthread_mutex_lock(&rout.mtx);
+	async_stat_lock();
+	o->error = error;
+	async_stat_unlock();
+	nfailed++;
+	pthread_mutex_unlock(&rout.mtx);
+}
+
+/*
+ * Write slot s to o, one of several outputs.  Returns whether s was the
+ * final flush.
+ */
+static int
+tee_put(struct output *o, const struct slot *s)
+{
+	struct timespec t0;
+	const u_char *p;
+	size_t cnt;
+	ssize_t nw;
+	int rv;
+
+	if (o->error != 0)
+		return (s->op == OP_FLUSH);
+	if (s->op == OP_FLUSH) {
+		rv = 0;
+		if (ddflags & C_FSYNC)
+			rv = fsync(o->io->fd);
+#ifndef __APPLE__
+		else if (ddflags & C_FDATASYNC)
+			rv = fdatasync(o->io->fd);
+#endif
+		if (rv == -1)
+			tee_fail(o, errno);
+		return (1);
+	}
+
+	for (p = s->buf, cnt = s->len; cnt != 0; p += nw, cnt -= nw) {
+		if (ddflags & C_JSON)
+			(void)clock_gettime(CLOCK_MONOTONIC, &t0);
+		nw = write(o->io->fd, p, cnt);
+		if (ddflags & C_JSON) {
+			async_stat_lock();
+			lat_add(&o->wlat, &t0);
+			async_stat_unlock();
+		}
+		if (nw == -1 && errno == EINTR) {
+			nw = 0;
+			continue;
+		}
+		if (nw <= 0 || ((size_t)nw != cnt && o->io->flags & ISTAPE)) {
+			tee_fail(o, nw == 0 ? ENOSPC : nw < 0 ? errno : EIO);
+			break;
+		}
+		async_stat_lock();
+		o->bytes += nw;
+		if ((size_t)nw == s->n && s->n == (size_t)o->io->dbsz)
+			++o->out_full;
+		else
+			++o->out_part;
+		async_stat_unlock();
+	}
+	return (0);
+}
+
+static void *
+writer(void *arg)
+{
+	struct output *o;
+	struct slot *s;
+	off_t pending;
+	u_int i, lag;
+	int done;
+
+	o = arg;
+	pending = 0;
+	for (done = 0; !done; ) {
+		pthread_mutex_lock(&rout.mtx);
+		while (rout.head == o->tail)
+			pthread_cond_wait(&rout.cv, &rout.mtx);
+		pthread_mutex_unlock(&rout.mtx);
+
+		s = &rout.slots[o->tail % ASYNC_NBUF];
+		if (nouts != 0)
+			done = tee_put(o, s);
+		else switch (s->op) {
+		case OP_HOLE:
+			pending += s->len;
+			out_count(s->len, s->len, s->n);
+			break;
+		case OP_DATA:
+		case OP_FLUSH:
+			if (pending != 0) {
+				out_hole(pending);
+				pending = 0;
+			}
+			if (s->op == OP_FLUSH)
+				done = 1;
+			else
+				out_write(s->buf, s->len, s->n);
+			break;
+		}
+
+		pthread_mutex_lock(&rout.mtx);
+		o->tail++;
+		/* The slowest output frees the slot. */
+		lag = UINT_MAX;
+		for (i = 0; i < noutputs; i++)
+			lag = MIN(lag, outputs[i].tail - rout.tail);
+		rout.tail += lag;
+		pthread_cond_broadcast(&rout.cv);
+		pthread_mutex_unlock(&rout.mtx);
+	}
+	return (NULL);
+}
+
+/*
+ * Start the helper threads requested with iflag=async and oflag=async.
+ * outsize is the size of the output buffer, the most dd_out() will ever
+ * hand over at once.
+ */
+void
+async_start(size_t outsize)
+{
+	u_int i;
+
+	if (ddflags & C_IASYNC) {
+		ring_init(&rin, in.dbsz);
+		thread_start(&rin.tid, reader, NULL);
+	}
+	if (ddflags & C_OASYNC) {
+		ring_init(&rout, outsize);
+		noutputs = nouts + 1;
+		if ((outputs = calloc(noutputs, sizeof(*outputs))) == NULL)
+			err(1, "async outputs");
+		for (i = 0; i < noutputs; i++) {
+			outputs[i].io = i == 0 ? &out : &outs[i - 1];
+			thread_start(&outputs[i].tid, writer, &outputs[i]);
+		}
+	}
+}
+
+/*
+ * Stand-in for read(2) on the input: return data, end of file or an
+ * error from the next queued read.  A read that returned more than len
+ * bytes (only possible with iflag=fullblock) is handed out over several
+ * calls.
+ */
+ssize_t
+async_read(void *buf, size_t len)
+{
+	struct slot *s;
+	ssize_t n;
+
+	pthread_mutex_lock(&rin.mtx);
+	while (rin.head == rin.tail) {
+		if (rin.done) {
+			/* Past the reader's count= limit or last error. */
+			pthread_mutex_unlock(&rin.mtx);
+			return (0);
+		}
+		ring_wait_main(&rin);
+	}
+	pthread_mutex_unlock(&rin.mtx);
+
+	s = &rin.slots[rin.tail % ASYNC_NBUF];
+	if (s->rv <= 0) {
+		n = s->rv;
+		errno = s->error;
+	} else {
+		n = (ssize_t)MIN(len, s->len - s->off);
+		memcpy(buf, s->buf + s->off, n);
+		s->off += n;
+		if (s->off < s->len)
+			return (n);
+	}
+	pthread_mutex_lock(&rin.mtx);
+	rin.tail++;
+	pthread_cond_broadcast(&rin.cv);
+	pthread_mutex_unlock(&rin.mtx);
+	if (n == -1)
+		errno = s->error;
+	return (n);
+}
+
+static struct slot *
+async_slot(void)
+{
+	int failed;
+
+	pthread_mutex_lock(&rout.mtx);
+	while (rout.head - rout.tail == ASYNC_NBUF)
+		ring_wait_main(&rout);
+	failed = nfailed == noutputs;
+	pthread_mutex_unlock(&rout.mtx);
+	if (failed)
+		errx(1, "all outputs have failed");
+	return (&rout.slots[rout.head % ASYNC_NBUF]);
+}
+
+static void
+async_queue(void)
+{
+
+	pthread_mutex_lock(&rout.mtx);
+	rout.head++;
+	pthread_cond_broadcast(&rout.cv);
+	pthread_mutex_unlock(&rout.mtx);
+}
+
+/*
+ * Queue cnt bytes at p, part of an output block of n bytes, for writing;
+ * or, with p NULL, a hole of cnt bytes to be seeked over.
+ */
+void
+async_write(const u_char *p, size_t cnt, size_t n)
+{
+	struct slot *s;
+
+	s = async_slot();
+	s->op = p != NULL ? OP_DATA : OP_HOLE;
+	s->len = cnt;
+	s->n = n;
+	if (p != NULL)
+		memcpy(s->buf, p, cnt);
+	async_queue();
+	/* With several outputs, st counts what was handed to them. */
+	if (nouts != 0)
+		out_count(cnt, cnt, n);
+}
+
+/*
+ * Wait for all queued output, including any trailing hole, to reach the
+ * output file.
+ */
+void
+async_finish(void)
+{
+	struct slot *s;
+	u_int i;
+
+	s = async_slot();
+	s->op = OP_FLUSH;
+	async_queue();
+	pthread_mutex_lock(&rout.mtx);
+	while (rout.head != rout.tail)
+		ring_wait_main(&rout);
+	pthread_mutex_unlock(&rout.mtx);
+	for (i = 0; i < noutputs; i++)
+		(void)pthread_join(outputs[i].tid, NULL);
+}
+
+/*
+ * Close every output, once of= has been given more than once.  Returns
+ * the exit status: 1 if any of the outputs failed.
+ */
+int
+tee_close(void)
+{
+	struct output *o;
+	int rv;
+
+	rv = 0;
+	for (o = outputs; o < outputs + noutputs; o++) {
+		if (close(o->io->fd) == -1 && errno != EINTR &&
+		    o->error == 0) {
+			o->error = errno;
+			warn("%s", o->io->name);
+		}
+		if (o->error != 0)
+			rv = 1;
+	}
+	return (rv);
+}
+
+/*
+ * Copy the name and counters of an output for printing.
+ */
+static void
+tee_copy(struct output *dst, const struct output *src)
+{
+
+	dst->io = src->io;
+	async_stat_lock();
+	dst->error = src->error;
+	dst->out_full = src->out_full;
+	dst->out_part = src->out_part;
+	dst->bytes = src->bytes;
+	dst->wlat = src->wlat;
+	async_stat_unlock();
+}
+
+/*
+ * Print what reached each output, once of= has been given more than once.
+ */
+void
+tee_summary(void)
+{
+	struct output o;
+	u_int i;
+
+	if (nouts == 0)
+		return;
+	for (i = 0; i < noutputs; i++) {
+		tee_copy(&o, &outputs[i]);
+		(void)fprintf(stderr, "%s: %ju+%ju records out, %ju bytes%s%s\n",
+		    o.io->name, o.out_full, o.out_part, o.bytes,
+		    o.error != 0 ? ", " : "",
+		    o.error != 0 ? strerror(o.error) : "");
+	}
+}
+
+/*
+ * Add the per-output statistics to a status=json record.
+ */
+void
+tee_json(void)
+{
+	struct output o;
+	u_int i;
+
+	if (nouts == 0)
+		return;
+	(void)fprintf(stderr, ",\"outputs\":[");
+	for (i = 0; i < noutputs; i++) {
+		tee_copy(&o, &outputs[i]);
+		(void)fprintf(stderr, "%s{\"name\":", i == 0 ? "" : ",");
+		json_string(o.io->name);
+		(void)fprintf(stderr, ",\"out_full\":%ju,\"out_part\":%ju,"
+		    "\"bytes\":%ju,\"error\":", o.out_full, o.out_part,
+		    o.bytes);
+		if (o.error != 0)
+			json_string(strerror(o.error));
+		else
+			(void)fprintf(stderr, "null");
+		json_lat("write", &o.wlat);
+		(void)fprintf(stderr, "}");
+	}
+	(void)fprintf(stderr, "]");
+}
@@ -60,13 +60,8 @@ __FBSDID("$FreeBSD$");
 void
 def(void)
 {
-	u_char *inp;
-	const u_char *t;
-	size_t cnt;
-
-	if ((t = ctab) != NULL)
-		for (inp = in.dbp - (cnt = in.dbrcnt); cnt--; ++inp)
-			*inp = t[*inp];
+	if (ctab != NULL)
+		xlate(in.dbp - in.dbrcnt, in.dbrcnt, ctab);
 
 	/* Make the output buffer look right. */
 	out.dbp = in.dbp;
@@ -104,8 +99,7 @@ def_close(void)
 void
 block(void)
 {
-	u_char *inp, *outp;
-	const u_char *t;
+	u_char *inp, *outp, *nl, *xp;
 	size_t cnt, maxlen;
 	static int intrunc;
 	int ch;
@@ -132,19 +126,24 @@ block(void)
 
 	/*
 	 * Copy records (max cbsz size chunks) into the output buffer.  The
-	 * translation is done as we copy into the output buffer.
+	 * translation is done on the output buffer, from xp up to out.dbp,
+	 * before it is written.
 	 */
 	ch = 0;
+	xp = out.dbp;
 	for (inp = in.dbp - in.dbcnt, outp = out.dbp; in.dbcnt;) {
 		maxlen = MIN(cbsz, (size_t)in.dbcnt);
-		if ((t = ctab) != NULL)
-			for (cnt = 0; cnt < maxlen && (ch = *inp++) != '\n';
-			    ++cnt)
-				*outp++ = t[ch];
+		if ((nl = memchr(inp, '\n', maxlen)) != NULL)
+			cnt = nl - inp;
+		else
+			cnt = maxlen;
+		(void)memcpy(outp, inp, cnt);
+		inp += cnt;
+		outp += cnt;
+		if (nl != NULL)
+			ch = *inp++;
 		else
-			for (cnt = 0; cnt < maxlen && (ch = *inp++) != '\n';
-			    ++cnt)
-				*outp++ = ch;
+			ch = inp[-1];
 		/*
 		 * Check for short record without a newline.  Reassemble the
 		 * input block.
@@ -161,7 +160,7 @@ block(void)
 
 		/* Pad short records with spaces. */
 		if (cnt < cbsz)
-			(void)memset(outp, ctab ? ctab[' '] : ' ', cbsz - cnt);
+			(void)memset(outp, ' ', cbsz - cnt);
 		else {
 			/*
 			 * If the next character wouldn't have ended the
@@ -181,10 +180,16 @@ block(void)
 
 		/* Adjust output buffer numbers. */
 		out.dbp += cbsz;
-		if ((out.dbcnt += cbsz) >= out.dbsz)
+		if ((out.dbcnt += cbsz) >= out.dbsz) {
+			if (ctab != NULL)
+				xlate(xp, out.dbp - xp, ctab);
 			dd_out(0);
+			xp = out.dbp;
+		}
 		outp = out.dbp;
 	}
+	if (ctab != NULL)
+		xlate(xp, out.dbp - xp, ctab);
 	in.dbp = in.db + in.dbcnt;
 }
 
@@ -223,9 +228,8 @@ unblock(void)
 	size_t cnt;
 
 	/* Translation and case conversion. */
-	if ((t = ctab) != NULL)
-		for (inp = in.dbp - (cnt = in.dbrcnt); cnt--; ++inp)
-			*inp = t[*inp];
+	if (ctab != NULL)
+		xlate(in.dbp - in.dbrcnt, in.dbrcnt, ctab);
 	/*
 	 * Copy records (max cbsz size chunks) into the output buffer.  The
 	 * translation has to already be done or we might not recognize the
@@ -87,19 +87,22 @@ __FBSDID("$FreeBSD$");
 static void dd_close(void);
 static void dd_in(void);
 static void getfdtype(IO *);
+static void open_out(IO *);
 static void setup(void);
 
 IO	in, out;		/* input/output state */
+IO	*outs;			/* further outputs, from repeated of= */
+u_int	nouts;
 STAT	st;			/* statistics */
 void	(*cfunc)(void);		/* conversion function */
 uintmax_t cpy_cnt;		/* # of blocks to copy */
-static off_t	pending = 0;	/* pending seek if sparse */
 uint64_t	ddflags = 0;	/* conversion options */
 size_t	cbsz;			/* conversion block size */
 uintmax_t files_cnt = 1;	/* # of files to copy */
 const	u_char *ctab;		/* conversion table */
 char	fill_char;		/* Character to fill with if defined */
 size_t	speed = 0;		/* maximum speed, in bytes per second */
+double	status_interval = 1;	/* seconds between progress reports */
 volatile sig_atomic_t need_summary;
 volatile sig_atomic_t need_progress;
 volatile sig_atomic_t kill_signal;
@@ -107,7 +110,7 @@ volatile sig_atomic_t kill_signal;
 int
 main(int argc __unused, char *argv[])
 {
-	struct itimerval itv = { { 1, 0 }, { 1, 0 } }; /* SIGALARM every second, if needed */
+	struct itimerval itv;	/* SIGALRM every status_interval, if needed */
 
 	(void)siginterrupt(SIGINT, 1);
 	(void)signal(SIGINT, terminate);
@@ -123,7 +126,11 @@ main(int argc __unused, char *argv[])
 #endif
 
 	(void)signal(SIGINFO, siginfo_handler);
-	if (ddflags & C_PROGRESS) {
+	if (ddflags & (C_PROGRESS | C_JSON)) {
+		itv.it_interval.tv_sec = (time_t)status_interval;
+		itv.it_interval.tv_usec = (suseconds_t)((status_interval -
+		    itv.it_interval.tv_sec) * 1000000);
+		itv.it_value = itv.it_interval;
 		(void)signal(SIGALRM, sigalarm_handler);
 		setitimer(ITIMER_REAL, &itv, NULL);
 	}
@@ -140,6 +147,8 @@ main(int argc __unused, char *argv[])
 	 * descriptor explicitly so that the summary handler (called
 	 * from an atexit() hook) includes this work.
 	 */
+	if (nouts != 0)
+		exit(tee_close());
 	if (close(out.fd) == -1 && errno != EINTR)
 		err(1, "close");
 	exit(0);
@@ -155,13 +164,51 @@ parity(u_char c)
 	return (i & 1);
 }
 
+/*
+ * Open a named output file.
+ */
+static void
+open_out(IO *io)
+{
+	int oflags;
+
+	oflags = O_CREAT;
+	if (!(ddflags & (C_SEEK | C_NOTRUNC)))
+		oflags |= O_TRUNC;
+	if (ddflags & C_OFSYNC)
+		oflags |= O_FSYNC;
+#ifndef __APPLE__
+	if (ddflags & C_ODIRECT)
+		oflags |= O_DIRECT;
+#endif
+	check_terminate();
+	io->fd = open(io->name, O_RDWR | oflags, DEFFILEMODE);
+	check_terminate();
+	/*
+	 * May not have read access, so try again with write only.
+	 * Without read we may have a problem if output also does
+	 * not support seeks.
+	 */
+	if (io->fd == -1) {
+		io->fd = open(io->name, O_WRONLY | oflags, DEFFILEMODE);
+		check_terminate();
+		io->flags |= NOREAD;
+	}
+#ifdef __APPLE__
+	if (ddflags & C_ODIRECT)
+		(void)fcntl(io->fd, F_NOCACHE, 1);
+#endif
+	if (io->fd == -1)
+		err(1, "%s", io->name);
+}
+
 static void
 setup(void)
 {
-	u_int cnt;
+	u_int cnt, i;
 	int iflags, oflags;
 #ifndef __APPLE__
-	cap_rights_t rights;
+	cap_rights_t orights, rights;
 	unsigned long cmds[] = { FIODTYPE, MTIOCTOP };
 #endif
 
@@ -213,47 +260,36 @@ setup(void)
 			if (fcntl(out.fd, F_SETFL, oflags) == -1)
 				err(1, "unable to set fd flags for stdout");
 		}
-	} else {
-		oflags = O_CREAT;
-		if (!(ddflags & (C_SEEK | C_NOTRUNC)))
-			oflags |= O_TRUNC;
-		if (ddflags & C_OFSYNC)
-			oflags |= O_FSYNC;
-#ifndef __APPLE__
-		if (ddflags & C_ODIRECT)
-			oflags |= O_DIRECT;
-#endif
-		check_terminate();
-		out.fd = open(out.name, O_RDWR | oflags, DEFFILEMODE);
-		check_terminate();
-		/*
-		 * May not have read access, so try again with write only.
-		 * Without read we may have a problem if output also does
-		 * not support seeks.
-		 */
-		if (out.fd == -1) {
-			out.fd = open(out.name, O_WRONLY | oflags, DEFFILEMODE);
-			check_terminate();
-			out.flags |= NOREAD;
-#ifndef __APPLE__
-			cap_rights_clear(&rights, CAP_READ);
-#endif
-		}
-#ifdef __APPLE__
-		if (ddflags & C_ODIRECT)
-			(void)fcntl(out.fd, F_NOCACHE, 1);
-#endif
-		if (out.fd == -1)
-			err(1, "%s", out.name);
-	}
+	} else
+		open_out(&out);
 
 	getfdtype(&out);
 
 #ifndef __APPLE__
+	orights = rights;
+	if (out.flags & NOREAD)
+		cap_rights_clear(&rights, CAP_READ);
 	if (caph_rights_limit(out.fd, &rights) == -1)
 		err(1, "unable to limit capability rights");
 	if (caph_ioctls_limit(out.fd, cmds, nitems(cmds)) == -1)
 		err(1, "unable to limit capability rights");
+#endif
+
+	for (i = 0; i < nouts; i++) {
+		open_out(&outs[i]);
+		getfdtype(&outs[i]);
+#ifndef __APPLE__
+		rights = orights;
+		if (outs[i].flags & NOREAD)
+			cap_rights_clear(&rights, CAP_READ);
+		if (caph_rights_limit(outs[i].fd, &rights) == -1)
+			err(1, "unable to limit capability rights");
+		if (caph_ioctls_limit(outs[i].fd, cmds, nitems(cmds)) == -1)
+			err(1, "unable to limit capability rights");
+#endif
+	}
+
+#ifndef __APPLE__
 
 	if (in.fd != STDIN_FILENO && out.fd != STDIN_FILENO) {
 		if (caph_limit_stdin() == -1)
@@ -287,11 +323,21 @@ setup(void)
 	in.dbp = in.db;
 	out.dbp = out.db;
 
+	/* The other outputs share the block size, seek and scratch buffer. */
+	for (i = 0; i < nouts; i++) {
+		outs[i].dbsz = out.dbsz;
+		outs[i].offset = out.offset;
+		outs[i].db = out.db;
+	}
+
 	/* Position the input/output streams. */
 	if (in.offset)
 		pos_in();
-	if (out.offset)
-		pos_out();
+	if (out.offset) {
+		pos_out(&out);
+		for (i = 0; i < nouts; i++)
+			pos_out(&outs[i]);
+	}
 
 	/*
 	 * Truncate the output file.  If it fails on a type of output file
@@ -301,6 +347,11 @@ setup(void)
 	    out.flags & ISTRUNC)
 		if (ftruncate(out.fd, out.offset * out.dbsz) == -1)
 			err(1, "truncating %s", out.name);
+	for (i = 0; i < nouts; i++)
+		if ((ddflags & (C_SEEK | C_NOTRUNC)) == C_SEEK &&
+		    outs[i].flags & ISTRUNC &&
+		    ftruncate(outs[i].fd, outs[i].offset * outs[i].dbsz) == -1)
+			err(1, "truncating %s", outs[i].name);
 
 	if (ddflags & (C_LCASE  | C_UCASE | C_ASCII | C_EBCDIC | C_PARITY)) {
 		if (ctab != NULL) {
@@ -351,6 +402,22 @@ setup(void)
 		ctab = casetab;
 	}
 
+	if (ddflags & C_IASYNC && in.flags & ISTAPE)
+		errx(1, "iflag=async is not supported for tape devices");
+	/* Each output gets its own writer thread; see async.c. */
+	if (nouts != 0) {
+		if (ddflags & C_SPARSE)
+			errx(1, "conv=sparse is not supported with several outputs");
+		ddflags |= C_OASYNC;
+	}
+	if (ddflags & C_SPARSE)
+		sparse_setup();
+	if (ddflags & (C_IHASH | C_OHASH))
+		hash_start();
+	if (ddflags & (C_IASYNC | C_OASYNC))
+		async_start(ddflags & (C_BLOCK | C_UNBLOCK) ?
+		    out.dbsz + cbsz : (size_t)out.dbsz + in.dbsz - 1);
+
 	if (clock_gettime(CLOCK_MONOTONIC, &st.start))
 		err(1, "clock_gettime");
 }
@@ -419,24 +486,10 @@ speed_limit(void)
 	t_prev = t_now;
 }
 
-static void
-swapbytes(void *v, size_t len)
-{
-	unsigned char *p = v;
-	unsigned char t;
-
-	while (len > 1) {
-		t = p[0];
-		p[0] = p[1];
-		p[1] = t;
-		p += 2;
-		len -= 2;
-	}
-}
-
 static void
 dd_in(void)
 {
+	struct timespec t0;
 	ssize_t n;
 
 	for (;;) {
@@ -470,7 +523,15 @@ dd_in(void)
 		in.dbrcnt = 0;
 fill:
 		check_terminate();
-		n = read(in.fd, in.dbp + in.dbrcnt, in.dbsz - in.dbrcnt);
+		if (ddflags & C_IASYNC)
+			n = async_read(in.dbp + in.dbrcnt, in.dbsz - in.dbrcnt);
+		else {
+			if (ddflags & C_JSON)
+				(void)clock_gettime(CLOCK_MONOTONIC, &t0);
+			n = read(in.fd, in.dbp + in.dbrcnt, in.dbsz - in.dbrcnt);
+			if (ddflags & C_JSON)
+				lat_add(&st.rlat, &t0);
+		}
 		check_terminate();
 
 		/* EOF */
@@ -492,9 +553,10 @@ fill:
 			 * If it's a seekable file descriptor, seek past the
 			 * error.  If your OS doesn't do the right thing for
 			 * raw disks this section should be modified to re-read
-			 * in sector size chunks.
+			 * in sector size chunks.  The reader thread has already
+			 * done so for iflag=async.
 			 */
-			if (in.flags & ISSEEK &&
+			if (!(ddflags & C_IASYNC) && in.flags & ISSEEK &&
 			    lseek(in.fd, (off_t)in.dbsz, SEEK_CUR))
 				warn("%s", in.name);
 
@@ -503,6 +565,9 @@ fill:
 				continue;
 		}
 
+		if (n > 0 && ddflags & C_IHASH)
+			hash_input(in.dbp + in.dbrcnt, n);
+
 		/* If conv=sync, use the entire block. */
 		if (ddflags & C_SYNC)
 			n = in.dbsz;
@@ -558,6 +623,8 @@ fill:
 static void
 dd_close(void)
 {
+	struct stat sb;
+
 	if (cfunc == def)
 		def_close();
 	else if (cfunc == block)
@@ -573,19 +640,30 @@ dd_close(void)
 			memset(out.dbp, 0, out.dbsz - out.dbcnt);
 		out.dbcnt = out.dbsz;
 	}
-	if (out.dbcnt || pending)
+	if (out.dbcnt)
 		dd_out(1);
+	if (ddflags & C_SPARSE)
+		sparse_finish();
+	if (ddflags & C_OASYNC)
+		async_finish();
+	if (ddflags & (C_IHASH | C_OHASH))
+		hash_finish();
 
 	/*
 	 * If the file ends with a hole, ftruncate it to extend its size
 	 * up to the end of the hole (without having to write any data).
+	 * With conv=notrunc the file may already be longer.
 	 */
-	if (out.seek_offset > 0 && (out.flags & ISTRUNC)) {
+	if (out.seek_offset > 0 && (out.flags & ISTRUNC) &&
+	    (fstat(out.fd, &sb) == -1 || sb.st_size < out.seek_offset)) {
 		if (ftruncate(out.fd, out.seek_offset) == -1)
 			err(1, "truncating %s", out.name);
 	}
 
-	if (ddflags & C_FSYNC) {
+	/* With several outputs, the writer threads have synced them. */
+	if (nouts != 0)
+		;
+	else if (ddflags & C_FSYNC) {
 		if (fsync(out.fd) == -1)
 			err(1, "fsyncing %s", out.name);
 #ifndef __APPLE__
@@ -596,14 +674,84 @@ dd_close(void)
 	}
 }
 
+/*
+ * Account for nw bytes written out of an attempted cnt, part of an output
+ * block of n bytes.  An n of 0 counts the bytes but not the record.
+ */
+void
+out_count(size_t nw, size_t cnt, size_t n)
+{
+	static int warned;
+
+	/* With oflag=async this runs on the writer thread. */
+	async_stat_lock();
+	st.bytes += nw;
+
+	if (n == 0)
+		;
+	else if (nw == n && n == (size_t)out.dbsz)
+		++st.out_full;
+	else
+		++st.out_part;
+	async_stat_unlock();
+
+	if (nw != cnt) {
+		if (out.flags & ISTAPE)
+			errx(1, "%s: short write on tape device",
+			    out.name);
+		if (out.flags & ISCHR && !warned) {
+			warned = 1;
+			warnx("%s: short write on character device",
+			    out.name);
+		}
+	}
+}
+
+/*
+ * Write cnt bytes at p, part of an output block of n bytes (or 0 if the
+ * record is accounted for elsewhere), retrying short writes.
+ */
+void
+out_write(const u_char *p, size_t cnt, size_t n)
+{
+	struct timespec t0;
+	ssize_t nw;
+
+	do {
+		if (ddflags & C_JSON)
+			(void)clock_gettime(CLOCK_MONOTONIC, &t0);
+		nw = write(out.fd, p, cnt);
+		if (ddflags & C_JSON) {
+			async_stat_lock();
+			lat_add(&st.wlat, &t0);
+			async_stat_unlock();
+		}
+		out.seek_offset = 0;
+		if (nw <= 0) {
+			if (nw == 0)
+				errx(1, "%s: end of device", out.name);
+			if (errno != EINTR)
+				err(1, "%s", out.name);
+			nw = 0;
+		}
+		p += nw;
+		out_count(nw, cnt, n);
+		cnt -= nw;
+		/*
+		 * A signal cuts a write short; act on it before blocking in
+		 * the next one.  The async writer threads leave that to the
+		 * main thread.
+		 */
+		if (cnt != 0 && !(ddflags & C_OASYNC))
+			check_terminate();
+	} while (cnt != 0);
+}
+
 void
 dd_out(int force)
 {
 	u_char *outp;
-	size_t cnt, n;
-	ssize_t nw;
-	static int warned;
-	int sparse;
+	size_t n;
 
 	/*
 	 * Write one or more blocks out.  The common case is writing a full
@@ -629,69 +777,21 @@ dd_out(int force)
 	 * a time at most.
 	 */
 	for (n = force ? out.dbcnt : out.dbsz;; n = out.dbsz) {
-		cnt = n;
-		do {
-			sparse = 0;
-			if (ddflags & C_SPARSE) {
-				/* Is buffer sparse? */
-				sparse = BISZERO(outp, cnt);
-			}
-			if (sparse && !force) {
-				pending += cnt;
-				nw = cnt;
-			} else {
-				if (pending != 0) {
-					/*
-					 * Seek past hole.  Note that we need to record the
-					 * reached offset, because we might have no more data
-					 * to write, in which case we'll need to call
-					 * ftruncate to extend the file size.
-					 */
-					out.seek_offset = lseek(out.fd, pending, SEEK_CUR);
-					if (out.seek_offset == -1)
-						err(2, "%s: seek error creating sparse file",
-						    out.name);
-					pending = 0;
-				}
-				if (cnt) {
-					check_terminate();
-					nw = write(out.fd, outp, cnt);
-					check_terminate();
-					out.seek_offset = 0;
-				} else {
-					return;
-				}
-			}
-
-			if (nw <= 0) {
-				if (nw == 0)
-					errx(1, "%s: end of device", out.name);
-				if (errno != EINTR)
-					err(1, "%s", out.name);
-				nw = 0;
-			}
-
-			outp += nw;
-			st.bytes += nw;
-
-			if ((size_t)nw == n && n == (size_t)out.dbsz)
-				++st.out_full;
-			else
-				++st.out_part;
-
-			if ((size_t) nw != cnt) {
-				if (out.flags & ISTAPE)
-					errx(1, "%s: short write on tape device",
-				    	out.name);
-				if (out.flags & ISCHR && !warned) {
-					warned = 1;
-					warnx("%s: short write on character device",
-				    	out.name);
-				}
-			}
-
-			cnt -= nw;
-		} while (cnt != 0);
+		if (n == 0)
+			break;
+		if (ddflags & C_OHASH)
+			hash_output(outp, n);
+		if (ddflags & C_SPARSE)
+			sparse_out(outp, n, force);
+		else if (ddflags & C_OASYNC) {
+			/* The writer thread does the accounting. */
+			async_write(outp, n, n);
+		} else {
+			check_terminate();
+			out_write(outp, n, n);
+			check_terminate();
+		}
+		outp += n;
 
 		if ((out.dbcnt -= n) < out.dbsz)
 			break;
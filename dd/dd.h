@@ -59,8 +59,21 @@ typedef struct {
 	int		fd;		/* file descriptor */
 	off_t		offset;		/* # of blocks to skip */
 	off_t		seek_offset;	/* offset of last seek past output hole */
+
+#define	HASH_CRC32C	1
+#define	HASH_XXH64	2
+#define	HASH_SHA256	3
+	int		hash;		/* ihash=/ohash= algorithm, or 0 */
 } IO;
 
+/* Histogram of system call latencies, for status=json. */
+#define	LAT_BUCKETS	24		/* hist[i]: calls under 2^i usecs */
+typedef struct {
+	uintmax_t	calls;		/* # of calls */
+	uintmax_t	usecs;		/* total time spent */
+	uintmax_t	hist[LAT_BUCKETS];
+} LAT;
+
 typedef struct {
 	uintmax_t	in_full;	/* # of full input blocks */
 	uintmax_t	in_part;	/* # of partial input blocks */
@@ -70,6 +83,8 @@ typedef struct {
 	uintmax_t	swab;		/* # of odd-length swab blocks */
 	uintmax_t	bytes;		/* # of bytes written */
 	struct timespec	start;		/* start time of dd */
+	LAT		rlat;		/* read(2) latencies */
+	LAT		wlat;		/* write(2) latencies */
 } STAT;
 
 /* Flags (in ddflags). */
@@ -112,11 +127,12 @@ typedef struct {
 #define	C_IFULLBLOCK	0x0000000400000000ULL
 #define	C_IDIRECT	0x0000000800000000ULL
 #define	C_ODIRECT	0x0000001000000000ULL
+#define	C_IASYNC	0x0000002000000000ULL
+#define	C_OASYNC	0x0000004000000000ULL
+#define	C_IHASH		0x0000008000000000ULL
+#define	C_OHASH		0x0000010000000000ULL
+#define	C_JSON		0x0000020000000000ULL
 
 #define	C_PARITY	(C_PAREVEN | C_PARODD | C_PARNONE | C_PARSET)
 
-#define	BISZERO(p, s)	((s) > 0 && *((const char *)p) == 0 && !memcmp( \
-			    (const void *)(p), (const void *) \
-			    ((const char *)p + 1), (s) - 1))
-
 #endif /* _DD_H_ */
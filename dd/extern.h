@@ -39,31 +39,61 @@
 #ifndef _DD_EXTERN_H_
 #define _DD_EXTERN_H_
 
+void async_finish(void);
+ssize_t async_read(void *, size_t);
+void async_start(size_t);
+void async_stat_lock(void);
+void async_stat_unlock(void);
+void async_write(const u_char *, size_t, size_t);
 void block(void);
 void block_close(void);
 void dd_out(int);
 void def(void);
 void def_close(void);
+void hash_finish(void);
+void hash_input(const void *, size_t);
+void hash_json(void);
+int hash_lookup(const char *);
+void hash_output(const void *, size_t);
+void hash_start(void);
+void hash_summary(void);
 void jcl(char **);
+void json_lat(const char *, const LAT *);
+void json_string(const char *);
+void lat_add(LAT *, const struct timespec *);
+void out_count(size_t, size_t, size_t);
+void out_hole(off_t);
+void out_write(const u_char *, size_t, size_t);
 void pos_in(void);
-void pos_out(void);
+void pos_out(IO *);
 double secs_elapsed(void);
 void progress(void);
 void summary(void);
+void swapbytes(void *, size_t);
 void sigalarm_handler(int);
 void siginfo_handler(int);
+void sparse_finish(void);
+void sparse_out(const u_char *, size_t, int);
+void sparse_setup(void);
+int tee_close(void);
+void tee_json(void);
+void tee_summary(void);
 void terminate(int);
 void check_terminate(void);
 void unblock(void);
 void unblock_close(void);
+void xlate(u_char *, size_t, const u_char *);
 
 extern IO in, out;
+extern IO *outs;
+extern u_int nouts;
 extern STAT st;
 extern void (*cfunc)(void);
 extern uintmax_t cpy_cnt;
 extern size_t cbsz;
 extern uint64_t ddflags;
 extern size_t speed;
+extern double status_interval;
 extern uintmax_t files_cnt;
 extern const u_char *ctab;
 extern const u_char a2e_32V[], a2e_POSIX[];
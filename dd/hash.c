@@ -0,0 +1,593 @@
+/*
+* Copyright (c) 2026 Apple Inc. All rights reserved.
+*
+* @APPLE_LICENSE_HEADER_START@
+*
+* This file contains Original Code and/or Modifications of Original Code
+* as defined in and that are subject to the Apple Public Source License
+* Version 2.0 (the 'License'). You may not use this file except in
+* compliance with the License. Please obtain a copy of the License at
+* http://www.opensource.apple.com/apsl/ and read it before using this
+* file.
+*
+* The Original Code and all software distributed under the License are
+* distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+* EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+* INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+* Please see the License for the specific language governing rights and
+* limitations under the License.
+*
+* @APPLE_LICENSE_HEADER_END@
+*/
+
+#include <sys/param.h>
+
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <CommonCrypto/CommonDigest.h>
+#else
+#include <sha256.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#include "dd.h"
+#include "extern.h"
+
+#if defined(__APPLE__) && !defined(nitems)
+#define	nitems(x)	(sizeof((x)) / sizeof((x)[0]))
+#endif
+
+/*
+ * ihash= and ohash=: digests of the data read and of the data written,
+ * computed as it passes through, so that an image does not have to be
+ * read back to be verified.  Each side has a hashing thread fed through
+ * a ring of HASH_NBUF buffers of HASH_BUFSIZE bytes; the main thread only
+ * copies the data.
+ */
+#define	HASH_NBUF	4
+#define	HASH_BUFSIZE	(1024 * 1024)
+
+#ifdef __APPLE__
+#define	SHA256_CTX		CC_SHA256_CTX
+#define	SHA256_Init		CC_SHA256_Init
+#define	SHA256_Update		CC_SHA256_Update
+#define	SHA256_Final		CC_SHA256_Final
+#endif
+
+#define	CRC32C_POLY	0x82f63b78
+
+#define	XXH_PRIME64_1	0x9e3779b185ebca87ULL
+#define	XXH_PRIME64_2	0xc2b2ae3d27d4eb4fULL
+#define	XXH_PRIME64_3	0x165667b19e3779f9ULL
+#define	XXH_PRIME64_4	0x85ebca77c2b2ae63ULL
+#define	XXH_PRIME64_5	0x27d4eb2f165667c5ULL
+
+struct xxh64 {
+	uint64_t	v[4];
+	uint64_t	total;
+	u_char		buf[32];
+	size_t		buflen;
+};
+
+union hash_ctx {
+	uint32_t	crc;
+	struct xxh64	xxh;
+	SHA256_CTX	sha;
+};
+
+struct hasher {
+	const struct hashalg *alg;
+	union hash_ctx	 ctx;
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 cv;
+	u_char		*bufs[HASH_NBUF];
+	size_t		 lens[HASH_NBUF];
+	u_int		 head;		/* slot being filled by dd */
+	u_int		 tail;		/* slot being hashed */
+	int		 eof;
+	pthread_t	 tid;
+	const char	*name;		/* file name for the summary */
+	char		 hex[65];	/* result, once finished */
+};
+
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+static uint32_t crc32c_tab[8][256];
+
+#if defined(__x86_64__) || defined(__i386__)
+#define	CRC32C_SSE42
+static int crc32c_have_sse42;
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define	CRC32C_ARMV8
+#endif
+
+static void
+crc32c_tabinit(void)
+{
+	uint32_t c;
+	int i, j, k;
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (j = 0; j < 8; j++)
+			c = c & 1 ? c >> 1 ^ CRC32C_POLY : c >> 1;
+		crc32c_tab[0][i] = c;
+	}
+	for (i = 0; i < 256; i++)
+		for (k = 1; k < 8; k++)
+			crc32c_tab[k][i] = crc32c_tab[k - 1][i] >> 8 ^
+			    crc32c_tab[0][crc32c_tab[k - 1][i] & 0xff];
+#ifdef CRC32C_SSE42
+	crc32c_have_sse42 = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+#ifdef CRC32C_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t
+crc32c_sse42(uint32_t crc, const u_char *p, size_t len)
+{
+	uint64_t w, c;
+
+	for (; len != 0 && ((uintptr_t)p & 7) != 0; len--, p++)
+		crc = _mm_crc32_u8(crc, *p);
+#ifdef __x86_64__
+	for (c = crc; len >= 8; len -= 8, p += 8) {
+		memcpy(&w, p, sizeof(w));
+		c = _mm_crc32_u64(c, w);
+	}
+	crc = (uint32_t)c;
+#else
+	(void)w;
+	(void)c;
+#endif
+	for (; len != 0; len--, p++)
+		crc = _mm_crc32_u8(crc, *p);
+	return (crc);
+}
+#endif
+
+#ifdef CRC32C_ARMV8
+static uint32_t
+crc32c_armv8(uint32_t crc, const u_char *p, size_t len)
+{
+	uint64_t w;
+
+	for (; len != 0 && ((uintptr_t)p & 7) != 0; len--, p++)
+		crc = __crc32cb(crc, *p);
+	for (; len >= 8; len -= 8, p += 8) {
+		memcpy(&w, p, sizeof(w));
+		crc = __crc32cd(crc, w);
+	}
+	for (; len != 0; len--, p++)
+		crc = __crc32cb(crc, *p);
+	return (crc);
+}
+#endif
+
+static void
+crc32c_init(union hash_ctx *ctx)
+{
+
+	(void)pthread_once(&crc32c_once, crc32c_tabinit);
+	ctx->crc = 0xffffffff;
+}
+
+static void
+crc32c_update(union hash_ctx *ctx, const u_char *p, size_t len)
+{
+	uint32_t a, b, crc;
+
+	crc = ctx->crc;
+#if defined(CRC32C_SSE42)
+	if (crc32c_have_sse42) {
+		ctx->crc = crc32c_sse42(crc, p, len);
+		return;
+	}
+#elif defined(CRC32C_ARMV8)
+	ctx->crc = crc32c_armv8(crc, p, len);
+	return;
+#endif
+	for (; len != 0 && ((uintptr_t)p & 7) != 0; len--, p++)
+		crc = crc32c_tab[0][(crc ^ *p) & 0xff] ^ crc >> 8;
+	for (; len >= 8; len -= 8, p += 8) {
+		a = crc ^ ((uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 |
+		    (uint32_t)p[1] << 8 | p[0]);
+		b = (uint32_t)p[7] << 24 | (uint32_t)p[6] << 16 |
+		    (uint32_t)p[5] << 8 | p[4];
+		crc = crc32c_tab[7][a & 0xff] ^ crc32c_tab[6][(a >> 8) & 0xff] ^
+		    crc32c_tab[5][(a >> 16) & 0xff] ^ crc32c_tab[4][a >> 24] ^
+		    crc32c_tab[3][b & 0xff] ^ crc32c_tab[2][(b >> 8) & 0xff] ^
+		    crc32c_tab[1][(b >> 16) & 0xff] ^ crc32c_tab[0][b >> 24];
+	}
+	for (; len != 0; len--, p++)
+		crc = crc32c_tab[0][(crc ^ *p) & 0xff] ^ crc >> 8;
+	ctx->crc = crc;
+}
+
+static void
+crc32c_final(union hash_ctx *ctx, char *hex)
+{
+
+	(void)snprintf(hex, 9, "%08x", ~ctx->crc);
+}
+
+static uint64_t
+rd64(const u_char *p)
+{
+
+	return ((uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 |
+	    (uint64_t)p[3] << 24 | (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 |
+	    (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56);
+}
+
+#define	ROTL64(x, r)	((x) << (r) | (x) >> (64 - (r)))
+
+static uint64_t
+xxh64_round(uint64_t acc, uint64_t input)
+{
+
+	acc += input * XXH_PRIME64_2;
+	acc = ROTL64(acc, 31);
+	return (acc * XXH_PRIME64_1);
+}
+
+static void
+xxh64_init(union hash_ctx *ctx)
+{
+	struct xxh64 *x = &ctx->xxh;
+
+	memset(x, 0, sizeof(*x));
+	x->v[0] = XXH_PRIME64_1 + XXH_PRIME64_2;
+	x->v[1] = XXH_PRIME64_2;
+	x->v[2] = 0;
+	x->v[3] = -XXH_PRIME64_1;
+}
+
+static void
+xxh64_stripe(struct xxh64 *x, const u_char *p)
+{
+
+	x->v[0] = xxh64_round(x->v[0], rd64(p));
+	x->v[1] = xxh64_round(x->v[1], rd64(p + 8));
+	x->v[2] = xxh64_round(x->v[2], rd64(p + 16));
+	x->v[3] = xxh64_round(x->v[3], rd64(p + 24));
+}
+
+static void
+xxh64_update(union hash_ctx *ctx, const u_char *p, size_t len)
+{
+	struct xxh64 *x = &ctx->xxh;
+	size_t n;
+
+	x->total += len;
+	if (x->buflen != 0) {
+		n = MIN(len, sizeof(x->buf) - x->buflen);
+		memcpy(x->buf + x->buflen, p, n);
+		x->buflen += n;
+		p += n;
+		len -= n;
+		if (x->buflen < sizeof(x->buf))
+			return;
+		xxh64_stripe(x, x->buf);
+		x->buflen = 0;
+	}
+	for (; len >= 32; len -= 32, p += 32)
+		xxh64_stripe(x, p);
+	memcpy(x->buf, p, len);
+	x->buflen = len;
+}
+
+static void
+xxh64_final(union hash_ctx *ctx, char *hex)
+{
+	struct xxh64 *x = &ctx->xxh;
+	const u_char *p;
+	uint64_t h;
+	size_t len;
+	int i;
+
+	if (x->total >= 32) {
+		h = ROTL64(x->v[0], 1) + ROTL64(x->v[1], 7) +
+		    ROTL64(x->v[2], 12) + ROTL64(x->v[3], 18);
+		for (i = 0; i < 4; i++) {
+			h ^= xxh64_round(0, x->v[i]);
+			h = h * XXH_PRIME64_1 + XXH_PRIME64_4;
+		}
+	} else
+		h = XXH_PRIME64_5;
+	h += x->total;
+	for (p = x->buf, len = x->buflen; len >= 8; len -= 8, p += 8) {
+		h ^= xxh64_round(0, rd64(p));
+		h = ROTL64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+	}
+	if (len >= 4) {
+		h ^= ((uint64_t)p[0] | (uint64_t)p[1] << 8 |
+		    (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24) * XXH_PRIME64_1;
+		h = ROTL64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+		len -= 4;
+	}
+	for (; len != 0; len--, p++) {
+		h ^= *p * XXH_PRIME64_5;
+		h = ROTL64(h, 11) * XXH_PRIME64_1;
+	}
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+	(void)snprintf(hex, 17, "%016llx", (unsigned long long)h);
+}
+
+static void
+sha256_init(union hash_ctx *ctx)
+{
+
+	SHA256_Init(&ctx->sha);
+}
+
+static void
+sha256_update(union hash_ctx *ctx, const u_char *p, size_t len)
+{
+
+	/* len is at most HASH_BUFSIZE. */
+	SHA256_Update(&ctx->sha, p, len);
+}
+
+static void
+sha256_final(union hash_ctx *ctx, char *hex)
+{
+	u_char md[32];
+	size_t i;
+
+	SHA256_Final(md, &ctx->sha);
+	for (i = 0; i < sizeof(md); i++)
+		(void)snprintf(hex + 2 * i, 3, "%02x", md[i]);
+}
+
+static const struct hashalg {
+	const char	*name;
+	const char	*label;
+	void		(*init)(union hash_ctx *);
+	void		(*update)(union hash_ctx *, const u_char *, size_t);
+	void		(*final)(union hash_ctx *, char *);
+} hashalgs[] = {
+	/* Indexed by HASH_* - 1. */
+	{ "crc32c",	"CRC32C",	crc32c_init,	crc32c_update,	crc32c_final },
+	{ "xxh64",	"XXH64",	xxh64_init,	xxh64_update,	xxh64_final },
+	{ "sha256",	"SHA256",	sha256_init,	sha256_update,	sha256_final },
+};
+
+static struct hasher hin, hout;
+
+/*
+ * Map an ihash= or ohash= argument to its HASH_* value.
+ */
+int
+hash_lookup(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < nitems(hashalgs); i++)
+		if (strcmp(name, hashalgs[i].name) == 0)
+			return ((int)i + 1);
+	errx(1, "unknown hash %s", name);
+}
+
+static void *
+hasher(void *arg)
+{
+	struct hasher *h = arg;
+	u_int slot;
+
+	for (;;) {
+		pthread_mutex_lock(&h->mtx);
+		while (h->tail == h->head && !h->eof)
+			pthread_cond_wait(&h->cv, &h->mtx);
+		if (h->tail == h->head) {
+			pthread_mutex_unlock(&h->mtx);
+			break;
+		}
+		pthread_mutex_unlock(&h->mtx);
+
+		slot = h->tail % HASH_NBUF;
+		h->alg->update(&h->ctx, h->bufs[slot], h->lens[slot]);
+
+		pthread_mutex_lock(&h->mtx);
+		h->lens[slot] = 0;
+		h->tail++;
+		pthread_cond_broadcast(&h->cv);
+		pthread_mutex_unlock(&h->mtx);
+	}
+	h->alg->final(&h->ctx, h->hex);
+	return (NULL);
+}
+
+/*
+ * Wait for the hashing thread, waking up regularly to handle SIGINT and
+ * SIGINFO.
+ */
+static void
+hash_wait(struct hasher *h)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += 100 * 1000 * 1000;
+	if (ts.tv_nsec >= 1000 * 1000 * 1000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000 * 1000 * 1000;
+	}
+	(void)pthread_cond_timedwait(&h->cv, &h->mtx, &ts);
+	if (kill_signal || need_summary || need_progress) {
+		pthread_mutex_unlock(&h->mtx);
+		check_terminate();
+		if (need_summary)
+			summary();
+		if (need_progress)
+			progress();
+		pthread_mutex_lock(&h->mtx);
+	}
+}
+
+static void
+hash_init(struct hasher *h, int alg, const char *name)
+{
+	sigset_t all, old;
+	u_int i;
+	int error;
+
+	h->alg = &hashalgs[alg - 1];
+	h->name = name;
+	h->alg->init(&h->ctx);
+	pthread_mutex_init(&h->mtx, NULL);
+	pthread_cond_init(&h->cv, NULL);
+	for (i = 0; i < HASH_NBUF; i++)
+		if ((h->bufs[i] = malloc(HASH_BUFSIZE)) == NULL)
+			err(1, "hash buffer");
+
+	/* Leave signal handling to the main thread. */
+	(void)sigfillset(&all);
+	(void)pthread_sigmask(SIG_SETMASK, &all, &old);
+	if ((error = pthread_create(&h->tid, NULL, hasher, h)) != 0)
+		errc(1, error, "pthread_create");
+	(void)pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+void
+hash_start(void)
+{
+
+	if (in.hash)
+		hash_init(&hin, in.hash, in.name);
+	if (out.hash)
+		hash_init(&hout, out.hash, out.name);
+}
+
+static void
+hash_queue(struct hasher *h)
+{
+
+	pthread_mutex_lock(&h->mtx);
+	h->head++;
+	pthread_cond_broadcast(&h->cv);
+	while (h->head - h->tail == HASH_NBUF)
+		hash_wait(h);
+	pthread_mutex_unlock(&h->mtx);
+}
+
+static void
+hash_update(struct hasher *h, const u_char *p, size_t len)
+{
+	u_int slot;
+	size_t n;
+
+	while (len != 0) {
+		slot = h->head % HASH_NBUF;
+		n = MIN(len, HASH_BUFSIZE - h->lens[slot]);
+		memcpy(h->bufs[slot] + h->lens[slot], p, n);
+		h->lens[slot] += n;
+		p += n;
+		len -= n;
+		if (h->lens[slot] == HASH_BUFSIZE)
+			hash_queue(h);
+	}
+}
+
+/* Hash data as read, before any conversion. */
+void
+hash_input(const void *p, size_t len)
+{
+
+	hash_update(&hin, p, len);
+}
+
+/* Hash data as written, after conversion. */
+void
+hash_output(const void *p, size_t len)
+{
+
+	hash_update(&hout, p, len);
+}
+
+static void
+hash_end(struct hasher *h)
+{
+
+	if (h->alg == NULL)
+		return;
+	if (h->lens[h->head % HASH_NBUF] != 0)
+		hash_queue(h);
+	pthread_mutex_lock(&h->mtx);
+	h->eof = 1;
+	pthread_cond_broadcast(&h->cv);
+	while (h->tail != h->head)
+		hash_wait(h);
+	pthread_mutex_unlock(&h->mtx);
+	(void)pthread_join(h->tid, NULL);
+}
+
+/*
+ * Hash whatever is still buffered and wait for the results.
+ */
+void
+hash_finish(void)
+{
+
+	hash_end(&hin);
+	hash_end(&hout);
+}
+
+static void
+hash_print(const struct hasher *h)
+{
+
+	if (h->hex[0] != '\0')
+		(void)fprintf(stderr, "%s (%s) = %s\n", h->alg->label, h->name,
+		    h->hex);
+}
+
+static void
+hash_json1(const char *key, const struct hasher *h)
+{
+
+	if (h->hex[0] != '\0')
+		(void)fprintf(stderr, ",\"%s\":{\"algorithm\":\"%s\","
+		    "\"digest\":\"%s\"}", key, h->alg->name, h->hex);
+}
+
+/*
+ * Add the digests, once the copy has finished, to a status=json record.
+ */
+void
+hash_json(void)
+{
+
+	hash_json1("ihash", &hin);
+	hash_json1("ohash", &hout);
+}
+
+/*
+ * Print the digests, once the copy has finished.
+ */
+void
+hash_summary(void)
+{
+
+	hash_print(&hin);
+	hash_print(&hout);
+}
@@ -76,41 +76,150 @@ secs_elapsed(void)
 	return (secs);
 }
 
+/*
+ * Record the latency of a system call that started at t0.
+ */
+void
+lat_add(LAT *lat, const struct timespec *t0)
+{
+	struct timespec t1;
+	uintmax_t us;
+	int i;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &t1);
+	us = (uintmax_t)(t1.tv_sec - t0->tv_sec) * 1000000 +
+	    (t1.tv_nsec - t0->tv_nsec) / 1000;
+	for (i = 0; i < LAT_BUCKETS - 1 && us >= (uintmax_t)1 << i; i++)
+		;
+	lat->calls++;
+	lat->usecs += us;
+	lat->hist[i]++;
+}
+
+/*
+ * Print s as a JSON string.
+ */
+void
+json_string(const char *s)
+{
+	const u_char *p;
+
+	(void)fputc('"', stderr);
+	for (p = (const u_char *)s; *p != '\0'; p++) {
+		if (*p == '"' || *p == '\\')
+			(void)fprintf(stderr, "\\%c", *p);
+		else if (*p < 0x20)
+			(void)fprintf(stderr, "\\u%04x", *p);
+		else
+			(void)fputc(*p, stderr);
+	}
+	(void)fputc('"', stderr);
+}
+
+/*
+ * Print a system call latency histogram as a member of a JSON object.
+ */
+void
+json_lat(const char *name, const LAT *lat)
+{
+	int i;
+
+	(void)fprintf(stderr, ",\"%s\":{\"calls\":%ju,\"usecs\":%ju,\"hist\":[",
+	    name, lat->calls, lat->usecs);
+	for (i = 0; i < LAT_BUCKETS; i++)
+		(void)fprintf(stderr, "%s%ju", i ? "," : "", lat->hist[i]);
+	(void)fprintf(stderr, "]}");
+}
+
+/*
+ * Copy st for printing; with iflag=async or oflag=async other threads are
+ * updating it.
+ */
+static void
+stat_copy(STAT *sp)
+{
+
+	async_stat_lock();
+	*sp = st;
+	async_stat_unlock();
+}
+
+/*
+ * Print one status=json record: a single line holding a JSON object.
+ */
+static void
+json_status(const char *type)
+{
+	static double last_secs;
+	static uintmax_t last_bytes;
+	double secs, rate;
+	STAT s;
+
+	stat_copy(&s);
+	secs = secs_elapsed();
+	rate = secs > last_secs ?
+	    (s.bytes - last_bytes) / (secs - last_secs) : 0;
+	(void)fprintf(stderr, "{\"type\":\"%s\",\"secs\":%.6f,"
+	    "\"bytes\":%ju,\"in_full\":%ju,\"in_part\":%ju,"
+	    "\"out_full\":%ju,\"out_part\":%ju,\"trunc\":%ju,"
+	    "\"swab\":%ju,\"rate\":%.0f,\"avg_rate\":%.0f",
+	    type, secs, s.bytes, s.in_full, s.in_part, s.out_full,
+	    s.out_part, s.trunc, s.swab, rate, s.bytes / secs);
+	json_lat("read", &s.rlat);
+	json_lat("write", &s.wlat);
+	tee_json();
+	hash_json();
+	(void)fprintf(stderr, "}\n");
+	last_secs = secs;
+	last_bytes = s.bytes;
+}
+
 void
 summary(void)
 {
 	double secs;
+	STAT s;
 
-	if (ddflags & C_NOINFO)
+	if (ddflags & C_JSON) {
+		json_status("summary");
+		need_summary = 0;
+		return;
+	}
+	if (ddflags & C_NOINFO) {
+		hash_summary();
 		return;
+	}
 
 	if (ddflags & C_PROGRESS)
 		fprintf(stderr, "\n");
 
+	stat_copy(&s);
 	secs = secs_elapsed();
 
 	(void)fprintf(stderr,
 	    "%ju+%ju records in\n%ju+%ju records out\n",
-	    st.in_full, st.in_part, st.out_full, st.out_part);
-	if (st.swab)
+	    s.in_full, s.in_part, s.out_full, s.out_part);
+	if (s.swab)
 		(void)fprintf(stderr, "%ju odd length swab %s\n",
 #ifdef __APPLE__
-		     st.swab, (st.swab == 1) ? "record" : "records");
+		     s.swab, (s.swab == 1) ? "record" : "records");
 #else
-		     st.swab, (st.swab == 1) ? "block" : "blocks");
+		     s.swab, (s.swab == 1) ? "block" : "blocks");
 #endif
-	if (st.trunc)
+	if (s.trunc)
 		(void)fprintf(stderr, "%ju truncated %s\n",
 #ifdef __APPLE__
-		     st.trunc, (st.trunc == 1) ? "record" : "records");
+		     s.trunc, (s.trunc == 1) ? "record" : "records");
 #else
-		     st.trunc, (st.trunc == 1) ? "block" : "blocks");
+		     s.trunc, (s.trunc == 1) ? "block" : "blocks");
 #endif
 	if (!(ddflags & C_NOXFER)) {
 		(void)fprintf(stderr,
 		    "%ju bytes transferred in %.6f secs (%.0f bytes/sec)\n",
-		    st.bytes, secs, st.bytes / secs);
+		    s.bytes, secs, s.bytes / secs);
 	}
+	tee_summary();
+	hash_summary();
 	need_summary = 0;
 }
 
@@ -123,16 +232,23 @@ progress(void)
 	char persec[4 + 1 + 2 + 1];	/* 123 <space> <suffix> NUL */
 	char *buf;
 	double secs;
+	STAT s;
 
+	if (ddflags & C_JSON) {
+		json_status("progress");
+		need_progress = 0;
+		return;
+	}
+	stat_copy(&s);
 	secs = secs_elapsed();
-	humanize_number(si, sizeof(si), (int64_t)st.bytes, "B", HN_AUTOSCALE,
+	humanize_number(si, sizeof(si), (int64_t)s.bytes, "B", HN_AUTOSCALE,
 	    HN_DECIMAL | HN_DIVISOR_1000);
-	humanize_number(iec, sizeof(iec), (int64_t)st.bytes, "B", HN_AUTOSCALE,
+	humanize_number(iec, sizeof(iec), (int64_t)s.bytes, "B", HN_AUTOSCALE,
 	    HN_DECIMAL | HN_IEC_PREFIXES);
-	humanize_number(persec, sizeof(persec), (int64_t)(st.bytes / secs), "B",
+	humanize_number(persec, sizeof(persec), (int64_t)(s.bytes / secs), "B",
 	    HN_AUTOSCALE, HN_DECIMAL | HN_DIVISOR_1000);
 	asprintf(&buf, "  %'ju bytes (%s, %s) transferred %.3fs, %s/s",
-	    (uintmax_t)st.bytes, si, iec, secs, persec);
+	    (uintmax_t)s.bytes, si, iec, secs, persec);
 	outlen = fprintf(stderr, "%-*s\r", outlen, buf) - 1;
 	fflush(stderr);
 	free(buf);
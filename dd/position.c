@@ -161,7 +161,7 @@ pos_in(void)
 }
 
 void
-pos_out(void)
+pos_out(IO *io)
 {
 #ifndef __APPLE__
 	struct mtop t_op;
@@ -174,38 +174,38 @@ pos_out(void)
 	 * going to fail, but don't protect the user -- they shouldn't
 	 * have specified the seek operand.
 	 */
-	if (out.flags & (ISSEEK | ISPIPE)) {
+	if (io->flags & (ISSEEK | ISPIPE)) {
 		errno = 0;
-		if (lseek(out.fd, seek_offset(&out), SEEK_CUR) == -1 &&
+		if (lseek(io->fd, seek_offset(io), SEEK_CUR) == -1 &&
 		    errno != 0)
-			err(1, "%s", out.name);
+			err(1, "%s", io->name);
 		return;
 	}
 
 	/* Don't try to read a really weird amount (like negative). */
-	if (out.offset < 0)
+	if (io->offset < 0)
 		errx(1, "%s: illegal offset", "oseek/seek");
 
 #ifndef __APPLE__
 	/* If no read access, try using mtio. */
-	if (out.flags & NOREAD) {
+	if (io->flags & NOREAD) {
 		t_op.mt_op = MTFSR;
-		t_op.mt_count = out.offset;
+		t_op.mt_count = io->offset;
 
-		if (ioctl(out.fd, MTIOCTOP, &t_op) == -1)
-			err(1, "%s", out.name);
+		if (ioctl(io->fd, MTIOCTOP, &t_op) == -1)
+			err(1, "%s", io->name);
 		return;
 	}
 #endif
 
 	/* Read it. */
-	for (cnt = 0; cnt < out.offset; ++cnt) {
+	for (cnt = 0; cnt < io->offset; ++cnt) {
 		check_terminate();
-		if ((n = read(out.fd, out.db, out.dbsz)) > 0)
+		if ((n = read(io->fd, io->db, io->dbsz)) > 0)
 			continue;
 		check_terminate();
 		if (n == -1)
-			err(1, "%s", out.name);
+			err(1, "%s", io->name);
 
 #ifndef __APPLE__
 		/*
@@ -215,18 +215,18 @@ pos_out(void)
 		 */
 		t_op.mt_op = MTBSR;
 		t_op.mt_count = 1;
-		if (ioctl(out.fd, MTIOCTOP, &t_op) == -1)
-			err(1, "%s", out.name);
+		if (ioctl(io->fd, MTIOCTOP, &t_op) == -1)
+			err(1, "%s", io->name);
 #endif
 
-		while (cnt++ < out.offset) {
+		while (cnt++ < io->offset) {
 			check_terminate();
-			n = write(out.fd, out.db, out.dbsz);
+			n = write(io->fd, io->db, io->dbsz);
 			check_terminate();
 			if (n == -1)
-				err(1, "%s", out.name);
-			if (n != out.dbsz)
-				errx(1, "%s: write failure", out.name);
+				err(1, "%s", io->name);
+			if (n != io->dbsz)
+				errx(1, "%s: write failure", io->name);
 		}
 		break;
 	}
@@ -0,0 +1,235 @@
+/*
+* Copyright (c) 2026 Apple Inc. All rights reserved.
+*
+* @APPLE_LICENSE_HEADER_START@
+*
+* This file contains Original Code and/or Modifications of Original Code
+* as defined in and that are subject to the Apple Public Source License
+* Version 2.0 (the 'License'). You may not use this file except in
+* compliance with the License. Please obtain a copy of the License at
+* http://www.opensource.apple.com/apsl/ and read it before using this
+* file.
+*
+* The Original Code and all software distributed under the License are
+* distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+* EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+* INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+* Please see the License for the specific language governing rights and
+* limitations under the License.
+*
+* @APPLE_LICENSE_HEADER_END@
+*/
+
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#ifdef __linux__
+#include <linux/falloc.h>
+#endif
+
+#include "dd.h"
+#include "extern.h"
+
+/*
+ * conv=sparse.  Each output block is scanned a file system block at a
+ * time; runs of zero blocks are seeked over instead of written, so a
+ * mostly-empty block still leaves holes.  Where the output file already
+ * had data (conv=notrunc), the skipped range is deallocated as well, or
+ * written as zeros if the file system can't do that.
+ */
+static off_t	pending;	/* pending seek if sparse */
+static size_t	granule;	/* size of the runs checked for zeros */
+static off_t	oldsize;	/* size of the output before dd began */
+static u_char	*zeros;
+
+/*
+ * Return whether the len bytes at p are all zero.
+ */
+static int
+iszero(const u_char *p, size_t len)
+{
+	uint64_t w;
+
+#if defined(__SSE2__)
+	__m128i v;
+
+	for (; len >= 64; len -= 64, p += 64) {
+		v = _mm_or_si128(
+		    _mm_or_si128(_mm_loadu_si128((const __m128i *)p),
+		    _mm_loadu_si128((const __m128i *)(p + 16))),
+		    _mm_or_si128(_mm_loadu_si128((const __m128i *)(p + 32)),
+		    _mm_loadu_si128((const __m128i *)(p + 48))));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(v,
+		    _mm_setzero_si128())) != 0xffff)
+			return (0);
+	}
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	uint8x16_t v;
+
+	for (; len >= 64; len -= 64, p += 64) {
+		v = vorrq_u8(vorrq_u8(vld1q_u8(p), vld1q_u8(p + 16)),
+		    vorrq_u8(vld1q_u8(p + 32), vld1q_u8(p + 48)));
+		if (vmaxvq_u8(v) != 0)
+			return (0);
+	}
+#endif
+	for (; len >= sizeof(w); len -= sizeof(w), p += sizeof(w)) {
+		memcpy(&w, p, sizeof(w));
+		if (w != 0)
+			return (0);
+	}
+	for (; len != 0; len--, p++)
+		if (*p != 0)
+			return (0);
+	return (1);
+}
+
+void
+sparse_setup(void)
+{
+	struct stat sb;
+
+	/*
+	 * Holes can only be made a file system block at a time, so there is
+	 * no point in looking at smaller runs.
+	 */
+	granule = out.dbsz;
+	oldsize = 0;
+	if (fstat(out.fd, &sb) == 0) {
+		if (sb.st_blksize > 0 && (size_t)sb.st_blksize < granule &&
+		    out.dbsz % sb.st_blksize == 0)
+			granule = sb.st_blksize;
+		if (S_ISREG(sb.st_mode))
+			oldsize = sb.st_size;
+	}
+	if (oldsize > 0 && (zeros = calloc(1, granule)) == NULL)
+		err(1, "sparse buffer");
+}
+
+static int
+punch(off_t off, off_t len)
+{
+#if defined(F_PUNCHHOLE)
+	struct fpunchhole fp;
+
+	memset(&fp, 0, sizeof(fp));
+	fp.fp_offset = off;
+	fp.fp_length = len;
+	return (fcntl(out.fd, F_PUNCHHOLE, &fp));
+#elif defined(SPACECTL_DEALLOC)
+	struct spacectl_range sr;
+
+	sr.r_offset = off;
+	sr.r_len = len;
+	return (fspacectl(out.fd, SPACECTL_DEALLOC, &sr, 0, NULL));
+#elif defined(FALLOC_FL_PUNCH_HOLE)
+	return (fallocate(out.fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+	    off, len));
+#else
+	(void)off;
+	(void)len;
+	errno = EOPNOTSUPP;
+	return (-1);
+#endif
+}
+
+/*
+ * Move the output offset past a hole of len bytes.  Note that we need to
+ * record the reached offset, because we might have no more data to write,
+ * in which case we'll need to call ftruncate to extend the file size.
+ */
+void
+out_hole(off_t len)
+{
+	off_t pos, n;
+	ssize_t nw;
+
+	if (oldsize > 0 && (pos = lseek(out.fd, 0, SEEK_CUR)) < oldsize &&
+	    pos != -1 && punch(pos, MIN(len, oldsize - pos)) == -1) {
+		/* Overwrite the old data the hard way. */
+		for (n = MIN(len, oldsize - pos); n > 0; n -= nw, len -= nw) {
+			nw = write(out.fd, zeros, (size_t)MIN(n, (off_t)granule));
+			if (nw <= 0) {
+				if (nw == 0)
+					errx(1, "%s: end of device", out.name);
+				if (errno != EINTR)
+					err(1, "%s", out.name);
+				nw = 0;
+			}
+			/* As in out_write(). */
+			if (!(ddflags & C_OASYNC))
+				check_terminate();
+		}
+	}
+	out.seek_offset = lseek(out.fd, len, SEEK_CUR);
+	if (out.seek_offset == -1)
+		err(2, "%s: seek error creating sparse file", out.name);
+}
+
+/*
+ * Write the p, n byte output block as runs of data and holes.  If force,
+ * the block is the last one and its final run is always written.
+ */
+void
+sparse_out(const u_char *p, size_t n, int force)
+{
+	size_t off, len, run;
+	int zero;
+
+	for (off = 0; off < n; off += run) {
+		len = MIN(granule, n - off);
+		zero = iszero(p + off, len) && !(force && off + len == n);
+		for (run = len; off + run < n; run += len) {
+			len = MIN(granule, n - off - run);
+			if (iszero(p + off + run, len) != zero ||
+			    (zero && force && off + run + len == n))
+				break;
+		}
+		if (ddflags & C_OASYNC) {
+			/* The writer thread accounts for the bytes. */
+			async_write(zero ? NULL : p + off, run, 0);
+		} else if (zero) {
+			pending += run;
+			out_count(run, run, 0);
+		} else {
+			if (pending != 0) {
+				out_hole(pending);
+				pending = 0;
+			}
+			check_terminate();
+			out_write(p + off, run, 0);
+			check_terminate();
+		}
+	}
+
+	if (n == (size_t)out.dbsz)
+		++st.out_full;
+	else
+		++st.out_part;
+}
+
+/*
+ * Seek past any hole at the end of the output.
+ */
+void
+sparse_finish(void)
+{
+
+	if (pending != 0) {
+		out_hole(pending);
+		pending = 0;
+	}
+}
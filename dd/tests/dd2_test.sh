@@ -88,10 +88,191 @@ sigint_read_body()
 	atf_check test -s stderr
 }
 
+atf_test_case sigint_write
+sigint_write_head()
+{
+	atf_set "descr" "SIGINT while writing destination"
+}
+sigint_write_body()
+{
+	atf_check mkfifo fifo
+	(sleep 30 <fifo &) # a reader that never reads, so that dd blocks
+	set -m
+	dd if=/dev/zero of=fifo bs=1m count=5 2>stderr &
+	pid=$!
+	sleep 3
+	kill -INT $pid
+	wait $pid
+	rv=$?
+	atf_check test "$rv" -gt 128
+	atf_check -o inline:"INT\n" kill -l $((rv-128))
+	atf_check test -s stderr
+}
+
+atf_test_case async
+async_head()
+{
+	atf_set "descr" "iflag=async and oflag=async produce the same output"
+}
+async_body()
+{
+	atf_check -e ignore dd if=/dev/random of=f.data bs=64k count=40
+	atf_check -e ignore dd if=/dev/zero of=f.data bs=64k count=20 \
+	    seek=10 conv=notrunc
+	for flags in "iflag=async" "oflag=async" "iflag=async oflag=async"; do
+		atf_check -e save:plain dd if=f.data of=f.plain \
+		    ibs=10000 obs=4096 conv=sparse
+		atf_check -e save:async dd if=f.data of=f.async \
+		    ibs=10000 obs=4096 conv=sparse $flags
+		atf_check cmp f.plain f.async
+		atf_check -o save:records.plain head -2 plain
+		atf_check -o file:records.plain head -2 async
+		atf_check -o ignore -e ignore sh -c \
+		    "dd if=f.data bs=7k count=5 $flags | cmp -n 35840 - f.data"
+	done
+}
+
+atf_test_case hash
+hash_head()
+{
+	atf_set "descr" "ihash= and ohash= digest the data as it is copied"
+}
+hash_body()
+{
+	sha256=15e2b0d3c33891ebb0f1ef609ec419420c20e320ce94c65fbc8c3312448eb225
+
+	printf 123456789 >f.in
+	printf "CRC32C (f.in) = e3069283\nXXH64 (f.out) = 8cb841db40e6ae83\n" \
+	    >expected
+	atf_check -e file:expected dd if=f.in of=f.out ibs=4 obs=3 \
+	    ihash=crc32c ohash=xxh64 status=none
+	atf_check -e match:"^SHA256 \(f.in\) = $sha256$" \
+	    dd if=f.in of=f.out ihash=sha256
+	# ohash= is computed after conversion.
+	printf abc >f.lc
+	printf ABC >f.uc
+	atf_check -e save:lc dd if=f.lc of=f.out conv=ucase ohash=sha256 \
+	    status=none
+	atf_check -e save:uc dd if=f.uc ihash=sha256 status=none of=/dev/null
+	atf_check -o save:lc.sum cut -d= -f2 lc
+	atf_check -o file:lc.sum cut -d= -f2 uc
+	atf_check -s not-exit:0 -e match:"unknown hash" \
+	    dd if=f.in of=f.out ihash=md4
+}
+
+atf_test_case sparse
+sparse_head()
+{
+	atf_set "descr" "conv=sparse leaves holes within large blocks"
+}
+sparse_body()
+{
+	# 1 MiB of data, then 3 MiB of zeros, all in one 4 MiB block.
+	atf_check -e ignore dd if=/dev/random of=f.data bs=1m count=1
+	atf_check -e ignore dd if=/dev/zero of=f.data bs=1m count=3 \
+	    seek=1 conv=notrunc
+	atf_check -e ignore dd if=f.data of=f.out bs=4m conv=sparse
+	atf_check cmp f.data f.out
+	atf_check test $(stat -f %b f.out) -lt 4096
+
+	# Old data under the holes must not show through.
+	atf_check -e ignore dd if=/dev/random of=f.old bs=1m count=5
+	atf_check -e ignore dd if=f.data of=f.old bs=4m conv=sparse,notrunc
+	atf_check cmp -n 4194304 f.data f.old
+	atf_check -o inline:"5242880\n" stat -f %z f.old
+}
+
+atf_test_case conv
+conv_head()
+{
+	atf_set "descr" "Table conversions and swab on buffers of all lengths"
+}
+conv_body()
+{
+	atf_check -e ignore dd if=/dev/random of=f.data bs=1000 count=100
+	for ibs in 1 63 64 65 1000 4096; do
+		atf_check -e ignore dd if=f.data of=f.ebcdic conv=ebcdic \
+		    ibs=$ibs
+		atf_check -e ignore dd if=f.ebcdic of=f.ascii conv=ascii \
+		    ibs=$ibs
+		atf_check cmp f.data f.ascii
+
+		atf_check -e ignore dd if=f.data of=f.swab conv=swab ibs=$ibs
+		atf_check -e ignore dd if=f.swab of=f.swab2 conv=swab ibs=$ibs
+		atf_check cmp f.data f.swab2
+	done
+
+	jot -b "Lorem ipsum dolor sit amet, consectetur adipiscing elit" \
+	    1000 >f.text
+	tr a-z A-Z <f.text >f.upper
+	atf_check -e ignore dd if=f.text of=f.out conv=ucase
+	atf_check cmp f.upper f.out
+	atf_check -o inline:"badcfeg\n" -e ignore sh -c \
+	    "printf abcdefg | dd conv=swab; echo"
+	atf_check -e ignore dd if=f.text of=f.block conv=block,ebcdic cbs=80
+	atf_check -e ignore dd if=f.block of=f.out conv=unblock,ascii cbs=80
+	atf_check cmp f.text f.out
+}
+
+atf_test_case multiple_of
+multiple_of_head()
+{
+	atf_set "descr" "repeated of= writes the same data to every output"
+}
+multiple_of_body()
+{
+	atf_check -e ignore dd if=/dev/random of=f.in bs=64k count=20
+	atf_check -e save:stderr dd if=f.in of=f.out1 of=f.out2 of=f.out3 \
+	    bs=48k
+	atf_check cmp f.in f.out1
+	atf_check cmp f.in f.out2
+	atf_check cmp f.in f.out3
+	atf_check -o inline:"f.out2: 26+1 records out, 1310720 bytes\n" \
+	    grep ^f.out2: stderr
+	atf_check -e ignore dd if=f.in of=f.out1 of=f.out2 bs=4k seek=1 \
+	    conv=notrunc
+	atf_check -o inline:"1314816\n" stat -f %z f.out2
+	atf_check -s not-exit:0 -e match:"not supported with several outputs" \
+	    dd if=f.in of=f.out1 of=f.out2 conv=sparse
+	# An output that fails is reported; the others still get everything.
+	atf_check -s exit:1 -e save:stderr -x "trap '' XFSZ; ulimit -f 64; \
+	    dd if=f.in of=/dev/null of=f.out3 bs=64k"
+	atf_check -o match:"^f.out3: .*, File too large" grep ^f.out3: stderr
+	atf_check -o inline:"/dev/null: 20+0 records out, 1310720 bytes\n" \
+	    grep ^/dev/null: stderr
+}
+
+atf_test_case status_json
+status_json_head()
+{
+	atf_set "descr" "status=json reports counts and latencies as JSON"
+}
+status_json_body()
+{
+	atf_check -e ignore dd if=/dev/zero of=f.in bs=4k count=10
+	atf_check -e save:json dd if=f.in of=f.out bs=4k status=json \
+	    ohash=crc32c
+	atf_check -o inline:"1\n" grep -c . json
+	atf_check -o ignore grep '^{"type":"summary",' json
+	atf_check -o ignore grep '"bytes":40960,"in_full":10,"in_part":0,' json
+	atf_check -o ignore grep '"read":{"calls":11,' json
+	atf_check -o ignore grep '"write":{"calls":10,' json
+	atf_check -o ignore grep '"ohash":{"algorithm":"crc32c","digest":"[0-9a-f]*"}}$' json
+	atf_check -s not-exit:0 -e match:"interval must be" \
+	    dd if=f.in of=f.out interval=0
+}
+
 atf_init_test_cases()
 {
 	atf_add_test_case max_seek
+	atf_add_test_case async
+	atf_add_test_case conv
+	atf_add_test_case hash
+	atf_add_test_case multiple_of
+	atf_add_test_case sparse
+	atf_add_test_case status_json
 	atf_add_test_case seek_overflow
 	atf_add_test_case sigint_open
 	atf_add_test_case sigint_read
+	atf_add_test_case sigint_write
 }
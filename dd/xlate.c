@@ -0,0 +1,180 @@
+/*
+* Copyright (c) 2026 Apple Inc. All rights reserved.
+*
+* @APPLE_LICENSE_HEADER_START@
+*
+* This file contains Original Code and/or Modifications of Original Code
+* as defined in and that are subject to the Apple Public Source License
+* Version 2.0 (the 'License'). You may not use this file except in
+* compliance with the License. Please obtain a copy of the License at
+* http://www.opensource.apple.com/apsl/ and read it before using this
+* file.
+*
+* The Original Code and all software distributed under the License are
+* distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+* EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+* INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+* Please see the License for the specific language governing rights and
+* limitations under the License.
+*
+* @APPLE_LICENSE_HEADER_END@
+*/
+
+#include <sys/param.h>
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#endif
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "dd.h"
+#include "extern.h"
+
+/*
+ * Table translation (conv=ascii, ebcdic, ibm, lcase, ucase and the parity
+ * conversions) and conv=swab, a vector at a time.
+ *
+ * A 256-entry table fits in four 64-byte vectors.  With AVX-512 VBMI,
+ * vpermi2b looks up 64 bytes at a time in each half of the table and bit
+ * 7 of the input picks the half.  On arm64, each tbl covers a 64-byte
+ * quarter of the table.  Elsewhere the table is walked four bytes at a
+ * time: splitting it into 16-byte rows for pshufb needs a shuffle per row
+ * per vector, which is slower than the scalar loop.
+ */
+#if defined(__x86_64__)
+#define	XLATE_VBMI
+static pthread_once_t xlate_once = PTHREAD_ONCE_INIT;
+static int xlate_have_vbmi;
+
+static void
+xlate_init(void)
+{
+#ifdef __APPLE__
+	size_t len;
+	int val;
+
+	/* The kernel enables AVX-512 state on first use. */
+	len = sizeof(val);
+	if (sysctlbyname("hw.optional.avx512vbmi", &val, &len, NULL, 0) == 0)
+		xlate_have_vbmi = val;
+#else
+	xlate_have_vbmi = __builtin_cpu_supports("avx512vbmi") &&
+	    __builtin_cpu_supports("avx512bw");
+#endif
+}
+
+__attribute__((target("avx512vbmi,avx512bw")))
+static size_t
+xlate_vbmi(u_char *p, size_t len, const u_char *t)
+{
+	__m512i t0, t1, t2, t3, v, lo, hi;
+	size_t done;
+
+	t0 = _mm512_loadu_si512(t);
+	t1 = _mm512_loadu_si512(t + 64);
+	t2 = _mm512_loadu_si512(t + 128);
+	t3 = _mm512_loadu_si512(t + 192);
+	for (done = 0; len - done >= 64; done += 64, p += 64) {
+		v = _mm512_loadu_si512(p);
+		lo = _mm512_permutex2var_epi8(t0, v, t1);
+		hi = _mm512_permutex2var_epi8(t2, v, t3);
+		_mm512_storeu_si512(p,
+		    _mm512_mask_blend_epi8(_mm512_movepi8_mask(v), lo, hi));
+	}
+	return (done);
+}
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define	XLATE_NEON
+
+static size_t
+xlate_neon(u_char *p, size_t len, const u_char *t)
+{
+	uint8x16x4_t q0, q1, q2, q3;
+	uint8x16_t v, r, k64;
+	size_t done;
+
+	q0 = vld1q_u8_x4(t);
+	q1 = vld1q_u8_x4(t + 64);
+	q2 = vld1q_u8_x4(t + 128);
+	q3 = vld1q_u8_x4(t + 192);
+	k64 = vdupq_n_u8(64);
+	for (done = 0; len - done >= 16; done += 16, p += 16) {
+		/* Out-of-range indices look up as 0. */
+		v = vld1q_u8(p);
+		r = vqtbl4q_u8(q0, v);
+		v = vsubq_u8(v, k64);
+		r = vorrq_u8(r, vqtbl4q_u8(q1, v));
+		v = vsubq_u8(v, k64);
+		r = vorrq_u8(r, vqtbl4q_u8(q2, v));
+		v = vsubq_u8(v, k64);
+		r = vorrq_u8(r, vqtbl4q_u8(q3, v));
+		vst1q_u8(p, r);
+	}
+	return (done);
+}
+#endif
+
+/*
+ * Replace each of the len bytes at p with its entry in the table t.
+ */
+void
+xlate(u_char *p, size_t len, const u_char *t)
+{
+	size_t done;
+
+	done = 0;
+#if defined(XLATE_VBMI)
+	(void)pthread_once(&xlate_once, xlate_init);
+	if (xlate_have_vbmi)
+		done = xlate_vbmi(p, len, t);
+#elif defined(XLATE_NEON)
+	done = xlate_neon(p, len, t);
+#endif
+	for (p += done, len -= done; len >= 4; len -= 4, p += 4) {
+		p[0] = t[p[0]];
+		p[1] = t[p[1]];
+		p[2] = t[p[2]];
+		p[3] = t[p[3]];
+	}
+	for (; len != 0; len--, p++)
+		*p = t[*p];
+}
+
+/*
+ * Swap each pair of bytes in the len bytes at v; an odd byte at the end
+ * is left alone.
+ */
+void
+swapbytes(void *v, size_t len)
+{
+	unsigned char *p = v;
+	unsigned char t;
+
+#if defined(__x86_64__)
+	__m128i w;
+
+	for (; len >= 16; len -= 16, p += 16) {
+		w = _mm_loadu_si128((const __m128i *)p);
+		w = _mm_or_si128(_mm_slli_epi16(w, 8), _mm_srli_epi16(w, 8));
+		_mm_storeu_si128((__m128i *)p, w);
+	}
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	for (; len >= 16; len -= 16, p += 16)
+		vst1q_u8(p, vrev16q_u8(vld1q_u8(p)));
+#endif
+	while (len > 1) {
+		t = p[0];
+		p[0] = p[1];
+		p[1] = t;
+		p += 2;
+		len -= 2;
+	}
+}
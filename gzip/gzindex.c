@@ -0,0 +1,461 @@
+/*
+* Copyright (c) 2026 Apple Inc. All rights reserved.
+*
+* @APPLE_LICENSE_HEADER_START@
+*
+* This file contains Original Code and/or Modifications of Original Code
+* as defined in and that are subject to the Apple Public Source License
+* Version 2.0 (the 'License'). You may not use this file except in
+* compliance with the License. Please obtain a copy of the License at
+* http://www.opensource.apple.com/apsl/ and read it before using this
+* file.
+*
+* The Original Code and all software distributed under the License are
+* distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+* EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+* INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+* Please see the License for the specific language governing rights and
+* limitations under the License.
+*
+* @APPLE_LICENSE_HEADER_END@
+*/
+
+/*
+ * Random access to gzip files, after zlib's examples/zran.c.  --index
+ * inflates a file, checking it as -t does, and every index_span bytes of
+ * output records an access point: the position of a deflate block
+ * boundary in both streams, together with the 32 KiB of output before it,
+ * which is all inflate needs to carry on from there.  The points are kept
+ * in a file named after the gzip file with GZI_SUFFIX appended, and
+ * --range starts inflating at the last point before the requested range
+ * rather than at the start of the file.
+ *
+ * The index file holds the windows one after the other, then a table of
+ * GZI_ENTLEN byte entries and finally a GZI_TRAILERLEN byte trailer that
+ * identifies the gzip file it describes.  Numbers are little endian.
+ */
+#define	GZI_SUFFIX	".gzidx"
+#define	GZI_MAGIC	"GZIDX\0\0\1"
+#define	GZI_MAGICLEN	8
+#define	GZI_WINSIZE	(32 * 1024)
+#define	GZI_ENTLEN	32
+#define	GZI_TRAILERLEN	(40 + GZI_MAGICLEN)
+
+struct gzi_point {
+	off_t		out;		/* offset in the uncompressed data */
+	off_t		in;		/* offset of the next whole input byte */
+	off_t		winoff;		/* offset of the window in the index */
+	u_int		winlen;
+	int		bits;		/* bits of the byte before in still unread */
+};
+
+static int
+gzi_name(char *buf, size_t len, const char *filename)
+{
+
+	if ((size_t)snprintf(buf, len, "%s%s", filename, GZI_SUFFIX) >= len) {
+		maybe_warnx("%s: index name too long", filename);
+		return (-1);
+	}
+	return (0);
+}
+
+/* Refill z from in.  Returns the number of bytes read, -1 on error. */
+static ssize_t
+gzi_fill(int in, z_stream *z, u_char *buf, const char *filename)
+{
+	ssize_t in_size;
+
+	in_size = read(in, buf, BUFLEN);
+	if (in_size < 0) {
+		maybe_warn("failed to read %s", filename);
+		return (-1);
+	}
+	infile_newdata(in_size);
+	z->next_in = buf;
+	z->avail_in = in_size;
+	return (in_size);
+}
+
+/*
+ * Called at Z_STREAM_END: returns 1 if another member follows, 0 at the
+ * end of the input and -1 on error.
+ */
+static int
+gzi_next_member(int in, z_stream *z, u_char *buf, const char *filename)
+{
+	ssize_t in_size;
+
+	if (z->avail_in == 0 &&
+	    (in_size = gzi_fill(in, z, buf, filename)) <= 0)
+		return (in_size);
+	if (*z->next_in != GZIP_MAGIC0) {
+		maybe_warnx("%s: trailing garbage ignored", filename);
+		exit_value = 2;
+		return (0);
+	}
+	return (1);
+}
+
+static int
+gzi_zerror(z_stream *z, int error, const char *filename)
+{
+
+	switch (error) {
+	case Z_OK:
+	case Z_BUF_ERROR:
+	case Z_STREAM_END:
+		return (0);
+	case Z_MEM_ERROR:
+		maybe_warnx("memory allocation error");
+		break;
+	default:
+		maybe_warnx("%s: %s", filename,
+		    z->msg != NULL ? z->msg : "data stream error");
+		break;
+	}
+	return (-1);
+}
+
+/*
+ * Test the gzip file in and write an index for it.  Return the
+ * uncompressed size, -1 on error.
+ */
+static off_t
+gz_index(int in, const char *filename)
+{
+	struct stat sb;
+	z_stream z;
+	u_char *inbuf, *window, *table, *ent;
+	u_char trailer[GZI_TRAILERLEN];
+	char idxname[PATH_MAX];
+	off_t in_tot = 0, out_tot = 0, idx_tot = 0, last = 0;
+	size_t npoints = 0, left;
+	u_int winlen;
+	ssize_t in_size;
+	int fd, error;
+
+	if (gzi_name(idxname, sizeof idxname, filename) != 0)
+		return (-1);
+	if (fstat(in, &sb) != 0) {
+		maybe_warn("can't stat %s", filename);
+		return (-1);
+	}
+	if ((fd = open(idxname, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0) {
+		maybe_warn("can't open %s", idxname);
+		return (-1);
+	}
+	inbuf = malloc(BUFLEN);
+	window = malloc(GZI_WINSIZE);
+	table = NULL;
+	if (inbuf == NULL || window == NULL)
+		maybe_err("malloc failed");
+
+	memset(&z, 0, sizeof z);
+	if (inflateInit2(&z, MAX_WBITS + 16) != Z_OK) {
+		maybe_warnx("failed to inflateInit");
+		goto fail;
+	}
+	for (;;) {
+		check_siginfo();
+		if (z.avail_in == 0) {
+			if ((in_size = gzi_fill(in, &z, inbuf, filename)) < 0)
+				goto fail;
+			if (in_size == 0) {
+				maybe_warnx("%s: unexpected end of file",
+				    filename);
+				goto fail;
+			}
+		}
+		/* The output goes round the window, oldest byte first. */
+		if (z.avail_out == 0) {
+			z.next_out = window;
+			z.avail_out = GZI_WINSIZE;
+		}
+		in_tot += z.avail_in;
+		out_tot += z.avail_out;
+		error = inflate(&z, Z_BLOCK);
+		in_tot -= z.avail_in;
+		out_tot -= z.avail_out;
+		if (gzi_zerror(&z, error, filename) != 0)
+			goto fail;
+
+		if (error == Z_STREAM_END) {
+			if ((error = gzi_next_member(in, &z, inbuf,
+			    filename)) < 0)
+				goto fail;
+			if (error == 0)
+				break;
+			inflateReset(&z);
+			continue;
+		}
+
+		/*
+		 * Only a block boundary that isn't the end of a member will
+		 * do, as that is where a raw inflate can pick up.
+		 */
+		if ((z.data_type & 128) == 0 || (z.data_type & 64) != 0 ||
+		    (npoints != 0 && out_tot - last < index_span))
+			continue;
+		left = z.avail_out;
+		if (out_tot < GZI_WINSIZE) {
+			winlen = out_tot;
+			if (write_retry(fd, window, winlen) != (ssize_t)winlen)
+				goto wfail;
+		} else {
+			winlen = GZI_WINSIZE;
+			if (write_retry(fd, window + winlen - left, left) !=
+			    (ssize_t)left ||
+			    write_retry(fd, window, winlen - left) !=
+			    (ssize_t)(winlen - left))
+				goto wfail;
+		}
+
+		if ((ent = realloc(table, (npoints + 1) * GZI_ENTLEN)) == NULL)
+			maybe_err("malloc failed");
+		table = ent;
+		ent += npoints++ * GZI_ENTLEN;
+		memset(ent, 0, GZI_ENTLEN);
+		le64enc(ent, out_tot);
+		le64enc(ent + 8, in_tot);
+		le64enc(ent + 16, idx_tot);
+		le32enc(ent + 24, winlen);
+		ent[28] = z.data_type & 7;
+		idx_tot += winlen;
+		last = out_tot;
+	}
+
+	memset(trailer, 0, sizeof trailer);
+	le64enc(trailer, sb.st_size);
+	le64enc(trailer + 8, sb.st_mtime);
+	le64enc(trailer + 16, index_span);
+	le64enc(trailer + 24, idx_tot);
+	le64enc(trailer + 32, npoints);
+	memcpy(trailer + 40, GZI_MAGIC, GZI_MAGICLEN);
+	if (write_retry(fd, table, npoints * GZI_ENTLEN) !=
+	    (ssize_t)(npoints * GZI_ENTLEN) ||
+	    write_retry(fd, trailer, sizeof trailer) != sizeof trailer)
+		goto wfail;
+	if (close(fd) != 0) {
+		fd = -1;
+		goto wfail;
+	}
+	inflateEnd(&z);
+	free(table);
+	free(window);
+	free(inbuf);
+	return (out_tot);
+
+wfail:
+	maybe_warn("error writing to %s", idxname);
+fail:
+	inflateEnd(&z);
+	if (fd != -1)
+		close(fd);
+	unlink(idxname);
+	free(table);
+	free(window);
+	free(inbuf);
+	return (-1);
+}
+
+/*
+ * Find the last access point at or before uncompressed offset off in the
+ * index for in, and read its window.  Returns 0 if there is one.
+ */
+static int
+gzi_lookup(int in, const char *filename, off_t off, struct gzi_point *pt,
+    u_char *window)
+{
+	struct stat sb;
+	u_char trailer[GZI_TRAILERLEN], ent[GZI_ENTLEN];
+	char idxname[PATH_MAX];
+	off_t size, tableoff;
+	uint64_t lo, hi, mid, npoints;
+	int fd, found = -1;
+
+	if (gzi_name(idxname, sizeof idxname, filename) != 0)
+		return (-1);
+	if ((fd = open(idxname, O_RDONLY)) < 0)
+		return (-1);
+	if (fstat(in, &sb) != 0 || (size = lseek(fd, 0, SEEK_END)) < 0 ||
+	    size < GZI_TRAILERLEN ||
+	    pread(fd, trailer, sizeof trailer, size - GZI_TRAILERLEN) !=
+	    sizeof trailer ||
+	    memcmp(trailer + 40, GZI_MAGIC, GZI_MAGICLEN) != 0) {
+		if (qflag == 0)
+			warnx("%s: not an index, ignored", idxname);
+		goto out;
+	}
+	if (le64dec(trailer) != (uint64_t)sb.st_size ||
+	    le64dec(trailer + 8) != (uint64_t)sb.st_mtime) {
+		if (qflag == 0)
+			warnx("%s: out of date, ignored", idxname);
+		goto out;
+	}
+	tableoff = le64dec(trailer + 24);
+	npoints = le64dec(trailer + 32);
+	if (tableoff < 0 ||
+	    (uint64_t)(size - GZI_TRAILERLEN - tableoff) / GZI_ENTLEN != npoints) {
+		if (qflag == 0)
+			warnx("%s: corrupt index, ignored", idxname);
+		goto out;
+	}
+
+	/* Find the last point with pt->out <= off. */
+	for (lo = 0, hi = npoints; lo < hi;) {
+		mid = lo + (hi - lo) / 2;
+		if (pread(fd, ent, sizeof ent, tableoff + mid * GZI_ENTLEN) !=
+		    sizeof ent)
+			goto rfail;
+		if ((off_t)le64dec(ent) <= off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == 0)
+		goto out;
+	if (pread(fd, ent, sizeof ent, tableoff + (lo - 1) * GZI_ENTLEN) !=
+	    sizeof ent)
+		goto rfail;
+	pt->out = le64dec(ent);
+	pt->in = le64dec(ent + 8);
+	pt->winoff = le64dec(ent + 16);
+	pt->winlen = le32dec(ent + 24);
+	pt->bits = ent[28];
+	if (pt->winlen > GZI_WINSIZE || pt->bits > 7 ||
+	    pread(fd, window, pt->winlen, pt->winoff) != pt->winlen)
+		goto rfail;
+	found = 0;
+	goto out;
+
+rfail:
+	if (qflag == 0)
+		warnx("%s: can't read index, ignored", idxname);
+out:
+	close(fd);
+	return (found);
+}
+
+/*
+ * Write range_len bytes (or the rest, if range_len is -1) of the
+ * uncompressed data, starting at offset range_off, from in to out.
+ * Return bytes written, -1 on error.
+ */
+static off_t
+gz_range(int in, int out, const char *filename)
+{
+	struct gzi_point pt;
+	z_stream z;
+	u_char *inbuf, *outbuf, *window, *p;
+	off_t skip, left, out_tot = 0;
+	ssize_t in_size;
+	size_t wr;
+	u_int n, k;
+	int error, raw;
+	u_char c;
+
+	inbuf = malloc(BUFLEN);
+	outbuf = malloc(BUFLEN);
+	window = malloc(GZI_WINSIZE);
+	if (inbuf == NULL || outbuf == NULL || window == NULL)
+		maybe_err("malloc failed");
+
+	memset(&z, 0, sizeof z);
+	memset(&pt, 0, sizeof pt);
+	raw = gzi_lookup(in, filename, range_off, &pt, window) == 0;
+	if (inflateInit2(&z, raw ? -MAX_WBITS : MAX_WBITS + 16) != Z_OK) {
+		maybe_warnx("failed to inflateInit");
+		out_tot = -1;
+		goto out;
+	}
+	if (lseek(in, pt.in - (pt.bits != 0), SEEK_SET) < 0) {
+		maybe_warn("can't seek %s", filename);
+		goto fail;
+	}
+	if (pt.bits != 0) {
+		if (read(in, &c, 1) != 1)
+			goto eof;
+		inflatePrime(&z, pt.bits, c >> (8 - pt.bits));
+	}
+	if (pt.winlen != 0)
+		inflateSetDictionary(&z, window, pt.winlen);
+
+	skip = range_off - pt.out;
+	left = range_len;
+	while (left != 0) {
+		check_siginfo();
+		if (z.avail_in == 0) {
+			if ((in_size = gzi_fill(in, &z, inbuf, filename)) < 0)
+				goto fail;
+			if (in_size == 0)
+				goto eof;
+		}
+		z.next_out = outbuf;
+		z.avail_out = BUFLEN;
+		error = inflate(&z, Z_NO_FLUSH);
+		if (gzi_zerror(&z, error, filename) != 0)
+			goto fail;
+
+		p = outbuf;
+		wr = BUFLEN - z.avail_out;
+		if (skip > 0) {
+			if ((off_t)wr > skip) {
+				p += skip;
+				wr -= skip;
+				skip = 0;
+			} else {
+				skip -= wr;
+				wr = 0;
+			}
+		}
+		if (left > 0 && (off_t)wr > left)
+			wr = left;
+		if (wr != 0) {
+			if (write_retry(out, p, wr) != (ssize_t)wr) {
+				maybe_warn("error writing to output");
+				goto fail;
+			}
+			out_tot += wr;
+			if (left > 0)
+				left -= wr;
+		}
+
+		if (error != Z_STREAM_END)
+			continue;
+		if (raw) {
+			/* Step over the trailer inflate didn't know about. */
+			for (n = 8; n > 0; n -= k) {
+				if (z.avail_in == 0 && (in_size = gzi_fill(in,
+				    &z, inbuf, filename)) <= 0) {
+					if (in_size == 0)
+						goto eof;
+					goto fail;
+				}
+				k = MIN(n, z.avail_in);
+				z.next_in += k;
+				z.avail_in -= k;
+			}
+			inflateReset2(&z, MAX_WBITS + 16);
+			raw = 0;
+		} else
+			inflateReset(&z);
+		if ((error = gzi_next_member(in, &z, inbuf, filename)) < 0)
+			goto fail;
+		if (error == 0)
+			break;
+	}
+	goto out;
+
+eof:
+	maybe_warnx("%s: unexpected end of file", filename);
+fail:
+	out_tot = -1;
+out:
+	inflateEnd(&z);
+	free(window);
+	free(outbuf);
+	free(inbuf);
+	return (out_tot);
+}
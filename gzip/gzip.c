@@ -45,7 +45,6 @@ __FBSDID("$FreeBSD$");
  * RFC 1952 covers the gzip format
  *
  * TODO:
- *	- use mmap where possible
  *	- make bzip2/compress -v/-t/-l support work as well as possible
  */
 
@@ -53,10 +52,13 @@ __FBSDID("$FreeBSD$");
 #include <sys/endian.h>
 #endif
 #include <sys/param.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 
 #include <inttypes.h>
+#include <limits.h>
 #include <unistd.h>
 #ifdef __APPLE__
 #include <signal.h>
@@ -72,6 +74,7 @@ __FBSDID("$FreeBSD$");
 #include <libgen.h>
 #include <stdarg.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <time.h>
 
 #ifdef __APPLE__
@@ -94,6 +97,34 @@ le32dec(const void *pp)
 
 	return (((unsigned)p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0]);
 }
+
+static __inline uint64_t
+le64dec(const void *pp)
+{
+	uint8_t const *p = (uint8_t const *)pp;
+
+	return (((uint64_t)le32dec(p + 4) << 32) | le32dec(p));
+}
+
+static __inline void
+le32enc(void *pp, uint32_t u)
+{
+	uint8_t *p = (uint8_t *)pp;
+
+	p[0] = u & 0xff;
+	p[1] = (u >> 8) & 0xff;
+	p[2] = (u >> 16) & 0xff;
+	p[3] = (u >> 24) & 0xff;
+}
+
+static __inline void
+le64enc(void *pp, uint64_t u)
+{
+	uint8_t *p = (uint8_t *)pp;
+
+	le32enc(p, (uint32_t)(u & 0xffffffffU));
+	le32enc(p + 4, (uint32_t)(u >> 32));
+}
 #endif /* __APPLE__ */
 
 /* what type of file are we dealing with */
@@ -113,6 +144,12 @@ enum filetype {
 #endif
 #ifndef NO_LZ_SUPPORT
 	FT_LZ,
+#endif
+#ifndef NO_ZSTD_SUPPORT
+	FT_ZSTD,
+#endif
+#ifndef NO_LZ4_SUPPORT
+	FT_LZ4,
 #endif
 	FT_LAST,
 	FT_UNKNOWN
@@ -145,9 +182,23 @@ enum filetype {
 #define LZ_MAGIC	"LZIP"
 #endif
 
+#ifndef NO_ZSTD_SUPPORT
+#define ZSTD_SUFFIX	".zst"
+#define ZSTD_MAGIC	"\050\265\057\375"
+#endif
+
+#ifndef NO_LZ4_SUPPORT
+#define LZ4_SUFFIX	".lz4"
+#define LZ4_MAGIC	"\004\042\115\030"
+#endif
+
 #define GZ_SUFFIX	".gz"
 
 #define BUFLEN		(64 * 1024)
+#ifndef OUTBUFLEN
+#define OUTBUFLEN	(1024 * 1024)	/* gz_compress/gz_uncompress output */
+#endif
+#define MAPCHUNK	(1024 * 1024)	/* mapped input handed to zlib at once */
 
 #define GZIP_MAGIC0	0x1F
 #define GZIP_MAGIC1	0x8B
@@ -192,6 +243,13 @@ static suffixes_t suffixes[] = {
 #endif
 #ifndef NO_LZ_SUPPORT
 	SUFFIX(LZ_SUFFIX,	""),
+#endif
+#ifndef NO_ZSTD_SUPPORT
+	SUFFIX(ZSTD_SUFFIX,	""),
+	SUFFIX(".tzst",		".tar"),
+#endif
+#ifndef NO_LZ4_SUPPORT
+	SUFFIX(LZ4_SUFFIX,	""),
 #endif
 	SUFFIX(GZ_SUFFIX,	""),	/* Overwritten by -S "" */
 #endif /* SMALL */
@@ -237,27 +295,62 @@ static	int	cflag;			/* stdout mode */
 static	int	dflag;			/* decompress mode */
 static	int	lflag;			/* list mode */
 static	int	numflag = 6;		/* gzip -1..-9 value */
+static	int	numflag_set;		/* -1..-9 given */
 
-static	const char *remove_file = NULL;	/* file to be removed upon SIGINT */
+#ifndef SMALL
+#define	MAX_PROCESSES	256
+#else
+#define	MAX_PROCESSES	1
+#endif
+
+/* files to be removed upon SIGINT, one for each -r worker */
+static	const char *volatile remove_files[MAX_PROCESSES + 1];
+static	__thread int worker;		/* this thread's remove_files[] slot */
 
 static	int	fflag;			/* force mode */
 #ifndef SMALL
 static	int	kflag;			/* don't delete input files */
 static	int	nflag;			/* don't save name/timestamp */
 static	int	Nflag;			/* don't restore name/timestamp */
+static	int	pflag = 1;		/* (de)compression threads */
+static	int	Iflag;			/* write an index (--index) */
+static	int	Sflag;			/* -S gave the suffix */
+static	int	tpool;			/* -t files on the -p workers */
+#if !defined(NO_ZSTD_SUPPORT) || !defined(NO_LZ4_SUPPORT)
+static	enum filetype zformat = FT_GZIP; /* compress to (--zstd, --lz4) */
+#endif
+static	off_t	index_span = 1024 * 1024; /* bytes between access points */
+static	off_t	range_off = -1;		/* --range offset */
+static	off_t	range_len = -1;		/* --range length, -1 for the rest */
 static	int	qflag;			/* quiet mode */
 static	int	rflag;			/* recursive mode */
 static	int	tflag;			/* test */
 static	int	vflag;			/* verbose mode */
-static	sig_atomic_t print_info = 0;
+static	volatile sig_atomic_t print_info = 0; /* SIGINFOs received */
+static	__thread sig_atomic_t print_info_seen;
 #else
 #define		qflag	0
 #define		tflag	0
 #endif
 
-static	int	exit_value = 0;		/* exit value */
+/*
+ * The state of the file being worked on is kept per thread, so that the
+ * -r workers can each work on a file of their own.
+ */
+static	__thread int exit_value = 0;	/* exit value */
 
-static	const char *infile;		/* name of file coming in */
+static	__thread const char *infile;	/* name of file coming in */
+
+#ifndef SMALL
+static	__thread struct rjob *rjob;	/* the current -r job */
+static	__thread FILE *job_err;		/* stderr of the current -r job */
+static	__thread FILE *job_out;		/* stdout of the current -r job */
+#define	ERR_FP	(job_err != NULL ? job_err : stderr)
+#define	OUT_FP	(job_out != NULL ? job_out : stdout)
+#else
+#define	ERR_FP	stderr
+#define	OUT_FP	stdout
+#endif
 
 #ifdef __APPLE__
 static	bool	zcat;
@@ -270,11 +363,20 @@ static	void	maybe_errx(const char *fmt, ...) __printflike(1, 2) __dead2;
 #endif
 static	void	maybe_warn(const char *fmt, ...) __printflike(1, 2);
 static	void	maybe_warnx(const char *fmt, ...) __printflike(1, 2);
+static	void	maybe_vwarn(int, const char *, va_list) __printflike(2, 0);
 static	enum filetype file_gettype(u_char *);
 #ifdef SMALL
 #define gz_compress(if, of, sz, fn, tm) gz_compress(if, of, sz)
 #endif
 static	off_t	gz_compress(int, int, off_t *, const char *, uint32_t);
+#ifndef SMALL
+static	int	gz_mkheader(char *, size_t, const char *, uint32_t);
+static	off_t	gz_compress_mt(int, int, off_t *, const char *, uint32_t);
+static	off_t	gz_uncompress_mt(int, int, off_t, const char *);
+static	off_t	gz_index(int, const char *);
+static	off_t	gz_test(int, const char *);
+static	off_t	gz_range(int, int, const char *);
+#endif
 static	off_t	gz_uncompress(int, int, char *, size_t, off_t *, const char *);
 static	off_t	file_compress(char *, char *, size_t);
 static	off_t	file_uncompress(char *, char *, size_t);
@@ -284,6 +386,7 @@ static	void	handle_stdin(void);
 static	void	handle_stdout(void);
 static	void	print_ratio(off_t, off_t, FILE *);
 static	void	print_list(int fd, off_t, const char *, time_t);
+static	void	print_list_header(void);
 static	void	usage(void) __dead2;
 static	void	display_version(void) __dead2;
 #ifndef SMALL
@@ -292,6 +395,21 @@ static	void	display_license(void);
 static	const suffixes_t *check_suffix(char *, int);
 static	ssize_t	read_retry(int, void *, size_t);
 static	ssize_t	write_retry(int, const void *, size_t);
+static	ssize_t	writev_retry(int, struct iovec *, int);
+
+/* the rest of a regular input file, mapped by map_input() */
+struct mapped {
+	void	*base;
+	size_t	 len;
+	u_char	*p;		/* next byte to hand out */
+	u_char	*end;
+	int	 fd;
+	off_t	 off;		/* file offset of base */
+	volatile sig_atomic_t fault;	/* the file shrank under us */
+};
+static	int	map_input(int, struct mapped *);
+static	ssize_t	map_next(struct mapped *, u_char **);
+static	void	unmap_input(struct mapped *);
 static void	print_list_out(off_t, off_t, const char*);
 
 #ifdef SMALL
@@ -305,15 +423,17 @@ static	void	infile_set(const char *newinfile, off_t total);
 #define setup_signals() /* nothing */
 #define infile_newdata(t) /* nothing */
 #else
-static	off_t	infile_total;		/* total expected to read/write */
-static	off_t	infile_current;		/* current read/write */
+static	__thread off_t infile_total;	/* total expected to read/write */
+static	__thread off_t infile_current;	/* current read/write */
 
 static	void	check_siginfo(void);
 static	off_t	cat_fd(unsigned char *, size_t, off_t *, int fd);
 static	void	prepend_gzip(char *, int *, char ***);
 static	void	handle_dir(char *);
+static	void	rpool_add(const char *, const struct stat *);
+static	void	rpool_finish(void);
 static	void	print_verbage(const char *, const char *, off_t, off_t);
-static	void	print_test(const char *, int);
+static	void	print_test(const char *, int, off_t, double);
 static	void	copymodes(int fd, const struct stat *, const char *file);
 static	int	check_outfile(const char *outfile);
 static	void	setup_signals(void);
@@ -343,9 +463,32 @@ static	off_t	unxz_len(int);
 static	off_t	unlz(int, int, char *, size_t, off_t *);
 #endif
 
+#ifndef NO_ZSTD_SUPPORT
+static	off_t	unzstd(int, int, char *, size_t, off_t *);
+static	off_t	unzstd_len(int);
+#ifndef SMALL
+static	off_t	zstd_compress(int, int, off_t *);
+#endif
+#endif
+
+#ifndef NO_LZ4_SUPPORT
+static	off_t	unlz4(int, int, char *, size_t, off_t *);
+#ifndef SMALL
+static	off_t	lz4_compress(int, int, off_t *);
+#endif
+#endif
+
 #ifdef SMALL
 #define getopt_long(a,b,c,d,e) getopt(a,b,c)
 #else
+enum {
+	OPT_INDEX = CHAR_MAX + 1,
+	OPT_INDEX_SPAN,
+	OPT_RANGE,
+	OPT_ZSTD,
+	OPT_LZ4,
+};
+
 static const struct option longopts[] = {
 	{ "stdout",		no_argument,		0,	'c' },
 	{ "to-stdout",		no_argument,		0,	'c' },
@@ -357,6 +500,7 @@ static const struct option longopts[] = {
 	{ "list",		no_argument,		0,	'l' },
 	{ "no-name",		no_argument,		0,	'n' },
 	{ "name",		no_argument,		0,	'N' },
+	{ "processes",		required_argument,	0,	'p' },
 	{ "quiet",		no_argument,		0,	'q' },
 	{ "recursive",		no_argument,		0,	'r' },
 	{ "suffix",		required_argument,	0,	'S' },
@@ -367,6 +511,15 @@ static const struct option longopts[] = {
 	{ "best",		no_argument,		0,	'9' },
 	{ "ascii",		no_argument,		0,	'a' },
 	{ "license",		no_argument,		0,	'L' },
+	{ "index",		no_argument,		0,	OPT_INDEX },
+	{ "index-span",		required_argument,	0,	OPT_INDEX_SPAN },
+	{ "range",		required_argument,	0,	OPT_RANGE },
+#ifndef NO_ZSTD_SUPPORT
+	{ "zstd",		no_argument,		0,	OPT_ZSTD },
+#endif
+#ifndef NO_LZ4_SUPPORT
+	{ "lz4",		no_argument,		0,	OPT_LZ4 },
+#endif
 	{ NULL,			no_argument,		0,	0 },
 };
 #endif
@@ -378,6 +531,10 @@ main(int argc, char **argv)
 #ifndef SMALL
 	char *gzip;
 	int len;
+#endif
+#ifndef SMALL
+	const char *errstr;
+	char *ep;
 #endif
 	int ch;
 
@@ -407,7 +564,7 @@ main(int argc, char **argv)
 #ifdef SMALL
 #define OPT_LIST "123456789cdhlV"
 #else
-#define OPT_LIST "123456789acdfhklLNnqrS:tVv"
+#define OPT_LIST "123456789acdfhklLNnp:qrS:tVv"
 #endif
 
 	while ((ch = getopt_long(argc, argv, OPT_LIST, longopts, NULL)) != -1) {
@@ -416,6 +573,7 @@ main(int argc, char **argv)
 		case '4': case '5': case '6':
 		case '7': case '8': case '9':
 			numflag = ch - '0';
+			numflag_set = 1;
 			break;
 		case 'c':
 			cflag = 1;
@@ -451,6 +609,13 @@ main(int argc, char **argv)
 			nflag = 1;
 			Nflag = 0;
 			break;
+		case 'p':
+			pflag = (int)strtonum(optarg, 1, MAX_PROCESSES,
+			    &errstr);
+			if (errstr != NULL)
+				errx(1, "number of processes is %s: %s",
+				    errstr, optarg);
+			break;
 		case 'q':
 			qflag = 1;
 			break;
@@ -464,6 +629,9 @@ main(int argc, char **argv)
 					errx(1, "incorrect suffix: '%s': too long", optarg);
 				suffixes[0].zipped = optarg;
 				suffixes[0].ziplen = len;
+#ifndef SMALL
+				Sflag = 1;
+#endif
 			} else {
 				suffixes[NUM_SUFFIXES - 1].zipped = "";
 				suffixes[NUM_SUFFIXES - 1].ziplen = 0;
@@ -475,8 +643,44 @@ main(int argc, char **argv)
 			dflag = 1;
 			break;
 		case 'v':
-			vflag = 1;
+			vflag++;
+			break;
+		case OPT_INDEX:
+			Iflag = 1;
+			cflag = 1;
+			tflag = 1;
+			dflag = 1;
+			break;
+		case OPT_INDEX_SPAN:
+			index_span = strtonum(optarg, 1, 1024 * 1024, &errstr);
+			if (errstr != NULL)
+				errx(1, "index span is %s: %s", errstr, optarg);
+			index_span *= 1024 * 1024;
+			break;
+		case OPT_RANGE:
+			errno = 0;
+			range_len = -1;
+			range_off = strtoll(optarg, &ep, 10);
+			if (*ep == ':' && ep[1] != '\0')
+				range_len = strtoll(ep + 1, &ep, 10);
+			else if (*ep == ':')
+				ep++;
+			if (errno != 0 || *ep != '\0' || ep == optarg ||
+			    strchr(optarg, '-') != NULL)
+				errx(1, "invalid range: %s", optarg);
+			cflag = 1;
+			dflag = 1;
+			break;
+#ifndef NO_ZSTD_SUPPORT
+		case OPT_ZSTD:
+			zformat = FT_ZSTD;
+			break;
+#endif
+#ifndef NO_LZ4_SUPPORT
+		case OPT_LZ4:
+			zformat = FT_LZ4;
 			break;
+#endif
 #endif
 		default:
 			usage();
@@ -485,6 +689,25 @@ main(int argc, char **argv)
 	}
 	argv += optind;
 	argc -= optind;
+#ifndef SMALL
+	if (range_off != -1 && (tflag || lflag))
+		errx(1, "--range can't be used with --index, -l or -t");
+	/* Unless -S says otherwise, name the files after the format. */
+	if (!Sflag) {
+#ifndef NO_ZSTD_SUPPORT
+		if (zformat == FT_ZSTD) {
+			suffixes[0].zipped = ZSTD_SUFFIX;
+			suffixes[0].ziplen = sizeof(ZSTD_SUFFIX) - 1;
+		}
+#endif
+#ifndef NO_LZ4_SUPPORT
+		if (zformat == FT_LZ4) {
+			suffixes[0].zipped = LZ4_SUFFIX;
+			suffixes[0].ziplen = sizeof(LZ4_SUFFIX) - 1;
+		}
+#endif
+	}
+#endif
 
 	if (argc == 0) {
 		if (dflag)	/* stdin mode */
@@ -492,9 +715,16 @@ main(int argc, char **argv)
 		else		/* stdout mode */
 			handle_stdout();
 	} else {
+#ifndef SMALL
+		/* Nothing is written, so tests of separate files can overlap. */
+		tpool = tflag && pflag > 1 && argc > 1;
+#endif
 		do {
 			handle_pathname(argv[0]);
 		} while (*++argv);
+#ifndef SMALL
+		rpool_finish();
+#endif
 	}
 #ifndef SMALL
 	if (qflag == 0 && lflag && argc > 1)
@@ -507,6 +737,31 @@ main(int argc, char **argv)
 	exit(exit_value);
 }
 
+/*
+ * vwarn(3), or vwarnx(3) if !doerrno, into the current -r job's messages
+ * if there is one.
+ */
+static void
+maybe_vwarn(int doerrno, const char *fmt, va_list ap)
+{
+#ifndef SMALL
+	int serrno = errno;
+
+	if (job_err != NULL) {
+		fprintf(job_err, "%s: ", getprogname());
+		vfprintf(job_err, fmt, ap);
+		if (doerrno)
+			fprintf(job_err, ": %s", strerror(serrno));
+		fputc('\n', job_err);
+		return;
+	}
+#endif
+	if (doerrno)
+		vwarn(fmt, ap);
+	else
+		vwarnx(fmt, ap);
+}
+
 /* maybe print a warning */
 void
 maybe_warn(const char *fmt, ...)
@@ -515,7 +770,7 @@ maybe_warn(const char *fmt, ...)
 
 	if (qflag == 0) {
 		va_start(ap, fmt);
-		vwarn(fmt, ap);
+		maybe_vwarn(1, fmt, ap);
 		va_end(ap);
 	}
 	if (exit_value == 0)
@@ -530,7 +785,7 @@ maybe_warnx(const char *fmt, ...)
 
 	if (qflag == 0) {
 		va_start(ap, fmt);
-		vwarnx(fmt, ap);
+		maybe_vwarn(0, fmt, ap);
 		va_end(ap);
 	}
 	if (exit_value == 0)
@@ -634,12 +889,45 @@ copy_done:
 }
 #endif
 
+#ifndef SMALL
+/* build the gzip member header into buf. Return its length */
+static int
+gz_mkheader(char *buf, size_t len, const char *origname, uint32_t mtime)
+{
+	int i;
+
+	if (nflag != 0) {
+		mtime = 0;
+		origname = "";
+	}
+
+	i = snprintf(buf, len, "%c%c%c%c%c%c%c%c%c%c%s",
+		     GZIP_MAGIC0, GZIP_MAGIC1, Z_DEFLATED,
+		     *origname ? ORIG_NAME : 0,
+		     mtime & 0xff,
+		     (mtime >> 8) & 0xff,
+		     (mtime >> 16) & 0xff,
+		     (mtime >> 24) & 0xff,
+		     numflag == 1 ? 4 : numflag == 9 ? 2 : 0,
+		     OS_CODE, origname);
+	if ((size_t)i >= len)
+		/* this need PATH_MAX > BUFLEN ... */
+		maybe_err("snprintf");
+	if (*origname)
+		i++;
+	return (i);
+}
+#endif
+
 /* compress input to output. Return bytes read, -1 on error */
 static off_t
 gz_compress(int in, int out, off_t *gsizep, const char *origname, uint32_t mtime)
 {
 	z_stream z;
+	struct mapped m;
+	struct iovec iov[2];
 	char *outbufp, *inbufp;
+	u_char *inp, trailer[8];
 	off_t in_tot = 0, out_tot = 0;
 	ssize_t in_size;
 	int i, error;
@@ -648,14 +936,27 @@ gz_compress(int in, int out, off_t *gsizep, const char *origname, uint32_t mtime
 	static char header[] = { GZIP_MAGIC0, GZIP_MAGIC1, Z_DEFLATED, 0,
 				 0, 0, 0, 0,
 				 0, OS_CODE };
+#else
+#ifndef NO_ZSTD_SUPPORT
+	if (zformat == FT_ZSTD)
+		return zstd_compress(in, out, gsizep);
+#endif
+#ifndef NO_LZ4_SUPPORT
+	if (zformat == FT_LZ4)
+		return lz4_compress(in, out, gsizep);
+#endif
+	/* The -r workers already keep pflag threads busy. */
+	if (pflag > 1 && worker == 0)
+		return gz_compress_mt(in, out, gsizep, origname, mtime);
 #endif
 
-	outbufp = malloc(BUFLEN);
+	outbufp = malloc(OUTBUFLEN);
 	inbufp = malloc(BUFLEN);
 	if (outbufp == NULL || inbufp == NULL) {
 		maybe_err("malloc failed");
 		goto out;
 	}
+	map_input(in, &m);
 
 	memset(&z, 0, sizeof z);
 	z.zalloc = Z_NULL;
@@ -666,29 +967,11 @@ gz_compress(int in, int out, off_t *gsizep, const char *origname, uint32_t mtime
 	memcpy(outbufp, header, sizeof header);
 	i = sizeof header;
 #else
-	if (nflag != 0) {
-		mtime = 0;
-		origname = "";
-	}
-
-	i = snprintf(outbufp, BUFLEN, "%c%c%c%c%c%c%c%c%c%c%s",
-		     GZIP_MAGIC0, GZIP_MAGIC1, Z_DEFLATED,
-		     *origname ? ORIG_NAME : 0,
-		     mtime & 0xff,
-		     (mtime >> 8) & 0xff,
-		     (mtime >> 16) & 0xff,
-		     (mtime >> 24) & 0xff,
-		     numflag == 1 ? 4 : numflag == 9 ? 2 : 0,
-		     OS_CODE, origname);
-	if (i >= BUFLEN)
-		/* this need PATH_MAX > BUFLEN ... */
-		maybe_err("snprintf");
-	if (*origname)
-		i++;
+	i = gz_mkheader(outbufp, OUTBUFLEN, origname, mtime);
 #endif
 
 	z.next_out = (unsigned char *)outbufp + i;
-	z.avail_out = BUFLEN - i;
+	z.avail_out = OUTBUFLEN - i;
 
 	error = deflateInit2(&z, numflag, Z_DEFLATED,
 			     (-MAX_WBITS), 8, Z_DEFAULT_STRATEGY);
@@ -701,19 +984,22 @@ gz_compress(int in, int out, off_t *gsizep, const char *origname, uint32_t mtime
 	crc = crc32(0L, Z_NULL, 0);
 	for (;;) {
 		if (z.avail_out == 0) {
-			if (write_retry(out, outbufp, BUFLEN) != BUFLEN) {
+			if (write_retry(out, outbufp, OUTBUFLEN) != OUTBUFLEN) {
 				maybe_warn("write");
 				out_tot = -1;
 				goto out;
 			}
 
-			out_tot += BUFLEN;
+			out_tot += OUTBUFLEN;
 			z.next_out = (unsigned char *)outbufp;
-			z.avail_out = BUFLEN;
+			z.avail_out = OUTBUFLEN;
 		}
 
 		if (z.avail_in == 0) {
-			in_size = read(in, inbufp, BUFLEN);
+			if ((in_size = map_next(&m, &inp)) == 0) {
+				inp = (u_char *)inbufp;
+				in_size = read(in, inbufp, BUFLEN);
+			}
 			if (in_size < 0) {
 				maybe_warn("read");
 				in_tot = -1;
@@ -723,9 +1009,9 @@ gz_compress(int in, int out, off_t *gsizep, const char *origname, uint32_t mtime
 				break;
 			infile_newdata(in_size);
 
-			crc = crc32(crc, (const Bytef *)inbufp, (unsigned)in_size);
+			crc = crc32(crc, inp, (unsigned)in_size);
 			in_tot += in_size;
-			z.next_in = (unsigned char *)inbufp;
+			z.next_in = inp;
 			z.avail_in = in_size;
 		}
 
@@ -748,6 +1034,8 @@ gz_compress(int in, int out, off_t *gsizep, const char *origname, uint32_t mtime
 			in_tot = -1;
 			goto out;
 		}
+		if (error == Z_STREAM_END)
+			break;
 
 		len = (char *)z.next_out - outbufp;
 
@@ -759,10 +1047,7 @@ gz_compress(int in, int out, off_t *gsizep, const char *origname, uint32_t mtime
 		}
 		out_tot += len;
 		z.next_out = (unsigned char *)outbufp;
-		z.avail_out = BUFLEN;
-
-		if (error == Z_STREAM_END)
-			break;
+		z.avail_out = OUTBUFLEN;
 	}
 
 	if (deflateEnd(&z) != Z_OK) {
@@ -771,24 +1056,24 @@ gz_compress(int in, int out, off_t *gsizep, const char *origname, uint32_t mtime
 		goto out;
 	}
 
-	i = snprintf(outbufp, BUFLEN, "%c%c%c%c%c%c%c%c",
-		 (int)crc & 0xff,
-		 (int)(crc >> 8) & 0xff,
-		 (int)(crc >> 16) & 0xff,
-		 (int)(crc >> 24) & 0xff,
-		 (int)in_tot & 0xff,
-		 (int)(in_tot >> 8) & 0xff,
-		 (int)(in_tot >> 16) & 0xff,
-		 (int)(in_tot >> 24) & 0xff);
-	if (i != 8)
-		maybe_err("snprintf");
-	if (write_retry(out, outbufp, i) != i) {
+	/* The end of the stream and the trailer go out together. */
+	for (i = 0; i < 4; i++) {
+		trailer[i] = (crc >> (i * 8)) & 0xff;
+		trailer[i + 4] = (in_tot >> (i * 8)) & 0xff;
+	}
+	iov[0].iov_base = outbufp;
+	iov[0].iov_len = (char *)z.next_out - outbufp;
+	iov[1].iov_base = trailer;
+	iov[1].iov_len = sizeof trailer;
+	i = iov[0].iov_len + sizeof trailer;
+	if (writev_retry(out, iov, 2) != i) {
 		maybe_warn("write");
 		in_tot = -1;
 	} else
 		out_tot += i;
 
 out:
+	unmap_input(&m);
 	if (inbufp != NULL)
 		free(inbufp);
 	if (outbufp != NULL)
@@ -834,10 +1119,11 @@ gz_uncompress(int in, int out, char *pre, size_t prelen, off_t *gsizep,
 	uLong crc = 0;
 	ssize_t wr;
 	int needmore = 0;
+	struct mapped m;
 
 #define ADVANCE()       { z.next_in++; z.avail_in--; }
 
-	if ((outbufp = malloc(BUFLEN)) == NULL) {
+	if ((outbufp = malloc(OUTBUFLEN)) == NULL) {
 		maybe_err("malloc failed");
 		goto out2;
 	}
@@ -846,10 +1132,16 @@ gz_uncompress(int in, int out, char *pre, size_t prelen, off_t *gsizep,
 		goto out1;
 	}
 
+	/* What has been read already can't be joined up with a mapping. */
+	if (prelen == 0)
+		map_input(in, &m);
+	else
+		memset(&m, 0, sizeof m);
+
 	memset(&z, 0, sizeof z);
 	z.avail_in = prelen;
 	z.next_in = (unsigned char *)pre;
-	z.avail_out = BUFLEN;
+	z.avail_out = OUTBUFLEN;
 	z.next_out = (unsigned char *)outbufp;
 	z.zalloc = NULL;
 	z.zfree = NULL;
@@ -862,7 +1154,25 @@ gz_uncompress(int in, int out, char *pre, size_t prelen, off_t *gsizep,
 		check_siginfo();
 		if ((z.avail_in == 0 || needmore) && done_reading == 0) {
 			ssize_t in_size;
-
+			u_char *inp;
+
+			/*
+			 * The mapping is contiguous, so what is left over
+			 * just grows by the next piece of it.
+			 */
+			if ((in_size = map_next(&m, &inp)) > 0) {
+				if (z.avail_in == 0)
+					z.next_in = inp;
+				z.avail_in += in_size;
+				infile_newdata(in_size);
+				in_tot += in_size;
+				needmore = 0;
+				continue;
+			}
+			if (in_size < 0) {
+				maybe_warn("failed to read %s", filename);
+				goto stop_and_fail;
+			}
 			if (z.avail_in > 0) {
 				memmove(inbufp, z.next_in, z.avail_in);
 			}
@@ -1040,7 +1350,7 @@ gz_uncompress(int in, int out, char *pre, size_t prelen, off_t *gsizep,
 				maybe_warn("unknown error from inflate(): %d",
 				    error);
 			}
-			wr = BUFLEN - z.avail_out;
+			wr = OUTBUFLEN - z.avail_out;
 
 			if (wr != 0) {
 				crc = crc32(crc, (const Bytef *)outbufp, (unsigned)wr);
@@ -1064,7 +1374,7 @@ gz_uncompress(int in, int out, char *pre, size_t prelen, off_t *gsizep,
 			}
 
 			z.next_out = (unsigned char *)outbufp;
-			z.avail_out = BUFLEN;
+			z.avail_out = OUTBUFLEN;
 
 			break;
 		case GZSTATE_CRC:
@@ -1134,6 +1444,7 @@ stop:
 	}
 	if (state > GZSTATE_INIT)
 		inflateEnd(&z);
+	unmap_input(&m);
 
 	free(inbufp);
 out1:
@@ -1225,6 +1536,16 @@ file_gettype(u_char *buf)
 	if (memcmp(buf, LZ_MAGIC, 4) == 0)
 		return FT_LZ;
 	else
+#endif
+#ifndef NO_ZSTD_SUPPORT
+	if (memcmp(buf, ZSTD_MAGIC, 4) == 0)
+		return FT_ZSTD;
+	else
+#endif
+#ifndef NO_LZ4_SUPPORT
+	if (memcmp(buf, LZ4_MAGIC, 4) == 0)
+		return FT_LZ4;
+	else
 #endif
 		return FT_UNKNOWN;
 }
@@ -1241,8 +1562,12 @@ check_outfile(const char *outfile)
 		if (fflag)
 			unlink(outfile);
 		else if (isatty(STDIN_FILENO)) {
+			static pthread_mutex_t ask_mtx =
+			    PTHREAD_MUTEX_INITIALIZER;
 			char ans[10] = { 'n', '\0' };	/* default */
 
+			/* One question at a time from the -r workers. */
+			pthread_mutex_lock(&ask_mtx);
 			fprintf(stderr, "%s already exists -- do you wish to "
 					"overwrite (y or n)? " , outfile);
 			(void)fgets(ans, sizeof(ans) - 1, stdin);
@@ -1251,6 +1576,7 @@ check_outfile(const char *outfile)
 				ok = 0;
 			} else
 				unlink(outfile);
+			pthread_mutex_unlock(&ask_mtx);
 		} else {
 			maybe_warnx("%s already exists -- skipping", outfile);
 			ok = 0;
@@ -1283,9 +1609,11 @@ got_sigint(int signo)
 got_sigint(int signo __unused)
 #endif
 {
+	u_int i;
 
-	if (remove_file != NULL)
-		unlink(remove_file);
+	for (i = 0; i < nitems(remove_files); i++)
+		if (remove_files[i] != NULL)
+			unlink(remove_files[i]);
 #ifdef __APPLE__
 	/*
 	 * Re-raise the signal to get the exit status right for conformance
@@ -1302,7 +1630,7 @@ static void
 got_siginfo(int signo __unused)
 {
 
-	print_info = 1;
+	print_info++;
 }
 
 static void
@@ -1470,7 +1798,7 @@ file_compress(char *file, char *outfile, size_t outsize)
 			return (-1);
 		}
 #ifndef SMALL
-		remove_file = outfile;
+		remove_files[worker] = outfile;
 #endif
 	} else
 		out = STDOUT_FILENO;
@@ -1492,6 +1820,9 @@ file_compress(char *file, char *outfile, size_t outsize)
 		return in_size == -1 ? -1 : size;
 
 #ifndef SMALL
+	if (in_size == -1)
+		goto bad_outfile;
+
 	if (fstat(out, &osb) != 0) {
 		maybe_warn("couldn't stat: %s", outfile);
 		goto bad_outfile;
@@ -1508,7 +1839,7 @@ file_compress(char *file, char *outfile, size_t outsize)
 	clear_type_and_creator(out);
 #endif /* __APPLE__ */
 	copymodes(out, &isb, outfile);
-	remove_file = NULL;
+	remove_files[worker] = NULL;
 #endif
 #ifdef __APPLE__
 	(void)close(in);
@@ -1593,6 +1924,10 @@ file_uncompress(char *file, char *outfile, size_t outsize)
 		maybe_warnx("%s: not in gzip format", file);
 		goto lose;
 	}
+	if ((Iflag || range_off != -1) && method != FT_GZIP) {
+		maybe_warnx("%s: --index and --range need gzip files", file);
+		goto lose;
+	}
 
 #endif
 
@@ -1674,7 +2009,7 @@ file_uncompress(char *file, char *outfile, size_t outsize)
 			maybe_warn("can't open %s", outfile);
 			goto lose;
 		}
-		remove_file = outfile;
+		remove_files[worker] = outfile;
 	}
 
 	switch (method) {
@@ -1769,6 +2104,35 @@ file_uncompress(char *file, char *outfile, size_t outsize)
 		size = unlz(fd, zfd, NULL, 0, NULL);
 		break;
 #endif
+
+#ifndef NO_ZSTD_SUPPORT
+	case FT_ZSTD:
+		if (lflag) {
+			size = unzstd_len(fd);
+			print_list_out(in_size, size, file);
+			if (!tflag) {
+				close(fd);
+				return -1;
+			}
+			lseek(fd, 0, SEEK_SET);
+		}
+		size = unzstd(fd, zfd, NULL, 0, NULL);
+		break;
+#endif
+
+#ifndef NO_LZ4_SUPPORT
+	case FT_LZ4:
+		/* -l has to decompress, which is all -t does. */
+		size = unlz4(fd, lflag ? -1 : zfd, NULL, 0, NULL);
+		if (lflag) {
+			print_list_out(in_size, size, file);
+			if (!tflag) {
+				close(fd);
+				return -1;
+			}
+		}
+		break;
+#endif
 #ifndef SMALL
 	case FT_UNKNOWN:
 		if (lflag) {
@@ -1787,6 +2151,17 @@ file_uncompress(char *file, char *outfile, size_t outsize)
 			}
 		}
 
+#ifndef SMALL
+		if (Iflag)
+			size = gz_index(fd, file);
+		else if (range_off != -1)
+			size = gz_range(fd, zfd, file);
+		else if (pflag > 1 && worker == 0 && S_ISREG(isb.st_mode))
+			size = gz_uncompress_mt(fd, zfd, isb.st_size, file);
+		else if (tflag)
+			size = gz_test(fd, file);
+		else
+#endif
 		size = gz_uncompress(fd, zfd, NULL, 0, NULL, file);
 		break;
 	}
@@ -1840,7 +2215,7 @@ file_uncompress(char *file, char *outfile, size_t outsize)
 	}
 #ifndef SMALL
 	copymodes(ofd, &isb, outfile);
-	remove_file = NULL;
+	remove_files[worker] = NULL;
 #endif
 	close(ofd);
 	unlink_input(file, &isb);
@@ -1860,8 +2235,9 @@ file_uncompress(char *file, char *outfile, size_t outsize)
 static void
 check_siginfo(void)
 {
-	if (print_info == 0)
+	if (print_info == print_info_seen)
 		return;
+	print_info_seen = print_info;
 	if (infile) {
 		if (infile_total) {
 			int pcent = (int)((100.0 * infile_current) / infile_total);
@@ -1873,40 +2249,64 @@ check_siginfo(void)
 			fprintf(stderr, "%s: done %llu bytes\n",
 				infile, (unsigned long long)infile_current);
 	}
-	print_info = 0;
 }
 
 static off_t
 cat_fd(unsigned char * prepend, size_t count, off_t *gsizep, int fd)
 {
 	char buf[BUFLEN];
+	struct mapped m;
+	struct iovec iov[2];
 	off_t in_tot;
-	ssize_t w;
+	ssize_t rv;
 
+	/* The prepended bytes go out with the first of the rest. */
 	in_tot = count;
-	w = write_retry(STDOUT_FILENO, prepend, count);
-	if (w == -1 || (size_t)w != count) {
-		maybe_warn("write to stdout");
-		return -1;
-	}
+	iov[0].iov_base = prepend;
+	iov[0].iov_len = count;
+	map_input(fd, &m);
 	for (;;) {
-		ssize_t rv;
+		u_char *p;
 
-		rv = read(fd, buf, sizeof buf);
-		if (rv == 0)
-			break;
+		if ((rv = map_next(&m, &p)) == 0) {
+			p = (u_char *)buf;
+			rv = read(fd, buf, sizeof buf);
+		}
 		if (rv < 0) {
 			maybe_warn("read from fd %d", fd);
+			/* What came before still goes out, as it used to. */
+			if (count != 0 && write_retry(STDOUT_FILENO, prepend,
+			    count) != (ssize_t)count) {
+				maybe_warn("write to stdout");
+				unmap_input(&m);
+				return -1;
+			}
 			break;
 		}
 		infile_newdata(rv);
 
-		if (write_retry(STDOUT_FILENO, buf, rv) != rv) {
-			maybe_warn("write to stdout");
+		iov[1].iov_base = p;
+		iov[1].iov_len = rv;
+		if (writev_retry(STDOUT_FILENO, iov, 2) !=
+		    (ssize_t)(count + rv)) {
+			/* The mapped file was cut short under the write. */
+			if (errno == EFAULT && p != (u_char *)buf) {
+				errno = EIO;
+				maybe_warn("read from fd %d", fd);
+			} else
+				maybe_warn("write to stdout");
+			if (count != 0) {
+				unmap_input(&m);
+				return -1;
+			}
 			break;
 		}
 		in_tot += rv;
+		iov[0].iov_len = count = 0;
+		if (rv == 0)
+			break;
 	}
+	unmap_input(&m);
 
 	if (gsizep)
 		*gsizep = in_tot;
@@ -1932,6 +2332,10 @@ handle_stdin(void)
 		maybe_warnx("standard input is a terminal -- ignoring");
 		goto out;
 	}
+	if (Iflag || range_off != -1) {
+		maybe_warnx("--index and --range need a file name");
+		goto out;
+	}
 #endif
 
 	if (fstat(STDIN_FILENO, &isb) < 0) {
@@ -2008,6 +2412,18 @@ handle_stdin(void)
 		usize = unlz(STDIN_FILENO, STDOUT_FILENO,
 			     (char *)fourbytes, sizeof fourbytes, &gsize);
 		break;
+#endif
+#ifndef NO_ZSTD_SUPPORT
+	case FT_ZSTD:
+		usize = unzstd(STDIN_FILENO, STDOUT_FILENO,
+			       (char *)fourbytes, sizeof fourbytes, &gsize);
+		break;
+#endif
+#ifndef NO_LZ4_SUPPORT
+	case FT_LZ4:
+		usize = unlz4(STDIN_FILENO, STDOUT_FILENO,
+			      (char *)fourbytes, sizeof fourbytes, &gsize);
+		break;
 #endif
 	}
 
@@ -2015,7 +2431,7 @@ handle_stdin(void)
         if (vflag && !tflag && usize != -1 && gsize != -1)
 		print_verbage(NULL, NULL, usize, gsize);
 	if (vflag && tflag)
-		print_test("(stdin)", usize != -1);
+		print_test("(stdin)", usize != -1, -1, 0);
 #else
 	(void)&usize;
 #endif
@@ -2136,9 +2552,14 @@ retry:
 		goto out;
 	}
 
-	if (S_ISREG(sb.st_mode))
-		handle_file(path, &sb);
-	else
+	if (S_ISREG(sb.st_mode)) {
+#ifndef SMALL
+		if (tpool)
+			rpool_add(path, &sb);
+		else
+#endif
+			handle_file(path, &sb);
+	} else
 		maybe_warnx("%s is not a regular file", path);
 
 out:
@@ -2152,13 +2573,25 @@ handle_file(char *file, struct stat *sbp)
 {
 	off_t usize, gsize;
 	char	outfile[PATH_MAX];
+#ifndef SMALL
+	struct timespec start, end;
+#endif
 
 	infile_set(file, sbp->st_size);
 	if (dflag) {
+#ifndef SMALL
+		if (vflag > 1 && tflag)
+			clock_gettime(CLOCK_MONOTONIC, &start);
+#endif
 		usize = file_uncompress(file, outfile, sizeof(outfile));
 #ifndef SMALL
-		if (vflag && tflag)
-			print_test(file, usize != -1);
+		if (vflag > 1 && tflag) {
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			print_test(file, usize != -1, usize,
+			    (end.tv_sec - start.tv_sec) +
+			    (end.tv_nsec - start.tv_nsec) / 1e9);
+		} else if (vflag && tflag)
+			print_test(file, usize != -1, -1, 0);
 #endif
 		if (usize == -1)
 			return;
@@ -2178,6 +2611,42 @@ handle_file(char *file, struct stat *sbp)
 }
 
 #ifndef SMALL
+/*
+ * With -r and -p, the files found by handle_dir() are handed to pflag
+ * worker threads which each compress or uncompress a whole file at a
+ * time.  Whatever a job would print is collected in memory, and printed
+ * in the order that the files were found once the job and all those
+ * before it are done, so the output is the same as without -p.
+ */
+struct rjob {
+	char		*path;
+	struct stat	 sb;
+	char		*msg;		/* what went to stderr */
+	size_t		 msglen;
+	char		*list;		/* what went to stdout, for -l */
+	size_t		 listlen;
+	int		 listed;	/* print_list() left out its header */
+	int		 exit_value;
+	int		 done;
+};
+
+static struct {
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 work;		/* a job has been queued */
+	pthread_cond_t	 done;		/* a job has been finished */
+	pthread_t	*tids;
+	struct rjob	*jobs;
+	u_int		 njobs;
+	u_int		 next;		/* next job to hand to a worker */
+	u_int		 queued;	/* jobs queued so far */
+	u_int		 printed;	/* jobs printed so far */
+	int		 quit;
+} rpool = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+	.work = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+};
+
 /* this is used with -r to recursively descend directories */
 static void
 handle_dir(char *dir)
@@ -2185,6 +2654,10 @@ handle_dir(char *dir)
 	char *path_argv[2];
 	FTS *fts;
 	FTSENT *entry;
+	int pool;
+
+	/* Files written to stdout mustn't be mixed up. */
+	pool = pflag > 1 && (cflag == 0 || tflag);
 
 	path_argv[0] = dir;
 	path_argv[1] = 0;
@@ -2206,12 +2679,145 @@ handle_dir(char *dir)
 			maybe_warn("%s", entry->fts_path);
 			continue;
 		case FTS_F:
-			handle_file(entry->fts_path, entry->fts_statp);
+			if (pool)
+				rpool_add(entry->fts_path, entry->fts_statp);
+			else
+				handle_file(entry->fts_path, entry->fts_statp);
 		}
 	}
 	if (errno != 0)
 		warn("error with fts_read %s", dir);
 	(void)fts_close(fts);
+	rpool_finish();
+}
+
+static void *
+rpool_worker(void *arg)
+{
+	struct rjob *job;
+
+	worker = (int)(intptr_t)arg;
+	pthread_mutex_lock(&rpool.mtx);
+	for (;;) {
+		while (!rpool.quit && rpool.next == rpool.queued)
+			pthread_cond_wait(&rpool.work, &rpool.mtx);
+		if (rpool.next == rpool.queued)
+			break;
+		job = &rpool.jobs[rpool.next++ % rpool.njobs];
+		pthread_mutex_unlock(&rpool.mtx);
+
+		job_err = open_memstream(&job->msg, &job->msglen);
+		job_out = open_memstream(&job->list, &job->listlen);
+		if (job_err == NULL || job_out == NULL)
+			maybe_err("open_memstream");
+		rjob = job;
+		exit_value = 0;
+		handle_file(job->path, &job->sb);
+		job->exit_value = exit_value;
+		fclose(job_err);
+		fclose(job_out);
+		job_err = job_out = NULL;
+		rjob = NULL;
+
+		pthread_mutex_lock(&rpool.mtx);
+		job->done = 1;
+		pthread_cond_broadcast(&rpool.done);
+	}
+	pthread_mutex_unlock(&rpool.mtx);
+	return (NULL);
+}
+
+/* Print the output of the oldest job, waiting for it if need be. */
+static void
+rpool_print(void)
+{
+	struct rjob *job;
+
+	job = &rpool.jobs[rpool.printed++ % rpool.njobs];
+	pthread_mutex_lock(&rpool.mtx);
+	while (!job->done)
+		pthread_cond_wait(&rpool.done, &rpool.mtx);
+	pthread_mutex_unlock(&rpool.mtx);
+
+	if (job->listed)
+		print_list_header();
+	fwrite(job->list, 1, job->listlen, stdout);
+	fwrite(job->msg, 1, job->msglen, stderr);
+	fflush(stdout);
+	fflush(stderr);
+	if (job->exit_value > exit_value)
+		exit_value = job->exit_value;
+	free(job->list);
+	free(job->msg);
+	free(job->path);
+}
+
+/* queue a file found by handle_dir() for the -r workers */
+static void
+rpool_add(const char *path, const struct stat *sbp)
+{
+	struct rjob *job;
+	int error, done;
+	u_int i;
+
+	if (rpool.tids == NULL) {
+		rpool.njobs = pflag * 4;
+		rpool.jobs = calloc(rpool.njobs, sizeof(*rpool.jobs));
+		rpool.tids = calloc(pflag, sizeof(*rpool.tids));
+		if (rpool.jobs == NULL || rpool.tids == NULL)
+			maybe_err("malloc failed");
+		for (i = 0; i < (u_int)pflag; i++)
+			if ((error = pthread_create(&rpool.tids[i], NULL,
+			    rpool_worker, (void *)(intptr_t)(i + 1))) != 0) {
+				errno = error;
+				maybe_err("pthread_create");
+			}
+	}
+
+	/* Print whatever is ready, and make room for this job. */
+	while (rpool.printed != rpool.queued) {
+		job = &rpool.jobs[rpool.printed % rpool.njobs];
+		pthread_mutex_lock(&rpool.mtx);
+		done = job->done;
+		pthread_mutex_unlock(&rpool.mtx);
+		if (!done && rpool.queued - rpool.printed < rpool.njobs)
+			break;
+		rpool_print();
+	}
+
+	job = &rpool.jobs[rpool.queued % rpool.njobs];
+	memset(job, 0, sizeof(*job));
+	if ((job->path = strdup(path)) == NULL)
+		maybe_err("malloc failed");
+	job->sb = *sbp;
+	pthread_mutex_lock(&rpool.mtx);
+	rpool.queued++;
+	pthread_cond_signal(&rpool.work);
+	pthread_mutex_unlock(&rpool.mtx);
+}
+
+/* wait for the -r workers to finish and print the rest of their output */
+static void
+rpool_finish(void)
+{
+	u_int i;
+
+	if (rpool.tids == NULL)
+		return;
+	while (rpool.printed != rpool.queued)
+		rpool_print();
+	pthread_mutex_lock(&rpool.mtx);
+	rpool.quit = 1;
+	pthread_cond_broadcast(&rpool.work);
+	pthread_mutex_unlock(&rpool.mtx);
+	for (i = 0; i < (u_int)pflag; i++)
+		pthread_join(rpool.tids[i], NULL);
+	free(rpool.tids);
+	free(rpool.jobs);
+	rpool.tids = NULL;
+	rpool.jobs = NULL;
+	rpool.next = rpool.queued = rpool.printed = 0;
+	rpool.quit = 0;
 }
 #endif
 
@@ -2260,26 +2866,36 @@ print_ratio(off_t in, off_t out, FILE *where)
 static void
 print_verbage(const char *file, const char *nfile, off_t usize, off_t gsize)
 {
+	FILE *fp = ERR_FP;
+
 	if (file)
-		fprintf(stderr, "%s:%s  ", file,
+		fprintf(fp, "%s:%s  ", file,
 		    strlen(file) < 7 ? "\t\t" : "\t");
-	print_ratio(usize, gsize, stderr);
+	print_ratio(usize, gsize, fp);
 	if (nfile)
-		fprintf(stderr, " -- replaced with %s", nfile);
-	fprintf(stderr, "\n");
-	fflush(stderr);
+		fprintf(fp, " -- replaced with %s", nfile);
+	fprintf(fp, "\n");
+	fflush(fp);
 }
 
-/* print test results */
+/*
+ * print test results, and with -vv how long the test took for the usize
+ * bytes of uncompressed data (usize is -1 if not known)
+ */
 static void
-print_test(const char *file, int ok)
+print_test(const char *file, int ok, off_t usize, double secs)
 {
 
 	if (exit_value == 0 && ok == 0)
 		exit_value = 1;
-	fprintf(stderr, "%s:%s  %s\n", file,
+	fprintf(ERR_FP, "%s:%s  %s", file,
 	    strlen(file) < 7 ? "\t\t" : "\t", ok ? "OK" : "NOT OK");
-	fflush(stderr);
+	if (ok && usize != -1)
+		fprintf(ERR_FP, "  %jd bytes in %.3f s, %.1f MB/s",
+		    (intmax_t)usize, secs,
+		    secs > 0 ? usize / secs / 1000000 : 0.0);
+	fprintf(ERR_FP, "\n");
+	fflush(ERR_FP);
 }
 #endif
 
@@ -2291,23 +2907,20 @@ print_test(const char *file, int ok)
 static void
 print_list(int fd, off_t out, const char *outfile, time_t ts)
 {
-	static int first = 1;
 #ifndef SMALL
+	static pthread_mutex_t tot_mtx = PTHREAD_MUTEX_INITIALIZER;
 	static off_t in_tot, out_tot;
 	uint32_t crc = 0;
 #endif
 	off_t in = 0, rv;
 
-	if (first) {
 #ifndef SMALL
-		if (vflag)
-			printf("method  crc     date  time  ");
+	/* rpool_print() puts the header in front of the first -r job. */
+	if (rjob != NULL)
+		rjob->listed = 1;
+	else
 #endif
-		if (qflag == 0)
-			printf("  compressed uncompressed  "
-			       "ratio uncompressed_name\n");
-	}
-	first = 0;
+	print_list_header();
 
 	/* print totals? */
 #ifndef SMALL
@@ -2343,27 +2956,50 @@ print_list(int fd, off_t out, const char *outfile, time_t ts)
 	if (vflag && fd == -1)
 		printf("                            ");
 	else if (vflag) {
-		char *date = ctime(&ts);
+		char date[26];
 
 		/* skip the day, 1/100th second, and year */
-		date += 4;
-		date[12] = 0;
-		printf("%5s %08x %11s ", "defla"/*XXX*/, crc, date);
+		ctime_r(&ts, date);
+		date[16] = 0;
+		fprintf(OUT_FP, "%5s %08x %11s ", "defla"/*XXX*/, crc,
+		    date + 4);
 	}
+	pthread_mutex_lock(&tot_mtx);
 	in_tot += in;
 	out_tot += out;
+	pthread_mutex_unlock(&tot_mtx);
 #else
 	(void)&ts;	/* XXX */
 #endif
 	print_list_out(out, in, outfile);
 }
 
+static void
+print_list_header(void)
+{
+	static int first = 1;
+
+	if (first) {
+#ifndef SMALL
+		if (vflag)
+			printf("method  crc     date  time  ");
+#endif
+		if (qflag == 0)
+			printf("  compressed uncompressed  "
+			       "ratio uncompressed_name\n");
+	}
+	first = 0;
+}
+
 static void
 print_list_out(off_t out, off_t in, const char *outfile)
 {
-	printf("%12llu %12llu ", (unsigned long long)out, (unsigned long long)in);
-	print_ratio(in, out, stdout);
-	printf(" %s\n", outfile);
+	FILE *fp = OUT_FP;
+
+	fprintf(fp, "%12llu %12llu ", (unsigned long long)out,
+	    (unsigned long long)in);
+	print_ratio(in, out, fp);
+	fprintf(fp, " %s\n", outfile);
 }
 
 /* display the usage of NetBSD gzip */
@@ -2376,7 +3012,8 @@ usage(void)
 #ifdef SMALL
     "usage: %s [-" OPT_LIST "] [<file> [<file> ...]]\n",
 #else
-    "usage: %s [-123456789acdfhklLNnqrtVv] [-S .suffix] [<file> [<file> ...]]\n"
+    "usage: %s [-123456789acdfhklLNnqrtVv] [-p processes] [-S .suffix]\n"
+    "       [<file> [<file> ...]]\n"
     " -1 --fast            fastest (worst) compression\n"
     " -2 .. -8             set compression level\n"
     " -9 --best            best (slowest) compression\n"
@@ -2390,13 +3027,24 @@ usage(void)
     " -l --list            list compressed file contents\n"
     " -N --name            save or restore original file name and time stamp\n"
     " -n --no-name         don't save original file name or time stamp\n"
+    " -p --processes n     compress or uncompress using n threads\n"
     " -q --quiet           output no warnings\n"
     " -r --recursive       recursively compress files in directories\n"
     " -S .suf              use suffix .suf instead of .gz\n"
     "    --suffix .suf\n"
     " -t --test            test compressed file\n"
     " -V --version         display program version\n"
-    " -v --verbose         print extra statistics\n",
+    " -v --verbose         print extra statistics\n"
+    "    --index           test files and write an index for --range\n"
+    "    --index-span n    put index access points n MiB apart\n"
+    "    --range off:len   uncompress len bytes from offset off\n"
+#ifndef NO_ZSTD_SUPPORT
+    "    --zstd            compress to zstd instead of gzip\n"
+#endif
+#ifndef NO_LZ4_SUPPORT
+    "    --lz4             compress to lz4 instead of gzip\n"
+#endif
+    ,
 #endif
 	    getprogname());
 	exit(0);
@@ -2444,6 +3092,18 @@ display_version(void)
 #ifndef NO_LZ_SUPPORT
 #include "unlz.c"
 #endif
+#ifndef NO_ZSTD_SUPPORT
+#include "unzstd.c"
+#endif
+#ifndef NO_LZ4_SUPPORT
+#include "unlz4.c"
+#endif
+#ifndef SMALL
+#include "pgzip.c"
+#include "pgunzip.c"
+#include "gzindex.c"
+#include "gztest.c"
+#endif
 
 static ssize_t
 read_retry(int fd, void *buf, size_t sz)
@@ -2488,3 +3148,155 @@ write_retry(int fd, const void *buf, size_t sz)
 
 	return sz - left;
 }
+
+/* write_retry() for writev(2); iov is used up in the process */
+static ssize_t
+writev_retry(int fd, struct iovec *iov, int iovcnt)
+{
+	ssize_t ret, tot = 0;
+
+	while (iovcnt > 0) {
+		if (iov->iov_len == 0) {
+			iov++;
+			iovcnt--;
+			continue;
+		}
+		ret = writev(fd, iov, iovcnt);
+		if (ret == -1)
+			return ret;
+		else if (ret == 0)
+			abort();	/* Can't happen */
+		tot += ret;
+		for (; iovcnt > 0 && (size_t)ret >= iov->iov_len; iov++, iovcnt--)
+			ret -= iov->iov_len;
+		if (iovcnt > 0) {
+			iov->iov_base = (char *)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+
+	return tot;
+}
+
+/* the mapping in use by this thread, for map_sigbus() */
+static	__thread struct mapped *volatile map_cur;
+static	pthread_once_t map_once = PTHREAD_ONCE_INIT;
+
+/*
+ * A mapped file that is truncated behind our back raises SIGBUS on the
+ * pages past its new end.  Put zero pages in place of the mapping so the
+ * code reading it can carry on, and note it for map_next(), which turns
+ * it into a read error.  Any other SIGBUS is fatal as usual.
+ */
+static void
+map_sigbus(int signo, siginfo_t *info, void *ctx __unused)
+{
+	struct mapped *m = map_cur;
+	char *addr = info->si_addr;
+
+	if (m != NULL && addr >= (char *)m->base &&
+	    addr < (char *)m->base + m->len &&
+	    mmap(m->base, m->len, PROT_READ, MAP_PRIVATE | MAP_ANON | MAP_FIXED,
+	    -1, 0) != MAP_FAILED) {
+		m->fault = 1;
+		return;
+	}
+	signal(signo, SIG_DFL);
+}
+
+static void
+map_setup(void)
+{
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof sa);
+	sa.sa_sigaction = map_sigbus;
+	sa.sa_flags = SA_SIGINFO;
+	sigemptyset(&sa.sa_mask);
+	(void)sigaction(SIGBUS, &sa, NULL);
+}
+
+/*
+ * Map the rest of the regular file fd, so that it can be handed to zlib
+ * straight from the page cache rather than copied out by read(2).  The
+ * file offset is moved to the end of the mapping, so that read(2) picks
+ * up anything that has been appended since once the mapping is used up.
+ * Returns -1, with m empty, where read(2) has to do; small files aren't
+ * worth mapping.
+ */
+static int
+map_input(int fd, struct mapped *m)
+{
+	struct stat sb;
+	off_t off, pgoff;
+
+	memset(m, 0, sizeof(*m));
+	if (pthread_once(&map_once, map_setup) != 0)
+		return (-1);
+	if (fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode) ||
+	    (off = lseek(fd, 0, SEEK_CUR)) < 0 || sb.st_size - off < BUFLEN)
+		return (-1);
+	pgoff = off & (getpagesize() - 1);
+	if ((uintmax_t)(sb.st_size - off + pgoff) > SIZE_MAX)
+		return (-1);
+	m->len = sb.st_size - off + pgoff;
+	m->base = mmap(NULL, m->len, PROT_READ, MAP_SHARED, fd, off - pgoff);
+	if (m->base == MAP_FAILED) {
+		memset(m, 0, sizeof(*m));
+		return (-1);
+	}
+	if (lseek(fd, sb.st_size, SEEK_SET) < 0) {
+		unmap_input(m);
+		return (-1);
+	}
+	(void)madvise(m->base, m->len, MADV_SEQUENTIAL);
+	m->p = (u_char *)m->base + pgoff;
+	m->end = (u_char *)m->base + m->len;
+	m->fd = fd;
+	m->off = off - pgoff;
+	map_cur = m;
+	return (0);
+}
+
+/*
+ * Hand out up to MAPCHUNK more bytes of m in *pp; 0 once it is used up.
+ * If the file no longer holds them, the rest is left to read(2), which
+ * sees the file as it is now.  Returns -1 with errno set if the file
+ * shrank under bytes that had been handed out already.
+ */
+static ssize_t
+map_next(struct mapped *m, u_char **pp)
+{
+	struct stat sb;
+	off_t off;
+	size_t len;
+
+	if (m->fault) {
+		errno = EIO;
+		return (-1);
+	}
+	len = MIN((size_t)(m->end - m->p), MAPCHUNK);
+	if (len == 0)
+		return (0);
+	off = m->off + (m->p - (u_char *)m->base);
+	if (fstat(m->fd, &sb) != 0 || sb.st_size < off + (off_t)len) {
+		if (lseek(m->fd, off, SEEK_SET) < 0)
+			return (-1);
+		m->end = m->p;
+		return (0);
+	}
+	*pp = m->p;
+	m->p += len;
+	return (len);
+}
+
+static void
+unmap_input(struct mapped *m)
+{
+
+	if (m->base != NULL) {
+		map_cur = NULL;
+		(void)munmap(m->base, m->len);
+	}
+	memset(m, 0, sizeof(*m));
+}
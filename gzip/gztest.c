@@ -0,0 +1,247 @@
+/*
+* Copyright (c) 2026 Apple Inc. All rights reserved.
+*
+* @APPLE_LICENSE_HEADER_START@
+*
+* This file contains Original Code and/or Modifications of Original Code
+* as defined in and that are subject to the Apple Public Source License
+* Version 2.0 (the 'License'). You may not use this file except in
+* compliance with the License. Please obtain a copy of the License at
+* http://www.opensource.apple.com/apsl/ and read it before using this
+* file.
+*
+* The Original Code and all software distributed under the License are
+* distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+* EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+* INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+* Please see the License for the specific language governing rights and
+* limitations under the License.
+*
+* @APPLE_LICENSE_HEADER_END@
+*/
+
+/*
+ * The -t engine for gzip files.  Nothing is written, so rather than going
+ * through gz_uncompress() and its output buffer, each member is inflated
+ * with inflateBack(), which uses a ring of GZT_RINGSIZE bytes as both its
+ * output and its window: the ring stays in the cache and the data is
+ * never copied.  The headers and trailers are checked here the way
+ * gz_uncompress() checks them, with the CRC kept up as the ring fills.
+ * The input comes straight from the mapped file where possible.
+ */
+#define	GZT_RINGSIZE	(1U << MAX_WBITS)
+
+struct gzt {
+	int		 in;
+	struct mapped	 m;
+	u_char		*buf;		/* for read(2), past the mapping */
+	u_char		*ring;		/* inflateBack()'s window */
+	const char	*filename;
+	int		 rerror;	/* a read failed */
+	uint32_t	 crc;		/* of the member so far */
+	off_t		 len;
+};
+
+/* Return the next chunk of input in *pp, and its length. */
+static ssize_t
+gzt_fill(struct gzt *t, u_char **pp)
+{
+	ssize_t in_size;
+
+	check_siginfo();
+	if ((in_size = map_next(&t->m, pp)) == 0) {
+		in_size = read(t->in, t->buf, BUFLEN);
+		*pp = t->buf;
+	}
+	if (in_size < 0) {
+		maybe_warn("failed to read %s", t->filename);
+		t->rerror = 1;
+		return (-1);
+	}
+	infile_newdata(in_size);
+	return (in_size);
+}
+
+/* Return the next byte of input, -1 at the end or on error. */
+static int
+gzt_getc(struct gzt *t, z_stream *z)
+{
+	ssize_t in_size;
+	u_char *p;
+
+	if (z->avail_in == 0) {
+		if ((in_size = gzt_fill(t, &p)) <= 0)
+			return (-1);
+		z->next_in = p;
+		z->avail_in = in_size;
+	}
+	z->avail_in--;
+	return (*z->next_in++);
+}
+
+static unsigned
+gzt_in(void *arg, z_const unsigned char **pp)
+{
+	ssize_t in_size;
+	u_char *p;
+
+	if ((in_size = gzt_fill(arg, &p)) <= 0)
+		return (0);
+	*pp = p;
+	return (in_size);
+}
+
+static int
+gzt_out(void *arg, unsigned char *buf, unsigned len)
+{
+	struct gzt *t = arg;
+
+	t->crc = crc32(t->crc, buf, len);
+	t->len += len;
+	return (0);
+}
+
+/*
+ * Test the gzip file in, from its current offset to the end.  Return the
+ * uncompressed size, -1 on error.
+ */
+static off_t
+gz_test(int in, const char *filename)
+{
+	struct gzt t;
+	z_stream z;
+	off_t out_tot = 0, rv = -1;
+	uint32_t val;
+	int c, i, n, flags, error, first = 1;
+
+	memset(&t, 0, sizeof t);
+	t.in = in;
+	t.filename = filename;
+	/* The mapping may give out early, leaving the rest to read(2). */
+	map_input(in, &t.m);
+	if ((t.buf = malloc(BUFLEN)) == NULL ||
+	    (t.ring = malloc(GZT_RINGSIZE)) == NULL)
+		maybe_err("malloc failed");
+
+	memset(&z, 0, sizeof z);
+	if (inflateBackInit(&z, MAX_WBITS, t.ring) != Z_OK) {
+		maybe_warnx("failed to inflateInit");
+		goto out;
+	}
+	for (;; first = 0) {
+		/* As with gz_uncompress(), no input at all is no error. */
+		if ((c = gzt_getc(&t, &z)) == -1) {
+			if (!t.rerror)
+				rv = out_tot;
+			goto stop;
+		}
+		if (c != GZIP_MAGIC0) {
+			if (first) {
+				maybe_warnx("input not gziped (MAGIC0)");
+				goto stop;
+			}
+			maybe_warnx("%s: trailing garbage ignored", filename);
+			exit_value = 2;
+			rv = out_tot;
+			goto stop;
+		}
+		if ((c = gzt_getc(&t, &z)) == -1)
+			goto eof;
+		if (c != GZIP_MAGIC1 && c != GZIP_OMAGIC1) {
+			maybe_warnx("input not gziped (MAGIC1)");
+			goto stop;
+		}
+		if ((c = gzt_getc(&t, &z)) == -1)
+			goto eof;
+		if (c != Z_DEFLATED) {
+			maybe_warnx("unknown compression method");
+			goto stop;
+		}
+		if ((flags = gzt_getc(&t, &z)) == -1)
+			goto eof;
+		/* mtime, extra flags and OS */
+		for (i = 0; i < 6; i++)
+			if (gzt_getc(&t, &z) == -1)
+				goto eof;
+		if (flags & EXTRA_FIELD) {
+			if ((c = gzt_getc(&t, &z)) == -1 ||
+			    (n = gzt_getc(&t, &z)) == -1)
+				goto eof;
+			for (n = c | n << 8; n > 0; n--)
+				if (gzt_getc(&t, &z) == -1)
+					goto eof;
+		}
+		if (flags & ORIG_NAME)
+			while ((c = gzt_getc(&t, &z)) != 0)
+				if (c == -1)
+					goto eof;
+		if (flags & COMMENT)
+			while ((c = gzt_getc(&t, &z)) != 0)
+				if (c == -1)
+					goto eof;
+		if (flags & HEAD_CRC)
+			for (i = 0; i < 2; i++)
+				if (gzt_getc(&t, &z) == -1)
+					goto eof;
+
+		t.crc = crc32(0L, Z_NULL, 0);
+		t.len = 0;
+		error = inflateBack(&z, gzt_in, &t, gzt_out, &t);
+		if (t.rerror)
+			goto stop;
+		switch (error) {
+		case Z_STREAM_END:
+			break;
+		case Z_DATA_ERROR:
+			maybe_warnx("data stream error");
+			goto stop;
+		case Z_MEM_ERROR:
+			maybe_warnx("memory allocation error");
+			goto stop;
+		case Z_BUF_ERROR:
+			/* in() had nothing more to give */
+			if (z.next_in == Z_NULL)
+				goto eof;
+			/* FALLTHROUGH */
+		default:
+			maybe_warnx("decompression error");
+			goto stop;
+		}
+		out_tot += t.len;
+
+		for (val = 0, i = 0; i < 4; i++) {
+			if ((c = gzt_getc(&t, &z)) == -1)
+				goto truncated;
+			val |= (uint32_t)c << (i * 8);
+		}
+		if (val != t.crc) {
+			maybe_warnx("invalid compressed data--crc error");
+			goto stop;
+		}
+		for (val = 0, i = 0; i < 4; i++) {
+			if ((c = gzt_getc(&t, &z)) == -1)
+				goto truncated;
+			val |= (uint32_t)c << (i * 8);
+		}
+		if (val != (uint32_t)t.len) {
+			maybe_warnx("invalid compressed data--length error");
+			goto stop;
+		}
+	}
+
+truncated:
+	if (!t.rerror)
+		maybe_warnx("truncated input");
+	goto stop;
+eof:
+	if (!t.rerror)
+		maybe_warnx("%s: unexpected end of file", filename);
+stop:
+	inflateBackEnd(&z);
+out:
+	unmap_input(&t.m);
+	free(t.buf);
+	free(t.ring);
+	return (rv);
+}
@@ -0,0 +1,307 @@
+/*
+* Copyright (c) 2026 Apple Inc. All rights reserved.
+*
+* @APPLE_LICENSE_HEADER_START@
+*
+* This file contains Original Code and/or Modifications of Original Code
+* as defined in and that are subject to the Apple Public Source License
+* Version 2.0 (the 'License'). You may not use this file except in
+* compliance with the License. Please obtain a copy of the License at
+* http://www.opensource.apple.com/apsl/ and read it before using this
+* file.
+*
+* The Original Code and all software distributed under the License are
+* distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+* EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+* INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+* Please see the License for the specific language governing rights and
+* limitations under the License.
+*
+* @APPLE_LICENSE_HEADER_END@
+*/
+
+/*
+ * Parallel decompression for -p.  A gzip file made of many members, as
+ * written by concatenating gzip files or by block compressors such as
+ * BGZF, can be inflated one member per thread.  Member boundaries are not
+ * recorded anywhere, so the end of each member is guessed by looking for
+ * the next gzip header after its start; the guess is only trusted once
+ * the member has inflated to exactly the length and CRC in the trailer
+ * just before it.  Members are inflated into memory, so only members of
+ * up to PGU_MAXMEMBER bytes are handed to the workers: at the first one
+ * that is larger, or that doesn't check out, the rest of the file is left
+ * to gz_uncompress(), which also does all the error reporting.
+ */
+
+#define	PGU_MAXMEMBER	(16 * 1024 * 1024)
+/* Bound on the compressed size of such a member, headers included. */
+#define	PGU_MAXSPAN	(PGU_MAXMEMBER + PGU_MAXMEMBER / 8 + 256 * 1024)
+/* The smallest member: header, an empty final block and the trailer. */
+#define	PGU_MINMEMBER	20
+
+struct pgu_job {
+	off_t		 start;		/* member is map[start, end) */
+	off_t		 end;
+	u_char		*out;
+	size_t		 outlen;
+	size_t		 outsize;
+	int		 state;		/* PGZ_FREE, _QUEUED, _BUSY or _DONE */
+	int		 error;		/* member didn't check out */
+};
+
+struct pgu {
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 work;		/* a job has been queued */
+	pthread_cond_t	 done;		/* a job has been finished */
+	const u_char	*map;
+	struct pgu_job	*jobs;
+	u_int		 njobs;
+	u_int		 next;		/* next job to hand to a worker */
+	u_int		 queued;	/* jobs queued so far */
+	int		 quit;
+};
+
+/*
+ * Return the offset of the next plausible member header after the member
+ * at pos, size if the member runs to the end of the file, or -1 if it is
+ * too long to be inflated in memory.
+ */
+static off_t
+pgu_next(const u_char *map, off_t pos, off_t size)
+{
+	const u_char *p, *lim;
+
+	if (size - pos <= PGU_MAXSPAN)
+		lim = map + size;
+	else
+		lim = map + pos + PGU_MAXSPAN;
+	for (p = map + pos + PGU_MINMEMBER; p < lim - 3; p++) {
+		p = memchr(p, GZIP_MAGIC0, lim - 3 - p);
+		if (p == NULL)
+			break;
+		if (p[1] == GZIP_MAGIC1 && p[2] == Z_DEFLATED &&
+		    (p[3] & 0xe0) == 0)
+			return (p - map);
+	}
+	return (lim == map + size ? size : -1);
+}
+
+static int
+pgu_inflate(z_stream *z, const u_char *map, struct pgu_job *job)
+{
+	const u_char *p, *q;
+	size_t len, hlen;
+	uint32_t isize;
+	u_char *o;
+	int flags;
+
+	p = map + job->start;
+	len = job->end - job->start;
+	if (len < PGU_MINMEMBER)
+		return (-1);
+	flags = p[3];
+	hlen = 10;
+	if (flags & EXTRA_FIELD)
+		hlen += 2 + (p[hlen] | p[hlen + 1] << 8);
+	if ((flags & ORIG_NAME) && hlen < len) {
+		if ((q = memchr(p + hlen, 0, len - hlen)) == NULL)
+			return (-1);
+		hlen = q - p + 1;
+	}
+	if ((flags & COMMENT) && hlen < len) {
+		if ((q = memchr(p + hlen, 0, len - hlen)) == NULL)
+			return (-1);
+		hlen = q - p + 1;
+	}
+	if (flags & HEAD_CRC)
+		hlen += 2;
+	if (hlen + 8 > len)
+		return (-1);
+
+	isize = le32dec(p + len - 4);
+	/* inflate() wants somewhere to write even for an empty member. */
+	if (isize > job->outsize || job->out == NULL) {
+		if ((o = realloc(job->out, MAX(isize, 1))) == NULL)
+			return (-1);
+		job->out = o;
+		job->outsize = MAX(isize, 1);
+	}
+	if (inflateReset(z) != Z_OK)
+		return (-1);
+	z->next_in = (u_char *)(uintptr_t)(p + hlen);
+	z->avail_in = len - hlen - 8;
+	z->next_out = job->out;
+	z->avail_out = isize;
+	if (inflate(z, Z_FINISH) != Z_STREAM_END || z->avail_in != 0 ||
+	    z->total_out != isize ||
+	    crc32(crc32(0L, Z_NULL, 0), job->out, isize) !=
+	    le32dec(p + len - 8))
+		return (-1);
+	job->outlen = isize;
+	return (0);
+}
+
+static void *
+pgu_worker(void *arg)
+{
+	struct pgu *pu = arg;
+	struct pgu_job *job;
+	z_stream z;
+	int error;
+
+	memset(&z, 0, sizeof z);
+	error = inflateInit2(&z, -MAX_WBITS);
+
+	pthread_mutex_lock(&pu->mtx);
+	for (;;) {
+		while (!pu->quit && pu->next == pu->queued)
+			pthread_cond_wait(&pu->work, &pu->mtx);
+		if (pu->next == pu->queued)
+			break;
+		job = &pu->jobs[pu->next++ % pu->njobs];
+		job->state = PGZ_BUSY;
+		pthread_mutex_unlock(&pu->mtx);
+
+		job->error = error != Z_OK ||
+		    pgu_inflate(&z, pu->map, job) != 0;
+
+		pthread_mutex_lock(&pu->mtx);
+		job->state = PGZ_DONE;
+		pthread_cond_broadcast(&pu->done);
+	}
+	pthread_mutex_unlock(&pu->mtx);
+	if (error == Z_OK)
+		inflateEnd(&z);
+	return (NULL);
+}
+
+/*
+ * Wait for job n and write it out.  Returns 0 on success, 1 if the member
+ * has to be redone by gz_uncompress() and -1 on a write error.
+ */
+static int
+pgu_write(struct pgu *pu, u_int n, int out, off_t *out_tot)
+{
+	struct pgu_job *job;
+
+	job = &pu->jobs[n % pu->njobs];
+	pthread_mutex_lock(&pu->mtx);
+	while (job->state != PGZ_DONE)
+		pthread_cond_wait(&pu->done, &pu->mtx);
+	pthread_mutex_unlock(&pu->mtx);
+
+	if (job->error)
+		return (1);
+	if (tflag == 0 &&
+	    write_retry(out, job->out, job->outlen) != (ssize_t)job->outlen) {
+		maybe_warn("error writing to output");
+		return (-1);
+	}
+	infile_newdata(job->end - job->start);
+	*out_tot += job->outlen;
+	job->state = PGZ_FREE;
+	return (0);
+}
+
+/*
+ * uncompress the regular file in, of the given size, using pflag threads.
+ * Return bytes written, -1 on error.
+ */
+static off_t
+gz_uncompress_mt(int in, int out, off_t size, const char *filename)
+{
+	struct pgu pu;
+	pthread_t *tids;
+	void *map;
+	off_t out_tot = 0, pos, end, redo = -1;
+	u_int i, n, nwritten;
+	int error;
+
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, in, 0);
+	if (map == MAP_FAILED)
+		return (gz_uncompress(in, out, NULL, 0, NULL, filename));
+	(void)madvise(map, size, MADV_SEQUENTIAL);
+
+	memset(&pu, 0, sizeof pu);
+	pthread_mutex_init(&pu.mtx, NULL);
+	pthread_cond_init(&pu.work, NULL);
+	pthread_cond_init(&pu.done, NULL);
+	pu.map = map;
+	pu.njobs = pflag * 2;
+	tids = calloc(pflag, sizeof(*tids));
+	pu.jobs = calloc(pu.njobs, sizeof(*pu.jobs));
+	if (tids == NULL || pu.jobs == NULL)
+		maybe_err("malloc failed");
+	for (i = 0; i < (u_int)pflag; i++)
+		if ((error = pthread_create(&tids[i], NULL, pgu_worker,
+		    &pu)) != 0) {
+			errno = error;
+			maybe_err("pthread_create");
+		}
+
+	error = 0;
+	nwritten = 0;
+	for (n = 0, pos = 0; pos < size; n++, pos = end) {
+		if (n >= pu.njobs) {
+			error = pgu_write(&pu, nwritten, out, &out_tot);
+			if (error != 0) {
+				if (error > 0)
+					redo = pu.jobs[nwritten % pu.njobs].start;
+				break;
+			}
+			nwritten++;
+		}
+		end = pgu_next(map, pos, size);
+		if (end < 0 || le32dec((u_char *)map + end - 4) > PGU_MAXMEMBER) {
+			redo = pos;
+			break;
+		}
+		pu.jobs[n % pu.njobs].start = pos;
+		pu.jobs[n % pu.njobs].end = end;
+		pthread_mutex_lock(&pu.mtx);
+		pu.jobs[n % pu.njobs].state = PGZ_QUEUED;
+		pu.queued++;
+		pthread_cond_signal(&pu.work);
+		pthread_mutex_unlock(&pu.mtx);
+	}
+	if (error == 0)
+		for (; nwritten < pu.queued; nwritten++) {
+			error = pgu_write(&pu, nwritten, out, &out_tot);
+			if (error != 0) {
+				if (error > 0)
+					redo = pu.jobs[nwritten % pu.njobs].start;
+				break;
+			}
+		}
+
+	pthread_mutex_lock(&pu.mtx);
+	pu.quit = 1;
+	pthread_cond_broadcast(&pu.work);
+	pthread_mutex_unlock(&pu.mtx);
+	for (i = 0; i < (u_int)pflag; i++)
+		pthread_join(tids[i], NULL);
+
+	for (i = 0; i < pu.njobs; i++)
+		free(pu.jobs[i].out);
+	free(pu.jobs);
+	free(tids);
+	pthread_mutex_destroy(&pu.mtx);
+	pthread_cond_destroy(&pu.work);
+	pthread_cond_destroy(&pu.done);
+	(void)munmap(map, size);
+
+	if (error < 0)
+		return (-1);
+	if (redo >= 0) {
+		if (lseek(in, redo, SEEK_SET) != redo) {
+			maybe_warn("can't seek %s", filename);
+			return (-1);
+		}
+		if ((size = gz_uncompress(in, out, NULL, 0, NULL,
+		    filename)) == -1)
+			return (-1);
+		out_tot += size;
+	}
+	return (out_tot);
+}
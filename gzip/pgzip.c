@@ -0,0 +1,310 @@
+/*
+* Copyright (c) 2026 Apple Inc. All rights reserved.
+*
+* @APPLE_LICENSE_HEADER_START@
+*
+* This file contains Original Code and/or Modifications of Original Code
+* as defined in and that are subject to the Apple Public Source License
+* Version 2.0 (the 'License'). You may not use this file except in
+* compliance with the License. Please obtain a copy of the License at
+* http://www.opensource.apple.com/apsl/ and read it before using this
+* file.
+*
+* The Original Code and all software distributed under the License are
+* distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+* EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+* INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+* Please see the License for the specific language governing rights and
+* limitations under the License.
+*
+* @APPLE_LICENSE_HEADER_END@
+*/
+
+/*
+ * Parallel compression for -p: the input is cut into PGZ_BLOCK byte
+ * blocks which are deflated independently by a pool of threads, each
+ * block primed with the last 32 KiB of the one before it so that little
+ * compression is lost.  Every block but the last ends with a sync flush,
+ * which leaves the deflate stream on a byte boundary, so the blocks are
+ * simply written out in order as one gzip member that any decompressor
+ * can read.  The CRC of the whole input is put together from the CRCs of
+ * the blocks with crc32_combine().
+ */
+
+#define	PGZ_BLOCK	(128 * 1024)
+#define	PGZ_DICT	(32 * 1024)
+
+struct pgz_job {
+	u_char		*in;
+	size_t		 inlen;
+	u_char		 dict[PGZ_DICT];
+	size_t		 dictlen;
+	u_char		*out;
+	size_t		 outlen;
+	size_t		 outsize;
+	uLong		 crc;
+	int		 last;		/* finish the stream */
+	int		 state;		/* PGZ_FREE, _QUEUED, _BUSY or _DONE */
+	int		 error;		/* deflate() failed */
+};
+
+enum { PGZ_FREE, PGZ_QUEUED, PGZ_BUSY, PGZ_DONE };
+
+struct pgz {
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 work;		/* a job has been queued */
+	pthread_cond_t	 done;		/* a job has been finished */
+	struct pgz_job	*jobs;
+	u_int		 njobs;
+	u_int		 next;		/* next job to hand to a worker */
+	u_int		 queued;	/* jobs queued so far */
+	int		 quit;
+};
+
+static void
+pgz_deflate(z_stream *z, struct pgz_job *job)
+{
+	u_char *p;
+	int error;
+
+	job->crc = crc32(crc32(0L, Z_NULL, 0), job->in, job->inlen);
+	if (deflateReset(z) != Z_OK ||
+	    (job->dictlen != 0 &&
+	    deflateSetDictionary(z, job->dict, job->dictlen) != Z_OK)) {
+		job->error = 1;
+		return;
+	}
+	z->next_in = job->in;
+	z->avail_in = job->inlen;
+	z->next_out = job->out;
+	z->avail_out = job->outsize;
+	for (;;) {
+		error = deflate(z, job->last ? Z_FINISH : Z_SYNC_FLUSH);
+		if (error == Z_STREAM_END ||
+		    (error == Z_OK && z->avail_out != 0))
+			break;
+		if (error != Z_OK && error != Z_BUF_ERROR) {
+			job->error = 1;
+			return;
+		}
+		/* deflateBound() doesn't allow for the flush marker. */
+		p = realloc(job->out, job->outsize * 2);
+		if (p == NULL) {
+			job->error = 1;
+			return;
+		}
+		job->out = p;
+		z->next_out = p + job->outsize - z->avail_out;
+		z->avail_out += job->outsize;
+		job->outsize *= 2;
+	}
+	job->outlen = job->outsize - z->avail_out;
+}
+
+static void *
+pgz_worker(void *arg)
+{
+	struct pgz *pg = arg;
+	struct pgz_job *job;
+	z_stream z;
+	int error;
+
+	memset(&z, 0, sizeof z);
+	error = deflateInit2(&z, numflag, Z_DEFLATED, (-MAX_WBITS), 8,
+	    Z_DEFAULT_STRATEGY);
+
+	pthread_mutex_lock(&pg->mtx);
+	for (;;) {
+		while (!pg->quit && pg->next == pg->queued)
+			pthread_cond_wait(&pg->work, &pg->mtx);
+		if (pg->next == pg->queued)
+			break;
+		job = &pg->jobs[pg->next++ % pg->njobs];
+		job->state = PGZ_BUSY;
+		pthread_mutex_unlock(&pg->mtx);
+
+		if (error != Z_OK)
+			job->error = 1;
+		else
+			pgz_deflate(&z, job);
+
+		pthread_mutex_lock(&pg->mtx);
+		job->state = PGZ_DONE;
+		pthread_cond_broadcast(&pg->done);
+	}
+	pthread_mutex_unlock(&pg->mtx);
+	if (error == Z_OK)
+		deflateEnd(&z);
+	return (NULL);
+}
+
+static void
+pgz_queue(struct pgz *pg, struct pgz_job *job, int last)
+{
+
+	job->last = last;
+	pthread_mutex_lock(&pg->mtx);
+	job->state = PGZ_QUEUED;
+	pg->queued++;
+	pthread_cond_signal(&pg->work);
+	pthread_mutex_unlock(&pg->mtx);
+}
+
+/*
+ * Wait for job n, write it out and free its slot.  Returns 0 on success,
+ * -1 on error after printing a warning.
+ */
+static int
+pgz_write(struct pgz *pg, u_int n, int out, off_t *out_tot, uLong *crc)
+{
+	struct pgz_job *job;
+
+	job = &pg->jobs[n % pg->njobs];
+	pthread_mutex_lock(&pg->mtx);
+	while (job->state != PGZ_DONE)
+		pthread_cond_wait(&pg->done, &pg->mtx);
+	pthread_mutex_unlock(&pg->mtx);
+
+	if (job->error) {
+		maybe_warnx("deflate failed");
+		return (-1);
+	}
+	if (write_retry(out, job->out, job->outlen) != (ssize_t)job->outlen) {
+		maybe_warn("write");
+		return (-1);
+	}
+	*out_tot += job->outlen;
+	*crc = crc32_combine(*crc, job->crc, job->inlen);
+	job->state = PGZ_FREE;
+	return (0);
+}
+
+/* compress input to output using pflag threads. Return bytes read, -1 on error */
+static off_t
+gz_compress_mt(int in, int out, off_t *gsizep, const char *origname,
+    uint32_t mtime)
+{
+	struct pgz pg;
+	struct pgz_job *job, *prev;
+	pthread_t *tids;
+	u_char trailer[8];
+	char header[BUFLEN];
+	off_t in_tot = 0, out_tot = 0;
+	ssize_t in_size;
+	u_int i, n, nwritten;
+	uLong crc;
+	int error, hlen;
+
+	memset(&pg, 0, sizeof pg);
+	pthread_mutex_init(&pg.mtx, NULL);
+	pthread_cond_init(&pg.work, NULL);
+	pthread_cond_init(&pg.done, NULL);
+
+	/* Enough jobs to keep every worker busy while the oldest is written. */
+	pg.njobs = pflag * 2;
+	tids = calloc(pflag, sizeof(*tids));
+	pg.jobs = calloc(pg.njobs, sizeof(*pg.jobs));
+	if (tids == NULL || pg.jobs == NULL)
+		maybe_err("malloc failed");
+	for (i = 0; i < pg.njobs; i++) {
+		job = &pg.jobs[i];
+		job->outsize = compressBound(PGZ_BLOCK);
+		if ((job->in = malloc(PGZ_BLOCK)) == NULL ||
+		    (job->out = malloc(job->outsize)) == NULL)
+			maybe_err("malloc failed");
+	}
+
+	hlen = gz_mkheader(header, sizeof header, origname, mtime);
+	if (write_retry(out, header, hlen) != hlen) {
+		maybe_warn("write");
+		in_tot = -1;
+		goto out;
+	}
+	out_tot = hlen;
+
+	for (i = 0; i < (u_int)pflag; i++)
+		if ((error = pthread_create(&tids[i], NULL, pgz_worker,
+		    &pg)) != 0) {
+			errno = error;
+			maybe_err("pthread_create");
+		}
+
+	/*
+	 * Read block n + 1 before queueing block n, so that the last block
+	 * is known to be the last when it is queued.
+	 */
+	crc = crc32(0L, Z_NULL, 0);
+	nwritten = 0;
+	prev = NULL;
+	for (n = 0;; n++) {
+		if (n >= pg.njobs &&
+		    pgz_write(&pg, nwritten++, out, &out_tot, &crc) != 0) {
+			in_tot = -1;
+			break;
+		}
+		job = &pg.jobs[n % pg.njobs];
+		in_size = read_retry(in, job->in, PGZ_BLOCK);
+		if (in_size < 0) {
+			maybe_warn("read");
+			in_tot = -1;
+			break;
+		}
+		infile_newdata(in_size);
+		in_tot += in_size;
+		job->inlen = in_size;
+		job->error = 0;
+
+		if (prev != NULL)
+			pgz_queue(&pg, prev, in_size == 0);
+		if (in_size == 0) {
+			/* An empty input still needs an (empty) stream. */
+			if (prev == NULL) {
+				job->dictlen = 0;
+				pgz_queue(&pg, job, 1);
+			}
+			break;
+		}
+		job->dictlen = prev != NULL ? MIN(prev->inlen, PGZ_DICT) : 0;
+		if (job->dictlen != 0)
+			memcpy(job->dict, prev->in + prev->inlen - job->dictlen,
+			    job->dictlen);
+		prev = job;
+	}
+	while (in_tot != -1 && nwritten < pg.queued)
+		if (pgz_write(&pg, nwritten++, out, &out_tot, &crc) != 0)
+			in_tot = -1;
+
+	pthread_mutex_lock(&pg.mtx);
+	pg.quit = 1;
+	pthread_cond_broadcast(&pg.work);
+	pthread_mutex_unlock(&pg.mtx);
+	for (i = 0; i < (u_int)pflag; i++)
+		pthread_join(tids[i], NULL);
+
+	if (in_tot != -1) {
+		for (i = 0; i < 4; i++) {
+			trailer[i] = (crc >> (i * 8)) & 0xff;
+			trailer[i + 4] = (in_tot >> (i * 8)) & 0xff;
+		}
+		if (write_retry(out, trailer, sizeof trailer) != sizeof trailer) {
+			maybe_warn("write");
+			in_tot = -1;
+		} else
+			out_tot += sizeof trailer;
+	}
+
+out:
+	for (i = 0; i < pg.njobs; i++) {
+		free(pg.jobs[i].in);
+		free(pg.jobs[i].out);
+	}
+	free(pg.jobs);
+	free(tids);
+	pthread_mutex_destroy(&pg.mtx);
+	pthread_cond_destroy(&pg.work);
+	pthread_cond_destroy(&pg.done);
+	if (gsizep)
+		*gsizep = out_tot;
+	return in_tot;
+}
@@ -95,6 +95,188 @@ test_tlv_body()
 	    gunzip -tlv bar.gz
 }
 
+atf_test_case parallel
+parallel_body()
+{
+	jot -b "The quick brown fox jumps over the lazy dog" 100000 > bar
+	dd if=/dev/random bs=64k count=16 >> bar 2>/dev/null
+	: > empty
+
+	atf_check -o save:bar2.gz gzip -n -p 2 -c bar
+	atf_check -o save:bar4.gz gzip -n -p 4 -c bar
+	atf_check cmp bar2.gz bar4.gz
+	atf_check -o file:bar gzip -dc bar4.gz
+	atf_check gzip -t bar4.gz
+	atf_check -o save:empty.gz gzip -p 4 -c empty
+	atf_check -o file:empty gzip -dc empty.gz
+	atf_check -s not-exit:0 -e match:"number of processes" \
+	    gzip -p 0 -c bar
+}
+
+atf_test_case parallel_members
+parallel_members_body()
+{
+	jot -b "The quick brown fox jumps over the lazy dog" 100000 > bar
+	split -b 100000 bar part.
+	for f in part.*; do
+		gzip -c $f >> bar.gz
+	done
+	: | gzip -c >> bar.gz
+
+	atf_check -o file:bar gzip -p 4 -dc bar.gz
+	atf_check gzip -p 4 -t bar.gz
+	echo garbage >> bar.gz
+	atf_check -s exit:2 -o file:bar -e match:"trailing garbage" \
+	    gzip -p 4 -dc bar.gz
+}
+
+atf_test_case recursive_parallel
+recursive_parallel_body()
+{
+	mkdir -p one/sub
+	for i in 1 2 3 4 5 6 7 8; do
+		jot -b "line $i" $((i * 1000)) > one/f$i
+		jot -b "line $i" $((i * 500)) > one/sub/g$i
+	done
+	echo "not gzip" > one/sub/bad.gz
+	cp -R one two
+
+	# Same output, in the same order, as without -p.
+	(cd one && gzip -rv . 2> ../err1)
+	(cd two && gzip -p 4 -rv . 2> ../err4)
+	atf_check cmp err1 err4
+	(cd one && gzip -lr . > ../list1)
+	(cd two && gzip -p 4 -lr . > ../list4)
+	atf_check cmp list1 list4
+	(cd one && gzip -drv . 2> ../err1)
+	(cd two && gzip -p 4 -drv . 2> ../err4)
+	atf_check cmp err1 err4
+	atf_check diff -r one two
+}
+
+atf_test_case index_range
+index_range_body()
+{
+	jot 1000000 > bar
+	atf_check gzip -k bar
+
+	# Without an index, then with one.
+	tail -c +3000001 bar | head -c 100000 > expect
+	atf_check -o file:expect gzip -dc --range=3000000:100000 bar.gz
+	atf_check gzip --index --index-span 1 bar.gz
+	atf_check test -s bar.gz.gzidx
+	atf_check -o file:expect gzip -dc --range=3000000:100000 bar.gz
+	tail -c +6000001 bar > expect
+	atf_check -o file:expect gzip -dc --range=6000000: bar.gz
+	atf_check -o empty gzip -dc --range=100000000:10 bar.gz
+
+	# A stale index is ignored.
+	touch -t 200001010000 bar.gz
+	atf_check -o file:expect -e match:"out of date" \
+	    gzip -dc --range=6000000: bar.gz
+	atf_check -s not-exit:0 -e match:"invalid range" \
+	    gzip -dc --range=x bar.gz
+}
+
+atf_test_case test_parallel
+test_parallel_body()
+{
+	jot 200000 > bar
+	gzip -c bar > a.gz
+	cat a.gz a.gz > b.gz
+	size=$(wc -c < a.gz)
+	head -c $((size / 2)) a.gz > c.gz
+	cp a.gz d.gz
+	printf '\377\377\377\377' | dd of=d.gz bs=1 seek=$((size - 8)) \
+	    conv=notrunc 2>/dev/null
+
+	atf_check -e match:'^b.gz:[[:space:]]+OK  2577790 bytes in ' \
+	    gzip -tvv b.gz
+	atf_check -s exit:1 -e match:"unexpected end of file" gzip -t c.gz
+	atf_check -s exit:1 -e match:"crc error" gzip -t d.gz
+
+	# Same results, in the same order, as without -p.
+	gzip -tv a.gz b.gz c.gz d.gz 2> err1
+	gzip -p 4 -tv a.gz b.gz c.gz d.gz 2> err4
+	atf_check cmp err1 err4
+}
+
+atf_test_case zstd_lz4
+zstd_lz4_body()
+{
+	jot 100000 > bar
+	for fmt in zstd:zst lz4:lz4; do
+		opt=--${fmt%:*}
+		suf=.${fmt#*:}
+		if ! gzip -h 2>&1 | grep -q -- "$opt "; then
+			continue
+		fi
+
+		cp bar baz
+		atf_check gzip $opt baz
+		atf_check -o file:bar gzip -dc baz$suf
+		atf_check -o match:" 588895 .* baz$suf\$" gzip -l baz$suf
+		atf_check -o empty gzip -t baz$suf
+		atf_check gzip -d baz$suf
+		atf_check cmp bar baz
+
+		# Several frames, several threads and standard input.
+		gzip -p 4 $opt -c bar > baz$suf
+		gzip -1 $opt -c bar >> baz$suf
+		cat bar bar > expect
+		atf_check -o file:expect gzip -dc baz$suf
+		atf_check -o file:expect gzip -dc < baz$suf
+		head -c 1000 baz$suf > short$suf
+		atf_check -s exit:1 -e match:"truncated input" gzip -t short$suf
+
+		# An explicit -S wins, even if it is .gz.
+		cp bar baz
+		atf_check gzip $opt -S .gz baz
+		atf_check -o file:bar gzip -dc baz.gz
+		rm baz.gz
+	done
+}
+
+atf_test_case xz_parallel
+xz_parallel_body()
+{
+	jot 200000 > bar
+	xz -T 2 --block-size=100000 -c bar > bar.xz
+
+	atf_check -o file:bar gzip -p 4 -dc bar.xz
+	atf_check -o empty gzip -p 4 -t bar.xz
+	head -c 10000 bar.xz > short.xz
+	atf_check -s not-exit:0 -o ignore -e match:"Unexpected end of input" \
+	    gzip -p 4 -dc short.xz
+}
+
+atf_test_case lzip
+lzip_body()
+{
+	(jot 100; jot -b abcabc 50; head -c 300 /dev/zero | tr '\0' z; echo) > bar
+	# lzip(1) may not be installed, so this is bar as an lzip member.
+	printf '\114\132\111\120\001\027\000\030\202\202\217\042\116\370\246\125' > bar.lz
+	printf '\367\360\231\245\045\015\220\105\221\132\121\264\233\312\254\334' >> bar.lz
+	printf '\005\062\354\205\122\237\261\110\155\357\334\350\113\271\141\272' >> bar.lz
+	printf '\340\234\123\177\230\310\251\124\016\374\075\052\323\006\327\146' >> bar.lz
+	printf '\104\075\126\144\246\315\075\327\307\037\104\364\030\337\002\013' >> bar.lz
+	printf '\077\342\306\306\173\341\347\177\171\104\034\171\267\102\256\145' >> bar.lz
+	printf '\270\033\265\016\204\341\232\202\006\043\071\132\177\162\252\103' >> bar.lz
+	printf '\372\245\232\037\222\300\276\105\161\171\112\325\223\306\220\012' >> bar.lz
+	printf '\071\255\234\145\207\052\266\032\070\307\341\223\027\312\320\076' >> bar.lz
+	printf '\011\352\260\122\357\353\344\126\054\335\335\241\104\035\205\153' >> bar.lz
+	printf '\166\173\376\235\100\376\354\324\117\377\377\325\071\170\000\220' >> bar.lz
+	printf '\131\144\132\257\003\000\000\000\000\000\000\303\000\000\000\000' >> bar.lz
+	printf '\000\000\000' >> bar.lz
+
+	atf_check -o file:bar gzip -dc bar.lz
+	atf_check -o file:bar gzip -dc < bar.lz
+	atf_check -o empty gzip -t bar.lz
+	head -c 150 bar.lz > short.lz
+	atf_check -s not-exit:0 -o ignore -e match:"uncompress failed" \
+	    gzip -dc short.lz
+}
+
 atf_init_test_cases()
 {
 	atf_add_test_case extract_chmod
@@ -102,4 +284,12 @@ atf_init_test_cases()
 	atf_add_test_case extract_unlink
 	atf_add_test_case cat_force
 	atf_add_test_case test_tlv
+	atf_add_test_case parallel
+	atf_add_test_case parallel_members
+	atf_add_test_case recursive_parallel
+	atf_add_test_case index_range
+	atf_add_test_case test_parallel
+	atf_add_test_case zstd_lz4
+	atf_add_test_case xz_parallel
+	atf_add_test_case lzip
 }
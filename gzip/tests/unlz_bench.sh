@@ -0,0 +1,92 @@
+#!/bin/sh
+#
+# Copyright (c) 2026 Apple Inc. All rights reserved.
+#
+# @APPLE_LICENSE_HEADER_START@
+#
+# This file contains Original Code and/or Modifications of Original Code
+# as defined in and that are subject to the Apple Public Source License
+# Version 2.0 (the 'License'). You may not use this file except in
+# compliance with the License. Please obtain a copy of the License at
+# http://www.opensource.apple.com/apsl/ and read it before using this
+# file.
+#
+# The Original Code and all software distributed under the License are
+# distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+# EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+# INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+# Please see the License for the specific language governing rights and
+# limitations under the License.
+#
+# @APPLE_LICENSE_HEADER_END@
+#
+
+#
+# Compare the lzip decoder of two gzip builds, typically the installed
+# one and a new one:
+#
+#	sh unlz_bench.sh /usr/bin/gzip ./gzip [file.lz ...]
+#
+# Without file arguments, lzip(1) is used to make test data from text and
+# from random bytes.  Each file is decompressed $RUNS times (default 5) by
+# both builds, which must agree on the output; the best times are printed.
+# This is not an ATF test and is not installed.
+#
+
+usage()
+{
+	echo "usage: unlz_bench.sh old-gzip new-gzip [file.lz ...]" >&2
+	exit 2
+}
+
+# Print the best real time of $RUNS runs of "$1 -dc $2".
+best()
+{
+	i=0
+	while [ $i -lt $RUNS ]; do
+		{ time -p "$1" -dcq "$2" > /dev/null; } 2>&1 |
+		    awk '$1 == "real" { print $2 }'
+		i=$((i + 1))
+	done | sort -n | head -n 1
+}
+
+[ $# -ge 2 ] || usage
+old=$1
+new=$2
+shift 2
+: ${RUNS:=5}
+
+tmp=$(mktemp -d "${TMPDIR:-/tmp}/unlz_bench.XXXXXX") || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+if [ $# -eq 0 ]; then
+	if ! command -v lzip > /dev/null; then
+		echo "unlz_bench.sh: lzip not found; name some .lz files" >&2
+		exit 1
+	fi
+	# Text compresses well and exercises matches; random bytes are
+	# nearly all literals.
+	i=0
+	while [ $i -lt 20 ]; do
+		cat /usr/share/dict/words 2> /dev/null || jot 100000
+		i=$((i + 1))
+	done > "$tmp/text"
+	head -c 33554432 /dev/urandom > "$tmp/random"
+	lzip -k "$tmp/text" "$tmp/random" || exit 1
+	set -- "$tmp/text.lz" "$tmp/random.lz"
+fi
+
+printf "%-24s %10s %10s %8s\n" file old new speedup
+for f; do
+	"$old" -dcq "$f" > "$tmp/old.out"
+	"$new" -dcq "$f" > "$tmp/new.out"
+	if ! cmp -s "$tmp/old.out" "$tmp/new.out"; then
+		echo "unlz_bench.sh: $f: outputs differ" >&2
+		exit 1
+	fi
+	to=$(best "$old" "$f")
+	tn=$(best "$new" "$f")
+	printf "%-24s %10s %10s %8s\n" "$(basename "$f")" "$to" "$tn" \
+	    "$(echo "$to $tn" | awk '{ if ($2 > 0) printf "%.2fx", $1 / $2 }')"
+done
@@ -41,7 +41,7 @@ unbzip2(int in, int out, char *pre, size_t prelen, off_t *bytes_in)
 	int		ret, end_of_file, cold = 0;
 	off_t		bytes_out = 0;
 	bz_stream	bzs;
-	static char	*inbuf, *outbuf;
+	static __thread char *inbuf, *outbuf;
 
 	if (inbuf == NULL)
 		inbuf = malloc(BUFLEN);
@@ -122,20 +122,24 @@ lz_st_get_short_rep(int st) {
 	return st < 7 ? 9 : 11;
 }
 
+/* Bit models are probabilities out of BIT_MODEL_TOTAL. */
+typedef uint16_t lz_bm_t;
+
 struct lz_len_model {
-	int choice1;
-	int choice2;
-	int bm_low[POS_STATES][LOW_SYMBOLS];
-	int bm_mid[POS_STATES][MID_SYMBOLS];
-	int bm_high[HIGH_SYMBOLS];
+	lz_bm_t choice1;
+	lz_bm_t choice2;
+	lz_bm_t bm_low[POS_STATES][LOW_SYMBOLS];
+	lz_bm_t bm_mid[POS_STATES][MID_SYMBOLS];
+	lz_bm_t bm_high[HIGH_SYMBOLS];
 };
 
-static uint32_t lz_crc[256];
+/* Tables for slicing-by-8: lz_crc[0] is the usual bytewise table. */
+static uint32_t lz_crc[8][256];
 
 static void
 lz_crc_init(void)
 {
-	for (unsigned i = 0; i < nitems(lz_crc); i++) {
+	for (unsigned i = 0; i < nitems(lz_crc[0]); i++) {
 		unsigned c = i;
 		for (unsigned j = 0; j < 8; j++) {
 			if (c & 1)
@@ -143,82 +147,138 @@ lz_crc_init(void)
 			else
 				c >>= 1;
 		}
-		lz_crc[i] = c;
-      }
+		lz_crc[0][i] = c;
+	}
+	for (unsigned i = 0; i < nitems(lz_crc[0]); i++)
+		for (unsigned j = 1; j < nitems(lz_crc); j++)
+			lz_crc[j][i] = (lz_crc[j - 1][i] >> 8) ^
+			    lz_crc[0][lz_crc[j - 1][i] & 0xFF];
 }
 
 static void
-lz_crc_update(uint32_t *crc, const uint8_t *buf, size_t len)
+lz_crc_update(uint32_t *crcp, const uint8_t *buf, size_t len)
 {
-	for (size_t i = 0; i < len; i++)
-		*crc = lz_crc[(*crc ^ buf[i]) & 0xFF] ^ (*crc >> 8);
+	uint32_t crc = *crcp, lo, hi;
+
+	/* Eight bytes at a time, each through its own table. */
+	for (; len >= 8; buf += 8, len -= 8) {
+		lo = crc ^ le32dec(buf);
+		hi = le32dec(buf + 4);
+		crc = lz_crc[7][lo & 0xFF] ^ lz_crc[6][(lo >> 8) & 0xFF] ^
+		    lz_crc[5][(lo >> 16) & 0xFF] ^ lz_crc[4][lo >> 24] ^
+		    lz_crc[3][hi & 0xFF] ^ lz_crc[2][(hi >> 8) & 0xFF] ^
+		    lz_crc[1][(hi >> 16) & 0xFF] ^ lz_crc[0][hi >> 24];
+	}
+	for (; len > 0; len--)
+		crc = lz_crc[0][(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+	*crcp = crc;
 }
 
+/*
+ * The range decoder reads the input through a buffer of its own rather
+ * than stdio.  Past the end of the input it returns 0xFF bytes, as getc()
+ * did, and sets eof.
+ */
 struct lz_range_decoder {
-	FILE *fp;
+	int fd;
+	const uint8_t *p, *end;		/* unread part of buf */
+	uint8_t *buf;
+	bool eof;
+	bool error;
 	uint32_t code;
 	uint32_t range;
 };
 
+static uint8_t
+lz_rd_fill(struct lz_range_decoder *rd)
+{
+	ssize_t nr;
+
+	check_siginfo();
+	if (rd->eof)
+		return 0xFF;
+	nr = read(rd->fd, rd->buf, BUFLEN);
+	if (nr <= 0) {
+		rd->error = nr < 0;
+		rd->eof = true;
+		return 0xFF;
+	}
+	infile_newdata(nr);
+	rd->p = rd->buf;
+	rd->end = rd->buf + nr;
+	return *rd->p++;
+}
+
+static inline uint8_t
+lz_rd_getc(struct lz_range_decoder *rd)
+{
+	if (rd->p < rd->end)
+		return *rd->p++;
+	return lz_rd_fill(rd);
+}
+
+static inline void
+lz_rd_normalize(struct lz_range_decoder *rd)
+{
+	if (rd->range <= 0x00FFFFFFU) {
+		rd->range <<= 8;
+		rd->code = (rd->code << 8) | lz_rd_getc(rd);
+	}
+}
+
 static int
-lz_rd_create(struct lz_range_decoder *rd, FILE *fp)
+lz_rd_create(struct lz_range_decoder *rd, int fd)
 {
-	rd->fp = fp;
+	memset(rd, 0, sizeof(*rd));
+	rd->buf = malloc(BUFLEN);
+	if (rd->buf == NULL)
+		return -1;
+	rd->fd = fd;
 	rd->code = 0;
 	rd->range = ~0;
 	for (int i = 0; i < 5; i++)
-		rd->code = (rd->code << 8) | (uint8_t)getc(rd->fp);
-	return ferror(rd->fp) ? -1 : 0;
+		rd->code = (rd->code << 8) | lz_rd_getc(rd);
+	return rd->error ? -1 : 0;
 }
 
 static unsigned
 lz_rd_decode(struct lz_range_decoder *rd, int num_bits)
 {
 	unsigned symbol = 0;
+	uint32_t mask;
 
 	for (int i = num_bits; i > 0; i--) {
 		rd->range >>= 1;
-		symbol <<= 1;
-		if (rd->code >= rd->range) {
-			rd->code -= rd->range;
-			symbol |= 1;
-		}
-		if (rd->range <= 0x00FFFFFFU) {
-			rd->range <<= 8; 
-			rd->code = (rd->code << 8) | (uint8_t)getc(rd->fp);
-		}
+		mask = 0U - (rd->code >= rd->range);
+		rd->code -= rd->range & mask;
+		symbol = (symbol << 1) | (mask & 1);
+		lz_rd_normalize(rd);
 	}
 
 	return symbol;
 }
 
-static unsigned
-lz_rd_decode_bit(struct lz_range_decoder *rd, int *bm)
+/*
+ * Decode a bit without branching on it: mask is all ones for a 1 and
+ * selects the new range, code and model, which keeps the CPU from
+ * mispredicting the bits of literals that are close to random.
+ */
+static inline unsigned
+lz_rd_decode_bit(struct lz_range_decoder *rd, lz_bm_t *bm)
 {
-	unsigned symbol;
 	const uint32_t bound = (rd->range >> BIT_MODEL_TOTAL_BITS) * *bm;
-
-	if(rd->code < bound) {
-		rd->range = bound;
-		*bm += (BIT_MODEL_TOTAL - *bm) >> BIT_MODEL_MOVE_BITS;
-		symbol = 0;
-	}
-	else {
-		rd->range -= bound;
-		rd->code -= bound;
-		*bm -= *bm >> BIT_MODEL_MOVE_BITS;
-		symbol = 1;
-	}
-
-	if (rd->range <= 0x00FFFFFFU) {
-		rd->range <<= 8;
-		rd->code = (rd->code << 8) | (uint8_t)getc(rd->fp);
-	}
-	return symbol;
+	const uint32_t mask = 0U - (rd->code >= bound);
+
+	rd->range = (bound & ~mask) | ((rd->range - bound) & mask);
+	rd->code -= bound & mask;
+	*bm += (((BIT_MODEL_TOTAL - *bm) & ~mask) >> BIT_MODEL_MOVE_BITS) -
+	    ((*bm & mask) >> BIT_MODEL_MOVE_BITS);
+	lz_rd_normalize(rd);
+	return mask & 1;
 }
 
 static unsigned
-lz_rd_decode_tree(struct lz_range_decoder *rd, int *bm, int num_bits)
+lz_rd_decode_tree(struct lz_range_decoder *rd, lz_bm_t *bm, int num_bits)
 {
 	unsigned symbol = 1;
 
@@ -229,7 +289,8 @@ lz_rd_decode_tree(struct lz_range_decoder *rd, int *bm, int num_bits)
 }
 
 static unsigned
-lz_rd_decode_tree_reversed(struct lz_range_decoder *rd, int *bm, int num_bits)
+lz_rd_decode_tree_reversed(struct lz_range_decoder *rd, lz_bm_t *bm,
+    int num_bits)
 {
 	unsigned symbol = lz_rd_decode_tree(rd, bm, num_bits);
 	unsigned reversed_symbol = 0;
@@ -243,7 +304,7 @@ lz_rd_decode_tree_reversed(struct lz_range_decoder *rd, int *bm, int num_bits)
 }
 
 static unsigned
-lz_rd_decode_matched(struct lz_range_decoder *rd, int *bm, int match_byte)
+lz_rd_decode_matched(struct lz_range_decoder *rd, lz_bm_t *bm, int match_byte)
 {
 	unsigned symbol = 1;
 
@@ -280,7 +341,8 @@ lz_rd_decode_len(struct lz_range_decoder *rd, struct lz_len_model *lm,
 }
 
 struct lz_decoder {
-	FILE *fin, *fout;
+	int fout;
+	bool werror;
 	off_t pos, ppos, spos, dict_size;
 	bool wrapped;
 	uint32_t crc;
@@ -297,8 +359,9 @@ lz_flush(struct lz_decoder *lz)
 
 	size_t size = (size_t)offs;
 	lz_crc_update(&lz->crc, lz->obuf + lz->spos, size);
-	if (fwrite(lz->obuf + lz->spos, 1, size, lz->fout) != size)
-		return -1;
+	if (!tflag && !lz->werror &&
+	    write_retry(lz->fout, lz->obuf + lz->spos, size) != (ssize_t)size)
+		lz->werror = true;
 
 	lz->wrapped = lz->pos >= lz->dict_size;
 	if (lz->wrapped) {
@@ -312,10 +375,7 @@ lz_flush(struct lz_decoder *lz)
 static void
 lz_destroy(struct lz_decoder *lz)
 {
-	if (lz->fin)
-		fclose(lz->fin);
-	if (lz->fout)
-		fclose(lz->fout);
+	free(lz->rdec.buf);
 	free(lz->obuf);
 }
 
@@ -324,14 +384,7 @@ lz_create(struct lz_decoder *lz, int fin, int fdout, int dict_size)
 {
 	memset(lz, 0, sizeof(*lz));
 
-	lz->fin = fdopen(dup(fin), "r");
-	if (lz->fin == NULL)
-		goto out;
-
-	lz->fout = fdopen(dup(fdout), "w");
-	if (lz->fout == NULL)
-		goto out;
-
+	lz->fout = fdout;
 	lz->pos = lz->ppos = lz->spos = 0;
 	lz->crc = ~0;
 	lz->dict_size = dict_size;
@@ -341,7 +394,7 @@ lz_create(struct lz_decoder *lz, int fin, int fdout, int dict_size)
 	if (lz->obuf == NULL)
 		goto out;
 
-	if (lz_rd_create(&lz->rdec, lz->fin) == -1)
+	if (lz_rd_create(&lz->rdec, fin) == -1)
 		goto out;
 	return 0;
 out:
@@ -371,6 +424,44 @@ lz_put(struct lz_decoder *lz, uint8_t b)
 		lz_flush(lz);
 }
 
+/*
+ * Copy a match of len bytes from distance dist.  Where the source and
+ * destination don't overlap, whole runs up to the end of the dictionary
+ * are copied at once; an overlapping match repeats its first dist + 1
+ * bytes, so it is copied that many at a time.
+ */
+static void
+lz_copy(struct lz_decoder *lz, unsigned dist, unsigned len)
+{
+	off_t src;
+	size_t n;
+
+	if (dist >= lz->pos && !lz->wrapped) {
+		/* Only a corrupt rep match gets here; lz_peek() supplies 0s. */
+		while (len-- > 0)
+			lz_put(lz, lz_peek(lz, dist));
+		return;
+	}
+	while (len > 0) {
+		src = lz->pos - dist - 1;
+		if (src < 0)
+			src += lz->dict_size;
+		n = MIN(len, lz->dict_size - lz->pos);
+		n = MIN(n, lz->dict_size - src);
+		if (dist == 0)
+			memset(lz->obuf + lz->pos, lz->obuf[src], n);
+		else {
+			if (src < lz->pos)
+				n = MIN(n, dist + 1);
+			memmove(lz->obuf + lz->pos, lz->obuf + src, n);
+		}
+		lz->pos += n;
+		len -= n;
+		if (lz->pos == lz->dict_size)
+			lz_flush(lz);
+	}
+}
+
 static off_t
 lz_get_data_position(const struct lz_decoder *lz)
 {
@@ -384,7 +475,7 @@ lz_get_crc(const struct lz_decoder *lz)
 }
 
 static void
-lz_bm_init(int *a, size_t l)
+lz_bm_init(lz_bm_t *a, size_t l)
 {
 	for (size_t i = 0; i < l; i++)
 		a[i] = BIT_MODEL_INIT;
@@ -408,13 +499,13 @@ lz_bm_init(int *a, size_t l)
 static bool
 lz_decode_member(struct lz_decoder *lz)
 {
-	int bm_literal[1 << LITERAL_CONTEXT_BITS][0x300];
-	int bm_match[LZ_STATES][POS_STATES];
-	int bm_rep[4][LZ_STATES];
-	int bm_len[LZ_STATES][POS_STATES];
-	int bm_dis_slot[LZ_STATES][1 << DIS_SLOT_BITS];
-	int bm_dis[MODELED_DISTANCES - DIS_MODEL_END + 1];
-	int bm_align[DIS_ALIGN_SIZE];
+	lz_bm_t bm_literal[1 << LITERAL_CONTEXT_BITS][0x300];
+	lz_bm_t bm_match[LZ_STATES][POS_STATES];
+	lz_bm_t bm_rep[4][LZ_STATES];
+	lz_bm_t bm_len[LZ_STATES][POS_STATES];
+	lz_bm_t bm_dis_slot[LZ_STATES][1 << DIS_SLOT_BITS];
+	lz_bm_t bm_dis[MODELED_DISTANCES - DIS_MODEL_END + 1];
+	lz_bm_t bm_align[DIS_ALIGN_SIZE];
 
 	LZ_BM_INIT2(bm_literal);
 	LZ_BM_INIT2(bm_match);
@@ -436,14 +527,14 @@ lz_decode_member(struct lz_decoder *lz)
 
 	int state = 0;
 
-	while (!feof(lz->fin) && !ferror(lz->fin)) {
+	while (!rd->eof) {
 		const int pos_state = lz_get_data_position(lz) & POS_STATE_MASK;
 		// bit 1
 		if (lz_rd_decode_bit(rd, &bm_match[state][pos_state]) == 0) {
 			const uint8_t prev_byte = lz_peek(lz, 0);
 			const int literal_state =
 			    prev_byte >> (8 - LITERAL_CONTEXT_BITS);
-			int *bm = bm_literal[literal_state];
+			lz_bm_t *bm = bm_literal[literal_state];
 			if (lz_st_is_char(state))
 				lz_put(lz, lz_rd_decode_tree(rd, bm, 8));
 			else {
@@ -523,8 +614,7 @@ lz_decode_member(struct lz_decoder *lz)
 				return false;
 			}
 		}
-		for (int i = 0; i < len; i++)
-			lz_put(lz, lz_peek(lz, rep[0]));
+		lz_copy(lz, rep[0], len);
     	}
 	lz_flush(lz);
 	return false;
@@ -553,7 +643,7 @@ lz_decode(int fin, int fdout, unsigned dict_size, off_t *insize)
 	uint8_t trailer[TRAILER_SIZE];
 
 	for(size_t i = 0; i < nitems(trailer); i++) 
-		trailer[i] = (uint8_t)getc(lz.fin);
+		trailer[i] = lz_rd_getc(&lz.rdec);
 
 	unsigned crc = 0;
 	for (int i = 3; i >= 0; --i) {
@@ -567,6 +657,10 @@ lz_decode(int fin, int fdout, unsigned dict_size, off_t *insize)
 		data_size += trailer[i];
 	}
 
+	if (lz.werror) {
+		maybe_warn("error writing to output");
+		goto out;
+	}
 	if (crc != lz_get_crc(&lz) || data_size != lz_get_data_position(&lz))
 		goto out;
 
@@ -577,12 +671,7 @@ lz_decode(int fin, int fdout, unsigned dict_size, off_t *insize)
 	}
 	if (insize)
 		*insize = rv;
-#if 0
-	/* Does not work with pipes */
-	rv = ftello(lz.fout);
-#else
 	rv = data_size;
-#endif
 out:
 	lz_destroy(&lz);
 	return rv;
@@ -613,8 +702,9 @@ lz_get_dict_size(unsigned char c)
 static off_t
 unlz(int fin, int fout, char *pre, size_t prelen, off_t *bytes_in)
 {
-	if (lz_crc[0] == 0)
-		lz_crc_init();
+	static pthread_once_t lz_crc_once = PTHREAD_ONCE_INIT;
+
+	pthread_once(&lz_crc_once, lz_crc_init);
 
 	char header[HDR_SIZE];
 
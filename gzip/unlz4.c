@@ -0,0 +1,186 @@
+/*
+* Copyright (c) 2026 Apple Inc. All rights reserved.
+*
+* @APPLE_LICENSE_HEADER_START@
+*
+* This file contains Original Code and/or Modifications of Original Code
+* as defined in and that are subject to the Apple Public Source License
+* Version 2.0 (the 'License'). You may not use this file except in
+* compliance with the License. Please obtain a copy of the License at
+* http://www.opensource.apple.com/apsl/ and read it before using this
+* file.
+*
+* The Original Code and all software distributed under the License are
+* distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+* EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+* INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+* Please see the License for the specific language governing rights and
+* limitations under the License.
+*
+* @APPLE_LICENSE_HEADER_END@
+*/
+
+/*
+ * lz4 support, for the frame format written by lz4(1).  unlz4()
+ * decompresses any number of concatenated frames and lz4_compress()
+ * writes a single frame for --lz4.  The frame format keeps no record of
+ * the uncompressed size that covers the whole file, so -l decompresses.
+ */
+#include <lz4frame.h>
+
+#define	LZ4_INBUFLEN	(256 * 1024)
+
+/*
+ * Uncompress in, after the prelen bytes already read into pre, to out.
+ * Nothing is written if out is -1 or with -t.  Return bytes written,
+ * -1 on error.
+ */
+static off_t
+unlz4(int in, int out, char *pre, size_t prelen, off_t *bytes_in)
+{
+	LZ4F_dctx *dctx;
+	u_char *ibuf, *obuf;
+	size_t isize, ipos, ilen, srclen, dstlen, ret = 0;
+	ssize_t in_size;
+	off_t bytes_out = 0, bp;
+
+	if (bytes_in == NULL)
+		bytes_in = &bp;
+	isize = MAX(LZ4_INBUFLEN, prelen);
+	ret = LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION);
+	ibuf = malloc(isize);
+	obuf = malloc(OUTBUFLEN);
+	if (LZ4F_isError(ret) || ibuf == NULL || obuf == NULL)
+		maybe_err("malloc failed");
+
+	memcpy(ibuf, pre, prelen);
+	*bytes_in = prelen;
+	ipos = 0;
+	ilen = prelen;
+	dstlen = 0;
+	for (;;) {
+		check_siginfo();
+		/* A full output buffer may mean there is more to come. */
+		if (ipos == ilen && dstlen < OUTBUFLEN) {
+			in_size = read(in, ibuf, isize);
+			if (in_size < 0) {
+				maybe_warn("read failed");
+				goto fail;
+			}
+			if (in_size == 0)
+				break;
+			infile_newdata(in_size);
+			*bytes_in += in_size;
+			ipos = 0;
+			ilen = in_size;
+		}
+		srclen = ilen - ipos;
+		dstlen = OUTBUFLEN;
+		ret = LZ4F_decompress(dctx, obuf, &dstlen, ibuf + ipos, &srclen,
+		    NULL);
+		if (LZ4F_isError(ret)) {
+			maybe_warnx("%s", LZ4F_getErrorName(ret));
+			goto fail;
+		}
+		ipos += srclen;
+		if (dstlen != 0 && out != -1 && !tflag &&
+		    write_retry(out, obuf, dstlen) != (ssize_t)dstlen) {
+			maybe_warn("error writing to output");
+			goto fail;
+		}
+		bytes_out += dstlen;
+	}
+	/* LZ4F_decompress() returns 0 at the end of each frame. */
+	if (ret != 0) {
+		maybe_warnx("truncated input");
+		goto fail;
+	}
+	LZ4F_freeDecompressionContext(dctx);
+	free(ibuf);
+	free(obuf);
+	return (bytes_out);
+
+fail:
+	LZ4F_freeDecompressionContext(dctx);
+	free(ibuf);
+	free(obuf);
+	return (-1);
+}
+
+#ifndef SMALL
+/* compress input to output as an lz4 frame. Return bytes read, -1 on error */
+static off_t
+lz4_compress(int in, int out, off_t *gsizep)
+{
+	LZ4F_preferences_t prefs;
+	LZ4F_cctx *cctx;
+	struct mapped m;
+	struct stat sb;
+	u_char *ibuf, *obuf, *inp;
+	off_t in_tot = 0, out_tot = 0, off;
+	ssize_t in_size = -1;
+	size_t osize, ret;
+
+	memset(&prefs, 0, sizeof prefs);
+	prefs.frameInfo.blockSizeID = LZ4F_max4MB;
+	prefs.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+	/* Levels from 3 up use lz4's high compression mode. */
+	prefs.compressionLevel = numflag_set ? numflag : 0;
+	if (fstat(in, &sb) == 0 && S_ISREG(sb.st_mode) &&
+	    (off = lseek(in, 0, SEEK_CUR)) >= 0 && sb.st_size >= off)
+		prefs.frameInfo.contentSize = sb.st_size - off;
+
+	osize = LZ4F_compressBound(MAPCHUNK, &prefs);
+	ret = LZ4F_createCompressionContext(&cctx, LZ4F_VERSION);
+	ibuf = malloc(MAPCHUNK);
+	obuf = malloc(osize);
+	if (LZ4F_isError(ret) || ibuf == NULL || obuf == NULL)
+		maybe_err("malloc failed");
+	map_input(in, &m);
+
+	ret = LZ4F_compressBegin(cctx, obuf, osize, &prefs);
+	for (;;) {
+		if (LZ4F_isError(ret)) {
+			maybe_warnx("%s", LZ4F_getErrorName(ret));
+			in_tot = -1;
+			goto out;
+		}
+		if (write_retry(out, obuf, ret) != (ssize_t)ret) {
+			maybe_warn("write");
+			in_tot = -1;
+			goto out;
+		}
+		out_tot += ret;
+		if (in_size == 0)
+			break;
+
+		check_siginfo();
+		if ((in_size = map_next(&m, &inp)) == 0) {
+			in_size = read(in, ibuf, MAPCHUNK);
+			inp = ibuf;
+		}
+		if (in_size < 0) {
+			maybe_warn("read");
+			in_tot = -1;
+			goto out;
+		}
+		infile_newdata(in_size);
+		in_tot += in_size;
+		if (in_size == 0)
+			ret = LZ4F_compressEnd(cctx, obuf, osize, NULL);
+		else
+			ret = LZ4F_compressUpdate(cctx, obuf, osize, inp,
+			    in_size, NULL);
+	}
+
+	if (gsizep)
+		*gsizep = out_tot;
+out:
+	unmap_input(&m);
+	LZ4F_freeCompressionContext(cctx);
+	free(ibuf);
+	free(obuf);
+	return in_tot;
+}
+#endif
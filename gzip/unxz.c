@@ -39,6 +39,13 @@ __FBSDID("$FreeBSD$");
 #include <unistd.h>
 #include <lzma.h>
 
+#define	UNXZ_INBUFLEN	MAPCHUNK
+
+/* lzma_stream_decoder_mt() first appeared in liblzma 5.4.0. */
+#if LZMA_VERSION >= 50040002 && !defined(SMALL)
+#define	UNXZ_MT
+#endif
+
 static off_t
 unxz(int i, int o, char *pre, size_t prelen, off_t *bytes_in)
 {
@@ -47,22 +54,45 @@ unxz(int i, int o, char *pre, size_t prelen, off_t *bytes_in)
 	lzma_ret ret;
 	lzma_action action = LZMA_RUN;
 	off_t bytes_out, bp;
-	uint8_t ibuf[BUFSIZ];
-	uint8_t obuf[BUFSIZ];
+	uint8_t *ibuf, *obuf;
+#ifdef UNXZ_MT
+	lzma_mt mt;
+#endif
 
 	if (bytes_in == NULL)
 		bytes_in = &bp;
 
+	ibuf = malloc(UNXZ_INBUFLEN);
+	obuf = malloc(OUTBUFLEN);
+	if (ibuf == NULL || obuf == NULL)
+		maybe_err("malloc failed");
+
 	strm.next_in = ibuf;
 	memcpy(ibuf, pre, prelen);
-	strm.avail_in = read(i, ibuf + prelen, sizeof(ibuf) - prelen);
+	strm.avail_in = read(i, ibuf + prelen, UNXZ_INBUFLEN - prelen);
 	if (strm.avail_in == (size_t)-1)
 		maybe_err("read failed");
 	infile_newdata(strm.avail_in);
 	strm.avail_in += prelen;
 	*bytes_in = strm.avail_in;
 
-	if ((ret = lzma_stream_decoder(&strm, UINT64_MAX, flags)) != LZMA_OK)
+#ifdef UNXZ_MT
+	/*
+	 * Blocks that record their sizes, as xz -T writes them, are decoded
+	 * on pflag threads; anything else is decoded on this one.  The -r
+	 * workers already keep pflag threads busy.
+	 */
+	if (pflag > 1 && worker == 0) {
+		memset(&mt, 0, sizeof(mt));
+		mt.flags = flags;
+		mt.threads = pflag;
+		mt.memlimit_threading = MAX(lzma_physmem() / 4, 64 << 20);
+		mt.memlimit_stop = UINT64_MAX;
+		ret = lzma_stream_decoder_mt(&strm, &mt);
+	} else
+#endif
+	ret = lzma_stream_decoder(&strm, UINT64_MAX, flags);
+	if (ret != LZMA_OK)
 		maybe_errx("Can't initialize decoder (%d)", ret);
 
 	strm.next_out = NULL;
@@ -72,13 +102,13 @@ unxz(int i, int o, char *pre, size_t prelen, off_t *bytes_in)
 
 	bytes_out = 0;
 	strm.next_out = obuf;
-	strm.avail_out = sizeof(obuf);
+	strm.avail_out = OUTBUFLEN;
 
 	for (;;) {
 		check_siginfo();
 		if (strm.avail_in == 0) {
 			strm.next_in = ibuf;
-			strm.avail_in = read(i, ibuf, sizeof(ibuf));
+			strm.avail_in = read(i, ibuf, UNXZ_INBUFLEN);
 			switch (strm.avail_in) {
 			case (size_t)-1:
 				maybe_err("read failed");
@@ -99,13 +129,14 @@ unxz(int i, int o, char *pre, size_t prelen, off_t *bytes_in)
 		// This way as much data as possible gets written to output
 		// even if decoder detected an error.
 		if (strm.avail_out == 0 || ret != LZMA_OK) {
-			const size_t write_size = sizeof(obuf) - strm.avail_out;
+			const size_t write_size = OUTBUFLEN - strm.avail_out;
 
-			if (write(o, obuf, write_size) != (ssize_t)write_size)
+			if (!tflag && write_retry(o, obuf, write_size) !=
+			    (ssize_t)write_size)
 				maybe_err("write failed");
 
 			strm.next_out = obuf;
-			strm.avail_out = sizeof(obuf);
+			strm.avail_out = OUTBUFLEN;
 			bytes_out += write_size;
 		}
 
@@ -116,6 +147,8 @@ unxz(int i, int o, char *pre, size_t prelen, off_t *bytes_in)
 					ret = LZMA_DATA_ERROR;
 				else {
 					lzma_end(&strm);
+					free(ibuf);
+					free(obuf);
 					return bytes_out;
 				}
 			}
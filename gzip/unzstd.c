@@ -0,0 +1,228 @@
+/*
+* Copyright (c) 2026 Apple Inc. All rights reserved.
+*
+* @APPLE_LICENSE_HEADER_START@
+*
+* This file contains Original Code and/or Modifications of Original Code
+* as defined in and that are subject to the Apple Public Source License
+* Version 2.0 (the 'License'). You may not use this file except in
+* compliance with the License. Please obtain a copy of the License at
+* http://www.opensource.apple.com/apsl/ and read it before using this
+* file.
+*
+* The Original Code and all software distributed under the License are
+* distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+* EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+* INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+* Please see the License for the specific language governing rights and
+* limitations under the License.
+*
+* @APPLE_LICENSE_HEADER_END@
+*/
+
+/*
+ * zstd support.  unzstd() decompresses any number of concatenated frames,
+ * unzstd_len() works out the uncompressed size for -l and zstd_compress()
+ * writes a single frame for --zstd, on pflag threads of libzstd's own when
+ * there are several.
+ */
+#include <zstd.h>
+
+/*
+ * Uncompress in, after the prelen bytes already read into pre, to out.
+ * Nothing is written if out is -1 or with -t.  Return bytes written,
+ * -1 on error.
+ */
+static off_t
+unzstd(int in, int out, char *pre, size_t prelen, off_t *bytes_in)
+{
+	ZSTD_DCtx *dctx;
+	ZSTD_inBuffer ib;
+	ZSTD_outBuffer ob;
+	u_char *ibuf, *obuf;
+	size_t isize, ret = 0;
+	ssize_t in_size;
+	off_t bytes_out = 0, bp;
+
+	if (bytes_in == NULL)
+		bytes_in = &bp;
+	isize = MAX(ZSTD_DStreamInSize(), prelen);
+	dctx = ZSTD_createDCtx();
+	ibuf = malloc(isize);
+	obuf = malloc(OUTBUFLEN);
+	if (dctx == NULL || ibuf == NULL || obuf == NULL)
+		maybe_err("malloc failed");
+
+	memcpy(ibuf, pre, prelen);
+	*bytes_in = prelen;
+	ib.src = ibuf;
+	ib.size = prelen;
+	ib.pos = 0;
+	ob.dst = obuf;
+	ob.size = OUTBUFLEN;
+	ob.pos = 0;
+	for (;;) {
+		check_siginfo();
+		/* A full output buffer may mean there is more to come. */
+		if (ib.pos == ib.size && ob.pos < ob.size) {
+			in_size = read(in, ibuf, isize);
+			if (in_size < 0) {
+				maybe_warn("read failed");
+				goto fail;
+			}
+			if (in_size == 0)
+				break;
+			infile_newdata(in_size);
+			*bytes_in += in_size;
+			ib.size = in_size;
+			ib.pos = 0;
+		}
+		ob.pos = 0;
+		ret = ZSTD_decompressStream(dctx, &ob, &ib);
+		if (ZSTD_isError(ret)) {
+			maybe_warnx("%s", ZSTD_getErrorName(ret));
+			goto fail;
+		}
+		if (ob.pos != 0 && out != -1 && !tflag &&
+		    write_retry(out, obuf, ob.pos) != (ssize_t)ob.pos) {
+			maybe_warn("error writing to output");
+			goto fail;
+		}
+		bytes_out += ob.pos;
+	}
+	/* ZSTD_decompressStream() returns 0 at the end of each frame. */
+	if (ret != 0) {
+		maybe_warnx("truncated input");
+		goto fail;
+	}
+	ZSTD_freeDCtx(dctx);
+	free(ibuf);
+	free(obuf);
+	return (bytes_out);
+
+fail:
+	ZSTD_freeDCtx(dctx);
+	free(ibuf);
+	free(obuf);
+	return (-1);
+}
+
+/*
+ * Return the uncompressed size of the zstd file fd for -l.  This is
+ * added up from the frame headers when they all record it, as zstd
+ * does for regular files, and found by decompressing fd otherwise.
+ */
+static off_t
+unzstd_len(int fd)
+{
+	struct stat sb;
+	unsigned long long fsize;
+	u_char *map, *p;
+	size_t left, n;
+	off_t size = 0;
+
+	if (fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode) || sb.st_size == 0 ||
+	    (uintmax_t)sb.st_size > SIZE_MAX)
+		goto slow;
+	map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		goto slow;
+	for (p = map, left = sb.st_size; left > 0; p += n, left -= n) {
+		n = ZSTD_findFrameCompressedSize(p, left);
+		fsize = ZSTD_getFrameContentSize(p, left);
+		if (ZSTD_isError(n) || fsize == ZSTD_CONTENTSIZE_ERROR ||
+		    fsize == ZSTD_CONTENTSIZE_UNKNOWN) {
+			size = -1;
+			break;
+		}
+		size += fsize;
+	}
+	(void)munmap(map, sb.st_size);
+	if (size != -1)
+		return (size);
+slow:
+	if (lseek(fd, 0, SEEK_SET) != 0)
+		return (-1);
+	return (unzstd(fd, -1, NULL, 0, NULL));
+}
+
+#ifndef SMALL
+/* compress input to output as a zstd frame. Return bytes read, -1 on error */
+static off_t
+zstd_compress(int in, int out, off_t *gsizep)
+{
+	ZSTD_CCtx *cctx;
+	ZSTD_inBuffer ib;
+	ZSTD_outBuffer ob;
+	ZSTD_EndDirective mode;
+	struct mapped m;
+	struct stat sb;
+	u_char *ibuf, *obuf, *inp;
+	off_t in_tot = 0, out_tot = 0, off;
+	ssize_t in_size;
+	size_t ret;
+
+	cctx = ZSTD_createCCtx();
+	ibuf = malloc(BUFLEN);
+	obuf = malloc(OUTBUFLEN);
+	if (cctx == NULL || ibuf == NULL || obuf == NULL)
+		maybe_err("malloc failed");
+	(void)ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel,
+	    numflag_set ? numflag : ZSTD_CLEVEL_DEFAULT);
+	(void)ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+	/* The -r workers already keep pflag threads busy. */
+	if (pflag > 1 && worker == 0)
+		(void)ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, pflag);
+	/* Record the size in the frame header, for -l. */
+	if (fstat(in, &sb) == 0 && S_ISREG(sb.st_mode) &&
+	    (off = lseek(in, 0, SEEK_CUR)) >= 0 && sb.st_size >= off)
+		(void)ZSTD_CCtx_setPledgedSrcSize(cctx, sb.st_size - off);
+	map_input(in, &m);
+
+	do {
+		check_siginfo();
+		if ((in_size = map_next(&m, &inp)) == 0) {
+			in_size = read(in, ibuf, BUFLEN);
+			inp = ibuf;
+		}
+		if (in_size < 0) {
+			maybe_warn("read");
+			in_tot = -1;
+			goto out;
+		}
+		infile_newdata(in_size);
+		in_tot += in_size;
+		mode = in_size == 0 ? ZSTD_e_end : ZSTD_e_continue;
+		ib.src = inp;
+		ib.size = in_size;
+		ib.pos = 0;
+		do {
+			ob.dst = obuf;
+			ob.size = OUTBUFLEN;
+			ob.pos = 0;
+			ret = ZSTD_compressStream2(cctx, &ob, &ib, mode);
+			if (ZSTD_isError(ret)) {
+				maybe_warnx("%s", ZSTD_getErrorName(ret));
+				in_tot = -1;
+				goto out;
+			}
+			if (write_retry(out, obuf, ob.pos) != (ssize_t)ob.pos) {
+				maybe_warn("write");
+				in_tot = -1;
+				goto out;
+			}
+			out_tot += ob.pos;
+		} while (mode == ZSTD_e_end ? ret != 0 : ib.pos != ib.size);
+	} while (mode != ZSTD_e_end);
+
+	if (gsizep)
+		*gsizep = out_tot;
+out:
+	unmap_input(&m);
+	ZSTD_freeCCtx(cctx);
+	free(ibuf);
+	free(obuf);
+	return in_tot;
+}
+#endif